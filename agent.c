@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include "agent.h"
+#include "wire.h"
+
+/* how often running totals are sent, counting from the start */
+#define AGENT_INTERVAL 1000000000UL
+
+/**
+ * Receive a run's command line and request set from the
+ * coordinator. Return 1 on error or 0 on success.
+ */
+static int receive_run(agent* ag, int* argc, char*** argv)
+{
+    unsigned int type;
+    void* body;
+    unsigned long length, i, n;
+    char* p;
+    char** args;
+    FILE* out;
+    int fd;
+
+    if (wire_recv(ag->fd, &type, &body, &length) != 0 || type != MSG_ARGS ||
+            (length > 0 && ((char*)body)[length - 1] != '\0')) {
+        fprintf(stderr, "Coordinator sent no command line\n");
+        return 1;
+    }
+
+    // each argument ends in a NUL; the request set's file name
+    // goes last, in place of the coordinator's URL_FILE
+    for (i=0, n=0; i<length; i++)
+        n += (((char*)body)[i] == '\0');
+    if ((args = malloc((n + 3) * sizeof(char*))) == NULL)
+        return 1;
+    args[0] = "wideload";
+    for (p=body, n=1; p<(char*)body + length; p+=strlen(p) + 1)
+        args[n++] = p;
+    args[n++] = ag->url_filename;
+    args[n] = NULL;
+
+    if (wire_recv(ag->fd, &type, &body, &length) != 0 || type != MSG_FILE) {
+        fprintf(stderr, "Coordinator sent no request set\n");
+        return 1;
+    }
+    strcpy(ag->url_filename, "/tmp/wideload-agent-XXXXXX");
+    if ((fd = mkstemp(ag->url_filename)) < 0 || (out = fdopen(fd, "w")) == NULL) {
+        perror("Could not save the request set");
+        return 1;
+    }
+    if (fwrite(body, 1, length, out) != length || fclose(out) != 0) {
+        perror("Could not save the request set");
+        unlink(ag->url_filename);
+        return 1;
+    }
+    free(body);
+
+    printf("Running for coordinator:");
+    for (i=1; i<n - 1; i++)
+        printf(" %s", args[i]);
+    printf("\n\n");
+    fflush(stdout);
+
+    *argc = n;
+    *argv = args;
+    return 0;
+}
+
+/**
+ * Wait for coordinators on `address` and `port`, running each of
+ * their tests in a child process. Returns only in a child, having received the
+ * run's command line into `argc` and `argv` (with its request set
+ * saved to a temporary file, named last); the parent serves until
+ * it's killed. Return 1 on error or 0 in a child.
+ */
+int agent_serve(agent* ag, const char* address, unsigned long port, int* argc, char*** argv)
+{
+    int listener, fd;
+    pid_t pid;
+
+    if ((listener = wire_listen(address, port)) < 0)
+        return 1;
+
+    // finished runs are never waited for
+    signal(SIGCHLD, SIG_IGN);
+
+    printf("Waiting for coordinators on %s port %lu\n", address, port);
+    fflush(stdout);
+    for (;;) {
+        if ((fd = accept(listener, NULL, NULL)) < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            perror("accept");
+            return 1;
+        }
+        if ((pid = fork()) < 0) {
+            perror("fork");
+            close(fd);
+            continue;
+        }
+        if (pid == 0) {
+            close(listener);
+            memset(ag, 0, sizeof(agent));
+            ag->fd = fd;
+            return receive_run(ag, argc, argv);
+        }
+        close(fd);
+    }
+}
+
+/**
+ * Tell the coordinator the request set is loaded, and wait until
+ * the moment it chooses for every agent to start.
+ * Return 1 on error or 0 on success.
+ */
+int agent_ready(agent* ag)
+{
+    unsigned int type;
+    void* body;
+    unsigned long length, now;
+    struct timespec wait;
+
+    // the requests are loaded (or the stream is open), so their
+    // file is no longer needed
+    unlink(ag->url_filename);
+
+    if (wire_send(ag->fd, MSG_READY, NULL, 0) != 0 ||
+            wire_recv(ag->fd, &type, &body, &length) != 0 ||
+            type != MSG_START || length != sizeof(unsigned long)) {
+        fprintf(stderr, "Lost the coordinator before the start\n");
+        return 1;
+    }
+
+    // the start is in wall clock time, which every agent agrees
+    // on as closely as their clocks are synchronized
+    ag->start = *(unsigned long*)body - wall_offset;
+    free(body);
+    while ((now = nanos()) < ag->start) {
+        wait.tv_sec = (ag->start - now) / 1000000000;
+        wait.tv_nsec = (ag->start - now) % 1000000000;
+        nanosleep(&wait, NULL);
+    }
+    return 0;
+}
+
+static void* agent_thread(void* arg)
+{
+    agent* ag = (agent*)arg;
+    stats snapshot;
+    struct pollfd pfd;
+    unsigned int type;
+    void* body;
+    unsigned long i, length, next;
+
+    if (stats_init(&snapshot)) {
+        fprintf(stderr, "Could not allocate statistics for the coordinator\n");
+        return NULL;
+    }
+
+    pfd.fd = ag->fd;
+    pfd.events = POLLIN;
+    next = ag->start + AGENT_INTERVAL;
+    while (!__atomic_load_n(&ag->done, __ATOMIC_ACQUIRE)) {
+        // the coordinator only speaks during the run to stop it,
+        // and losing it stops the run too
+        if (poll(&pfd, 1, 50) > 0) {
+            if (wire_recv(ag->fd, &type, &body, &length) != 0) {
+                fprintf(stderr, "Lost the coordinator; stopping\n");
+                pfd.fd = -1;
+            } else {
+                free(body);
+            }
+            __atomic_store_n(&stopping, 1, __ATOMIC_RELAXED);
+        }
+
+        if (nanos() < next)
+            continue;
+
+        // the coordinator keeps the latest totals from each agent,
+        // so they're sent whole rather than as differences, and
+        // every agent sends at the same moments
+        stats_clear(&snapshot);
+        for (i=0; i<ag->nthreads; i++)
+            stats_merge(&snapshot, &ag->states[i].stats);
+        if ((body = wire_encode_stats(&snapshot, &length)) != NULL) {
+            wire_send(ag->fd, MSG_STATS, body, length);
+            free(body);
+        }
+        next += AGENT_INTERVAL;
+    }
+
+    stats_free(&snapshot);
+    return NULL;
+}
+
+/**
+ * Start sending the coordinator running totals for every state.
+ * A stop from the coordinator stops the run.
+ * Return 1 on error or 0 on success.
+ */
+int agent_start(agent* ag, threadstate* states, unsigned long nthreads)
+{
+    ag->states = states;
+    ag->nthreads = nthreads;
+    ag->done = 0;
+
+    if (pthread_create(&ag->thread, NULL, agent_thread, ag) != 0) {
+        perror("thread error");
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Stop sending running totals; call once the workers have
+ * finished.
+ */
+void agent_stop(agent* ag)
+{
+    __atomic_store_n(&ag->done, 1, __ATOMIC_RELEASE);
+    pthread_join(ag->thread, NULL);
+}
+
+/**
+ * Send the coordinator the totals for the whole run, and hang up.
+ */
+void agent_finish(agent* ag, const stats* summary)
+{
+    void* body;
+    unsigned long length;
+
+    if ((body = wire_encode_stats(summary, &length)) == NULL ||
+            wire_send(ag->fd, MSG_FINAL, body, length) != 0)
+        fprintf(stderr, "Could not send the coordinator the results\n");
+    free(body);
+    close(ag->fd);
+}
@@ -0,0 +1,57 @@
+#ifndef WIDELOAD_AGENT_H
+#define WIDELOAD_AGENT_H
+
+#include <pthread.h>
+
+#include "loader.h"
+
+/**
+ * One run on behalf of a coordinator: the connection to it, the
+ * request set it sent, and a background thread which sends it the
+ * workers' running totals each second.
+ */
+typedef struct {
+    int            fd;
+    char           url_filename[64];
+    unsigned long  start;
+    threadstate*   states;
+    unsigned long  nthreads;
+    int            done;
+    pthread_t      thread;
+} agent;
+
+/**
+ * Wait for coordinators on `address` and `port`, running each of
+ * their tests in a child process. Returns only in a child, having received the
+ * run's command line into `argc` and `argv` (with its request set
+ * saved to a temporary file, named last); the parent serves until
+ * it's killed. Return 1 on error or 0 in a child.
+ */
+int agent_serve(agent* ag, const char* address, unsigned long port, int* argc, char*** argv);
+
+/**
+ * Tell the coordinator the request set is loaded, and wait until
+ * the moment it chooses for every agent to start.
+ * Return 1 on error or 0 on success.
+ */
+int agent_ready(agent* ag);
+
+/**
+ * Start sending the coordinator running totals for every state.
+ * A stop from the coordinator stops the run.
+ * Return 1 on error or 0 on success.
+ */
+int agent_start(agent* ag, threadstate* states, unsigned long nthreads);
+
+/**
+ * Stop sending running totals; call once the workers have
+ * finished.
+ */
+void agent_stop(agent* ag);
+
+/**
+ * Send the coordinator the totals for the whole run, and hang up.
+ */
+void agent_finish(agent* ag, const stats* summary);
+
+#endif
@@ -0,0 +1,83 @@
+#!/bin/bash
+#
+# Benchmark wideload against wideload-target on this machine (run
+# with `make bench`): the most requests per second it can make at
+# standard concurrency levels, the CPU it spends on each, and how
+# closely the latency it measures matches the latency injected.
+#
+# BENCH_SECONDS (5) sets the length of each run, and BENCH_PORT
+# (18080) the target's port.
+
+SECONDS_PER_RUN=${BENCH_SECONDS:-5}
+PORT=${BENCH_PORT:-18080}
+URLS=$(mktemp /tmp/wideload-bench-XXXXXX)
+TARGET=
+
+stop_target() {
+    if [ -n "$TARGET" ]; then
+        kill $TARGET 2>/dev/null
+        wait $TARGET 2>/dev/null
+        TARGET=
+    fi
+}
+trap 'stop_target; rm -f $URLS' EXIT
+
+# start_target ARGS...: (re)start the target with the given options
+start_target() {
+    stop_target
+    ./wideload-target --port $PORT "$@" > /dev/null &
+    TARGET=$!
+    sleep 0.5
+}
+
+# run ARGS...: run wideload for SECONDS_PER_RUN, and set REQUESTS,
+# FAILURES, P50, P99 (ms) and CPU (seconds, user and system)
+run() {
+    local out times
+    out=$(mktemp /tmp/wideload-bench-XXXXXX)
+    times=$( { TIMEFORMAT='%U %S'; time ./wideload --run-seconds $SECONDS_PER_RUN --no-detailed-results "$@" $URLS > $out 2>/dev/null; } 2>&1 )
+    REQUESTS=$(awk '/^New connections:/ { print $5 }' $out)
+    FAILURES=$(awk '/^Failures:/ { print $2 }' $out)
+    P50=$(awk '/^ +50%:/ { print $2; exit }' $out)
+    P99=$(awk '/^ +99%:/ { print $2; exit }' $out)
+    CPU=$(echo $times | awk '{ print $1 + $2 }')
+    rm -f $out
+}
+
+echo "GET http://127.0.0.1:$PORT/" > $URLS
+
+echo "wideload benchmark: $(./wideload --version 2>&1 | head -1), $(nproc) CPUs, ${SECONDS_PER_RUN}s per run"
+echo
+
+echo "Throughput (no injected latency)"
+echo " engine  concurrency      req/s  cpu us/req      p50      p99 (ms)"
+start_target
+MAX=0
+for level in "easy 1" "easy 10" "easy 100" "multi 1" "multi 10" "multi 100" "multi 1000" "raw 1" "raw 100" "raw 1000"; do
+    set -- $level
+    run --engine $1 --concurrency $2
+    RATE=$(awk -v n=$REQUESTS -v s=$SECONDS_PER_RUN 'BEGIN { printf "%.0f", n / s }')
+    awk -v e=$1 -v c=$2 -v r=$RATE -v cpu=$CPU -v n=$REQUESTS -v p50=$P50 -v p99=$P99 \
+        'BEGIN { printf " %-6s %12d %10d %11.2f %8.3f %8.3f\n", e, c, r, (n ? cpu * 1000000 / n : 0), p50, p99 }'
+    [ $RATE -gt $MAX ] && MAX=$RATE
+done
+echo "Max: $MAX req/s"
+echo
+
+# the expected percentiles of each distribution, in ms
+echo "Accuracy (multi engine, 100 connections)"
+echo " injected        expected p50      p99   measured p50      p99   error p50      p99"
+for delay in "10 10 10" "1-20 10.5 19.81" "exp:5 3.466 23.026"; do
+    set -- $delay
+    start_target --delay $1
+    run --engine multi --concurrency 100
+    awk -v d=$1 -v e50=$2 -v e99=$3 -v p50=$P50 -v p99=$P99 \
+        'BEGIN { printf " %-12s %12.3f %8.3f %14.3f %8.3f %11.3f %8.3f\n", d, e50, e99, p50, p99, p50 - e50, p99 - e99 }'
+done
+echo
+
+echo "Timeouts (10ms injected, 10% held 200ms more, --fail-after 50)"
+start_target --delay 10 --slow 10:200
+run --engine multi --concurrency 100 --fail-after 50
+awk -v n=$REQUESTS -v f=$FAILURES -v p99=$P99 \
+    'BEGIN { printf " requests: %d  failed: %.2f%% (expected 10%%)  p99 of the rest: %.3f ms\n", n, (n ? 100.0 * f / n : 0), p99 }'
@@ -1,13 +1,49 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
 #include <argtable2.h>
 
 #include "main.h"
 #include "cli.h"
+#include "placement.h"
+#include "search.h"
 
 #define NOT_POSITIVE_INT(x) ((x)->count > 0 && (x)->ival[0] < 1)
 #define CLI_ERR(msg) { fprintf(stderr, "%s\n", msg); exit(11); }
 
+/**
+ * Parse --agent's "[ADDRESS:]PORT" into opts. Return 1 on error or
+ * 0 on success.
+ */
+static int parse_agent_address(const char* s, options* opts)
+{
+    const char* colon = strrchr(s, ':');
+    const char* port = (colon != NULL ? colon + 1 : s);
+    unsigned long length;
+    char* end;
+
+    opts->agent_port = strtoul(port, &end, 10);
+    if (*port < '0' || *port > '9' || *end != '\0' || opts->agent_port < 1 || opts->agent_port > 65535)
+        return 1;
+
+    // without an address, only this machine's coordinators are served
+    if (colon == NULL) {
+        opts->agent_address = "127.0.0.1";
+        return 0;
+    }
+    length = colon - s;
+    if (length >= 2 && s[0] == '[' && s[length - 1] == ']') {
+        s++;
+        length -= 2;
+    }
+    if (length == 0 || !(opts->agent_address = strndup(s, length)))
+        return 1;
+    return 0;
+}
+
 /**
  * Parse the command line options and return a struct options
  * after performing validation.
@@ -20,12 +56,43 @@ options command_line_options(int argc, char* argv[])
     struct arg_int* run_seconds = arg_int0("s", "run-seconds", "N", "Length of test in seconds [10]");
     struct arg_int* run_requests = arg_int0("r", "run-requests", "N", "Number of requests to make");
     struct arg_lit* randomize = arg_lit0(NULL, "randomize", "Start each thread at a random position in the URLs file [false]");
+    struct arg_int* seed = arg_int0(NULL, "seed", "N", "Seed for the random choices (the request mix, --randomize and --arrival poisson), to repeat a run exactly");
     struct arg_int* fail_after = arg_int0("f", "fail-after", "N", "Number of milliseconds after which to consider requests failed");
     struct arg_int* fail_status = arg_int0("t", "fail-status", "N", "HTTP status code greater than which to consider requests failed [400]");
+    struct arg_str* engine = arg_str0("e", "engine", "NAME", "Request engine: easy (a thread per connection), multi (event loops) or raw (io_uring event loops without libcurl; http:// only) [easy]");
+    struct arg_int* threads = arg_int0(NULL, "threads", "N", "Number of event loop threads for the multi and raw engines [number of CPUs]");
+    struct arg_lit* http2 = arg_lit0(NULL, "http2", "Use HTTP/2 (h2 by ALPN, or h2c by upgrade), multiplexing requests over each connection; multi engine only");
+    struct arg_lit* h2c = arg_lit0(NULL, "h2c", "As --http2, but speak HTTP/2 to http:// URLs from the start, without upgrading");
+    struct arg_int* streams = arg_int0(NULL, "streams", "N", "With --http2 or --h2c, the most requests in flight on each connection [100]");
+    struct arg_lit* close_on_timeout = arg_lit0(NULL, "close-on-timeout", "With --http2 or --h2c, close the whole connection when a request passes --fail-after, failing its other requests [reset just that stream]");
+    struct arg_lit* standby = arg_lit0(NULL, "standby", "After a failed request drops its connection, connect the replacement before the next request starts; easy engine only");
+    struct arg_int* pipeline = arg_int0(NULL, "pipeline", "N", "Keep up to N requests in flight on each connection, sending each without waiting for the response to the last (HTTP/1.1 pipelining); raw engine only [1]");
+    struct arg_str* cpus = arg_str0(NULL, "cpus", "LIST", "Pin worker threads, one CPU each in turn, to the CPUs in LIST (e.g. 0-7,16-23)");
+    struct arg_str* reserve_cpus = arg_str0(NULL, "reserve-cpus", "LIST", "Keep the CPUs in LIST for the writer and reporter threads, and the workers off them");
+    struct arg_int* rate = arg_int0(NULL, "rate", "N", "Open-loop mode: start N requests per second in total, whether or not earlier ones have finished");
+    struct arg_str* arrival = arg_str0(NULL, "arrival", "NAME", "Arrival process for --rate: uniform or poisson [uniform]");
+    struct arg_str* load_profile = arg_str0(NULL, "profile", "SPEC", "Vary concurrency in stages, e.g. 30:1-100,60:100,120:100-400/4 (SECONDS:LEVEL, SECONDS:FROM-TO or SECONDS:FROM-TO/STEPS), or @FILE for a YAML list of stages");
+    struct arg_str* rate_profile = arg_str0(NULL, "rate-profile", "SPEC", "Open-loop mode: vary the request rate in stages, as for --profile");
+    struct arg_lit* search = arg_lit0(NULL, "search", "Open-loop mode: find the highest rate meeting --slo-p99 and --max-failures, probing upwards from --rate [100]");
+    struct arg_int* slo_p99 = arg_int0(NULL, "slo-p99", "MS", "For --search, the highest acceptable p99 latency [--fail-after]");
+    struct arg_dbl* max_failures = arg_dbl0(NULL, "max-failures", "PCT", "For --search, the highest acceptable percentage of failures [1]");
+    struct arg_int* probe_seconds = arg_int0(NULL, "probe-seconds", "N", "For --search, the length of each probe, the first fifth of which isn't measured [10]");
+    struct arg_int* report_interval = arg_int0("i", "report-interval", "N", "Print throughput and latency to stderr every N seconds");
+    struct arg_lit* no_detailed = arg_lit0(NULL, "no-detailed-results", "Keep only summary statistics; don't write detailed-results.csv");
+    struct arg_file* output = arg_file0("o", "output", "FILE", "Where to write detailed results [detailed-results.csv, or .bin with --binary]");
+    struct arg_lit* binary = arg_lit0(NULL, "binary", "Write detailed results in wideload's binary format (see wideload-results)");
+    struct arg_file* compile_to = arg_file0(NULL, "compile", "FILE", "Compile URL_FILE into a request set at FILE, which later runs can load instantly, and exit");
+    struct arg_lit* stream = arg_lit0(NULL, "stream", "Read a line-oriented URL_FILE a chunk at a time during the test, instead of loading it all first");
+    struct arg_str* agent = arg_str0(NULL, "agent", "[ADDRESS:]PORT", "Run tests for coordinators: listen on PORT, on ADDRESS [127.0.0.1], and run whatever test each one sends");
+    struct arg_str* coordinator = arg_str0(NULL, "coordinator", "LIST", "Run the test on each agent in LIST (HOST:PORT,...), all starting at once, and merge their results");
     struct arg_file* url_filename = arg_file0(NULL, NULL, "URL_FILE", "File of URLs to load test");
     struct arg_end* end = arg_end(20);
 
     options opts;
+    cpu_set_t cpu_set;
+
+    opts.agent_address = NULL;
+    opts.agent_port = 0;
 
     void* argtable[] = {
         help,
@@ -34,8 +101,35 @@ options command_line_options(int argc, char* argv[])
         run_seconds,
         run_requests,
         randomize,
+        seed,
         fail_after,
         fail_status,
+        engine,
+        threads,
+        http2,
+        h2c,
+        streams,
+        close_on_timeout,
+        standby,
+        pipeline,
+        cpus,
+        reserve_cpus,
+        rate,
+        arrival,
+        load_profile,
+        rate_profile,
+        search,
+        slo_p99,
+        max_failures,
+        probe_seconds,
+        report_interval,
+        no_detailed,
+        output,
+        binary,
+        compile_to,
+        stream,
+        agent,
+        coordinator,
         url_filename,
         end
     };
@@ -65,6 +159,28 @@ options command_line_options(int argc, char* argv[])
 
 
     // validate results
+    if (load_profile->count > 0 && rate_profile->count > 0)
+        CLI_ERR("cannot specify both --profile and --rate-profile");
+    if ((load_profile->count > 0 || rate_profile->count > 0) && (run_seconds->count > 0 || run_requests->count > 0))
+        CLI_ERR("a profile sets the length of the run; don't also give -r/--run-requests or -s/--run-seconds");
+    if (load_profile->count > 0 && concurrency->count > 0)
+        CLI_ERR("--profile sets the concurrency; don't also give -c/--concurrency");
+    if (rate_profile->count > 0 && rate->count > 0)
+        CLI_ERR("--rate-profile sets the rate; don't also give --rate");
+
+    if (search->count > 0 && (run_seconds->count > 0 || run_requests->count > 0 || load_profile->count > 0 || rate_profile->count > 0))
+        CLI_ERR("--search decides the length and rate of the run; don't also give -r, -s, --profile or --rate-profile");
+    if (search->count > 0 && slo_p99->count == 0 && fail_after->count == 0)
+        CLI_ERR("--search needs a latency target, from --slo-p99 or -f/--fail-after");
+    if ((slo_p99->count > 0 || max_failures->count > 0 || probe_seconds->count > 0) && search->count == 0)
+        CLI_ERR("--slo-p99, --max-failures and --probe-seconds only apply to --search");
+    if (NOT_POSITIVE_INT(slo_p99))
+        CLI_ERR("--slo-p99 must be a positive number");
+    if (NOT_POSITIVE_INT(probe_seconds))
+        CLI_ERR("--probe-seconds must be a positive number");
+    if (max_failures->count > 0 && (max_failures->dval[0] < 0 || max_failures->dval[0] > 100))
+        CLI_ERR("--max-failures must be a percentage");
+
     if (run_seconds->count > 0 && run_requests->count > 0) {
         CLI_ERR("cannot specify boty -r/--run-requests and -s/--run-seconds");
     } else if (run_seconds->count == 0 && run_requests->count == 0) {
@@ -82,7 +198,55 @@ options command_line_options(int argc, char* argv[])
         CLI_ERR("-f/--fail-after must be a positive number");
     if (NOT_POSITIVE_INT(fail_status))
         CLI_ERR("-t/--fail-status must be a positive number");
-    if (url_filename->count != 1)
+    if (NOT_POSITIVE_INT(threads))
+        CLI_ERR("--threads must be a positive number");
+    if (http2->count > 0 && h2c->count > 0)
+        CLI_ERR("cannot specify both --http2 and --h2c");
+    if ((http2->count > 0 || h2c->count > 0) && (engine->count == 0 || strcmp(engine->sval[0], "multi") != 0))
+        CLI_ERR("--http2 and --h2c need -e/--engine multi");
+    if ((streams->count > 0 || close_on_timeout->count > 0) && http2->count == 0 && h2c->count == 0)
+        CLI_ERR("--streams and --close-on-timeout only apply to --http2 and --h2c");
+    if (NOT_POSITIVE_INT(streams))
+        CLI_ERR("--streams must be a positive number");
+    if (standby->count > 0 && engine->count > 0 && strcmp(engine->sval[0], "easy") != 0)
+        CLI_ERR("--standby only applies to the easy engine");
+    if (NOT_POSITIVE_INT(pipeline))
+        CLI_ERR("--pipeline must be a positive number");
+    if (pipeline->count > 0 && (engine->count == 0 || strcmp(engine->sval[0], "raw") != 0))
+        CLI_ERR("--pipeline needs -e/--engine raw");
+    if (engine->count > 0 && strcmp(engine->sval[0], "easy") != 0 && strcmp(engine->sval[0], "multi") != 0 && strcmp(engine->sval[0], "raw") != 0)
+        CLI_ERR("-e/--engine must be one of: easy, multi, raw");
+    if (stream->count > 0 && engine->count > 0 && strcmp(engine->sval[0], "raw") == 0)
+        CLI_ERR("--stream cannot be used with the raw engine, which serializes every request up front");
+    if (cpus->count > 0 && parse_cpu_list(cpus->sval[0], &cpu_set))
+        CLI_ERR("--cpus must be a list of CPUs, like 0-3,8,10-11");
+    if (reserve_cpus->count > 0 && parse_cpu_list(reserve_cpus->sval[0], &cpu_set))
+        CLI_ERR("--reserve-cpus must be a list of CPUs, like 0-3,8,10-11");
+    if (NOT_POSITIVE_INT(report_interval))
+        CLI_ERR("-i/--report-interval must be a positive number");
+    if (NOT_POSITIVE_INT(rate))
+        CLI_ERR("--rate must be a positive number");
+    if (arrival->count > 0 && strcmp(arrival->sval[0], "uniform") != 0 && strcmp(arrival->sval[0], "poisson") != 0)
+        CLI_ERR("--arrival must be one of: uniform, poisson");
+    if (arrival->count > 0 && rate->count == 0 && rate_profile->count == 0)
+        CLI_ERR("--arrival requires --rate or --rate-profile");
+    if (stream->count > 0 && randomize->count > 0)
+        CLI_ERR("--stream cannot be used with --randomize");
+    if (stream->count > 0 && binary->count > 0)
+        CLI_ERR("--stream cannot be used with --binary");
+    if (stream->count > 0 && compile_to->count > 0)
+        CLI_ERR("--stream cannot be used with --compile");
+    if (agent->count > 0 && argc > 3)
+        CLI_ERR("--agent takes its other options, and URL_FILE, from the coordinator");
+    if (agent->count > 0 && parse_agent_address(agent->sval[0], &opts))
+        CLI_ERR("--agent must be a port number, or an address and a port (like 10.0.0.5:7070 or [::]:7070)");
+    if (coordinator->count > 0 && (search->count > 0 || compile_to->count > 0))
+        CLI_ERR("--coordinator cannot be used with --search or --compile");
+    if (coordinator->count > 0 && stream->count > 0)
+        CLI_ERR("--coordinator cannot be used with --stream; agents only run compiled request sets");
+    if (coordinator->count > 0 && output->count > 0)
+        CLI_ERR("--coordinator cannot be used with -o/--output; agents don't write detailed results");
+    if (url_filename->count != 1 && agent->count == 0)
         CLI_ERR("URL_FILE is required");
 
     opts.concurrency = (concurrency->count == 0 ? 1 : concurrency->ival[0]);
@@ -90,8 +254,68 @@ options command_line_options(int argc, char* argv[])
     opts.run_requests = (run_requests->count == 0 ? 0 : run_requests->ival[0]);
     opts.fail_after = (fail_after->count == 0 ? 0 : fail_after->ival[0]);
     opts.fail_status = (fail_status->count == 0 ? 400 : fail_status->ival[0]);
-    opts.url_filename = url_filename->filename[0];
+    opts.url_filename = (url_filename->count > 0 ? url_filename->filename[0] : NULL);
     opts.randomize = (randomize->count > 0 ? 1 : 0);
+    opts.seeded = (seed->count > 0 ? 1 : 0);
+    opts.seed = (seed->count > 0 ? (unsigned long)seed->ival[0] : ((unsigned long)time(NULL) ^ ((unsigned long)getpid() << 16)) & 0x7fffffff);
+    opts.detailed = (no_detailed->count > 0 ? 0 : 1);
+    opts.binary = (binary->count > 0 ? 1 : 0);
+    opts.compile_to = (compile_to->count > 0 ? compile_to->filename[0] : NULL);
+    opts.stream = (stream->count > 0 ? 1 : 0);
+    if (output->count > 0)
+        opts.output = output->filename[0];
+    else
+        opts.output = (opts.binary ? "detailed-results.bin" : "detailed-results.csv");
+    opts.engine = (engine->count == 0 ? ENGINE_EASY :
+                   strcmp(engine->sval[0], "multi") == 0 ? ENGINE_MULTI :
+                   strcmp(engine->sval[0], "raw") == 0 ? ENGINE_RAW : ENGINE_EASY);
+    opts.threads = (threads->count == 0 ? sysconf(_SC_NPROCESSORS_ONLN) : threads->ival[0]);
+    opts.http = (h2c->count > 0 ? HTTP_2_PRIOR_KNOWLEDGE : http2->count > 0 ? HTTP_2 : HTTP_1_1);
+    opts.streams = (streams->count > 0 ? streams->ival[0] : 100);
+    opts.close_on_timeout = (close_on_timeout->count > 0 ? 1 : 0);
+    opts.standby = (standby->count > 0 ? 1 : 0);
+    opts.pipeline = (pipeline->count > 0 ? pipeline->ival[0] : 1);
+    opts.cpus = (cpus->count > 0 ? cpus->sval[0] : NULL);
+    opts.reserve_cpus = (reserve_cpus->count > 0 ? reserve_cpus->sval[0] : NULL);
+    opts.report_interval = (report_interval->count == 0 ? 0 : report_interval->ival[0]);
+    opts.rate = (rate->count == 0 ? 0 : rate->ival[0]);
+    opts.poisson = (arrival->count > 0 && strcmp(arrival->sval[0], "poisson") == 0 ? 1 : 0);
+
+    // a profile decides how long the run is, and how much
+    // concurrency (or what rate) it needs at most
+    opts.profile = NULL;
+    opts.rate_profile = (rate_profile->count > 0 ? 1 : 0);
+    if (load_profile->count > 0 || rate_profile->count > 0) {
+        opts.profile = malloc(sizeof(profile));
+        if (opts.profile == NULL || profile_parse(opts.profile, opts.rate_profile ? rate_profile->sval[0] : load_profile->sval[0]) != 0)
+            exit(11);
+        opts.run_seconds = (opts.profile->length + 999999999) / 1000000000;
+        opts.run_requests = 0;
+        if (opts.rate_profile)
+            opts.rate = (unsigned long)ceil(profile_max(opts.profile));
+        else
+            opts.concurrency = (unsigned long)ceil(profile_max(opts.profile));
+    }
+
+    // a search runs until it's found the answer, so the workers
+    // are given time for the most probes it can make
+    opts.search = (search->count > 0 ? 1 : 0);
+    opts.slo_p99 = (slo_p99->count > 0 ? slo_p99->ival[0] : opts.fail_after);
+    opts.max_failures = (max_failures->count > 0 ? max_failures->dval[0] : 1.0);
+    opts.probe_seconds = (probe_seconds->count > 0 ? probe_seconds->ival[0] : 10);
+    if (opts.search) {
+        if (opts.rate == 0)
+            opts.rate = 100;
+        opts.run_seconds = SEARCH_MAX_PROBES * opts.probe_seconds + 60;
+        opts.run_requests = 0;
+    }
+
+    opts.coordinator = (coordinator->count > 0 ? coordinator->sval[0] : NULL);
+
+    if (opts.threads < 1)
+        opts.threads = 1;
+    if (opts.threads > opts.concurrency)
+        opts.threads = opts.concurrency;
 
     arg_freetable(argtable, sizeof(argtable) / sizeof(argtable[0]));
 
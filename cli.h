@@ -3,6 +3,20 @@
 
 #include <stdio.h>
 
+#include "profile.h"
+
+typedef enum {
+    ENGINE_EASY,
+    ENGINE_MULTI,
+    ENGINE_RAW
+} engine_type;
+
+typedef enum {
+    HTTP_1_1,
+    HTTP_2,                 /* h2 by ALPN, or h2c by upgrade */
+    HTTP_2_PRIOR_KNOWLEDGE  /* h2c from the start */
+} http_version;
+
 typedef struct {
     /* required arguments */
     const char*    url_filename;
@@ -14,6 +28,42 @@ typedef struct {
     unsigned long  fail_after;
     unsigned long  fail_status;
     unsigned char  randomize;
+    unsigned long  seed;
+    unsigned char  seeded;
+    unsigned char  detailed;
+    unsigned char  binary;
+    const char*    output;
+    const char*    compile_to;
+    unsigned char  stream;
+    engine_type    engine;
+    unsigned long  threads;
+    http_version   http;
+    unsigned long  streams;           /* most in flight per connection */
+    unsigned char  close_on_timeout;  /* drop the connection, not just the stream */
+    unsigned char  standby;           /* reconnect ahead of the next request */
+    unsigned long  pipeline;          /* most requests in flight per connection */
+    const char*    cpus;
+    const char*    reserve_cpus;
+    unsigned long  report_interval;
+    unsigned long  rate;
+    unsigned char  poisson;
+
+    /* if set, the run follows this profile of concurrency, or (if
+       rate_profile) of requests per second */
+    profile*       profile;
+    unsigned char  rate_profile;
+
+    /* --search: find the highest rate meeting these */
+    unsigned char  search;
+    unsigned long  slo_p99;       /* millis */
+    double         max_failures;  /* percent */
+    unsigned long  probe_seconds;
+
+    /* --agent: serve coordinators on this address and port;
+       --coordinator: run the test on these agents (HOST:PORT,...) */
+    const char*    agent_address;
+    unsigned long  agent_port;
+    const char*    coordinator;
 } options;
 
 /**
@@ -0,0 +1,354 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+
+#include "coordinator.h"
+#include "urlfile.h"
+#include "reqset.h"
+#include "mix.h"
+#include "loader.h"
+#include "reporter.h"
+#include "wire.h"
+
+/* how far ahead the start is set, for it to reach every agent */
+#define START_MARGIN 1000000000UL
+
+/* how long after each second the agents' totals are waited for */
+#define REPORT_GRACE 250000000UL
+
+/**
+ * Return how many arguments from argv[i] on the agents don't get:
+ * the URL_FILE, which they're sent separately, --coordinator, and
+ * --seed, which each agent is given its own of.
+ */
+static int not_forwarded(char* argv[], int i, const options* opts)
+{
+    if (argv[i] == opts->url_filename)
+        return 1;
+    if (strcmp(argv[i], "--coordinator") == 0 || strcmp(argv[i], "--seed") == 0)
+        return 2;
+    if (strncmp(argv[i], "--coordinator=", 14) == 0 || strncmp(argv[i], "--seed=", 7) == 0)
+        return 1;
+    return 0;
+}
+
+/**
+ * Return a malloc'd agent command line: the arguments, each
+ * followed by a NUL.
+ */
+static char* forward_args(int argc, char* argv[], const options* opts, unsigned long seed, unsigned long* length)
+{
+    char seed_arg[32];
+    char* body;
+    int i, skip;
+
+    snprintf(seed_arg, sizeof(seed_arg), "--seed=%lu", seed);
+
+    *length = strlen(seed_arg) + 1;
+    for (i=1; i<argc; i+=(skip ? skip : 1))
+        if ((skip = not_forwarded(argv, i, opts)) == 0)
+            *length += strlen(argv[i]) + 1;
+    if ((body = malloc(*length)) == NULL)
+        return NULL;
+
+    *length = 0;
+    for (i=1; i<argc; i+=(skip ? skip : 1)) {
+        if ((skip = not_forwarded(argv, i, opts)) == 0) {
+            strcpy(body + *length, argv[i]);
+            *length += strlen(argv[i]) + 1;
+        }
+    }
+    strcpy(body + *length, seed_arg);
+    *length += strlen(seed_arg) + 1;
+
+    return body;
+}
+
+/**
+ * Read a whole file into a malloc'd buffer. Return NULL on error.
+ */
+static void* read_file(const char* filename, unsigned long* length)
+{
+    FILE* in;
+    void* body = NULL;
+    long size;
+
+    if ((in = fopen(filename, "rb")) == NULL) {
+        perror(filename);
+        return NULL;
+    }
+    if (fseek(in, 0, SEEK_END) == 0 && (size = ftell(in)) >= 0 && fseek(in, 0, SEEK_SET) == 0) {
+        if ((body = malloc(size + 1)) != NULL && fread(body, 1, size, in) != size) {
+            free(body);
+            body = NULL;
+        }
+        *length = size;
+    }
+    fclose(in);
+
+    if (body == NULL)
+        fprintf(stderr, "Could not read %s\n", filename);
+    return body;
+}
+
+/**
+ * Return the request set to send every agent, in a malloc'd buffer.
+ * Return NULL on error.
+ */
+static void* request_set(coordinator* co, const options* opts, unsigned long* length)
+{
+    char compiled[] = "/tmp/wideload-set-XXXXXX";
+    requests reqs;
+    void* body;
+    int fd;
+
+    // the set is sent compiled, with the payload and CSV files it
+    // names, which the agents won't have
+    reqs = load_requests(opts->url_filename);
+    co->weighted = mix_weighted(reqs);
+    if ((fd = mkstemp(compiled)) < 0) {
+        perror("Could not compile the request set");
+        free_requests(reqs);
+        return NULL;
+    }
+    close(fd);
+    body = (reqset_write(compiled, reqs) == 0 ? read_file(compiled, length) : NULL);
+    unlink(compiled);
+    free_requests(reqs);
+
+    return body;
+}
+
+/**
+ * Connect to every agent, and send each the test.
+ * Return 1 on error or 0 on success.
+ */
+static int send_run(coordinator* co, const options* opts, int argc, char* argv[])
+{
+    void* set;
+    char* args;
+    unsigned long i, set_length, args_length;
+    int failed = 0;
+
+    if ((set = request_set(co, opts, &set_length)) == NULL)
+        return 1;
+
+    for (i=0; i<co->count && !failed; i++) {
+        agent_link* link = &co->agents[i];
+
+        if ((link->fd = wire_connect(link->address)) < 0) {
+            failed = 1;
+            continue;
+        }
+
+        // agents given the same seed would make the same random
+        // choices, so each gets its own, far from the others'
+        args = forward_args(argc, argv, opts, (opts->seed + i * 1000003) & 0x7fffffff, &args_length);
+        if (args == NULL ||
+                wire_send(link->fd, MSG_ARGS, args, args_length) != 0 ||
+                wire_send(link->fd, MSG_FILE, set, set_length) != 0) {
+            fprintf(stderr, "Could not send the test to agent %s\n", link->address);
+            failed = 1;
+        }
+        free(args);
+    }
+
+    free(set);
+    return failed;
+}
+
+/**
+ * Wait for every agent to load the test, then tell them all when
+ * to start: the same moment, shortly after. Return the start (on
+ * this host's monotonic clock), or 0 on error.
+ */
+static unsigned long start_run(coordinator* co)
+{
+    unsigned long i, start, length;
+    unsigned int type;
+    void* body;
+
+    for (i=0; i<co->count; i++) {
+        if (wire_recv(co->agents[i].fd, &type, &body, &length) != 0 || type != MSG_READY) {
+            fprintf(stderr, "Agent %s could not run the test; see its output\n", co->agents[i].address);
+            return 0;
+        }
+        free(body);
+    }
+
+    // the start is sent in wall clock time, which the agents'
+    // monotonic clocks have no relation to
+    start = nanos() + START_MARGIN;
+    for (i=0; i<co->count; i++) {
+        unsigned long wall = start + wall_offset;
+        if (wire_send(co->agents[i].fd, MSG_START, &wall, sizeof(wall)) != 0) {
+            fprintf(stderr, "Could not start agent %s\n", co->agents[i].address);
+            return 0;
+        }
+    }
+
+    printf("Starting %lu agents\n\n", co->count);
+    fflush(stdout);
+    return start;
+}
+
+/**
+ * Stop waiting for an agent, counting whatever it last sent.
+ */
+static void finish(agent_link* link, unsigned char lost)
+{
+    if (lost)
+        fprintf(stderr, "Lost agent %s; counting its results so far\n", link->address);
+    link->finished = 1;
+    link->lost = lost;
+    close(link->fd);
+}
+
+/**
+ * Send the test described by `opts` (whose own command line is
+ * `argv`) and the request set to each agent named by
+ * opts->coordinator, start them all at the same moment, and wait
+ * for them to finish, printing merged running totals each
+ * report interval. Fill in `summary` with the merged totals.
+ * Return 1 on error or 0 on success.
+ */
+int coordinator_run(coordinator* co, const options* opts, int argc, char* argv[], stats* summary)
+{
+    char* address;
+    char* saveptr;
+    unsigned long i, start, interval, next_report, remaining;
+    unsigned int type;
+    void* body;
+    unsigned long length;
+    stats snapshots[2];
+    histogram window;
+    int cur = 0;
+    char stop_sent = 0;
+
+    memset(co, 0, sizeof(coordinator));
+    if ((co->addresses = strdup(opts->coordinator)) == NULL)
+        return 1;
+    for (i=0, address=co->addresses; *address; address++)
+        i += (*address == ',');
+    if ((co->agents = calloc(i + 1, sizeof(agent_link))) == NULL)
+        return 1;
+    for (address=strtok_r(co->addresses, ",", &saveptr); address!=NULL; address=strtok_r(NULL, ",", &saveptr)) {
+        co->agents[co->count].address = address;
+        co->agents[co->count].fd = -1;
+        if (stats_init(&co->agents[co->count].latest)) {
+            fprintf(stderr, "Could not allocate statistics\n");
+            return 1;
+        }
+        co->count++;
+    }
+    if (co->count == 0) {
+        fprintf(stderr, "--coordinator needs at least one agent\n");
+        return 1;
+    }
+
+    if (send_run(co, opts, argc, argv) != 0 || (start = start_run(co)) == 0)
+        return 1;
+
+    if (stats_init(&snapshots[0]) || stats_init(&snapshots[1]) || hist_init(&window, LATENCY_HIGHEST, LATENCY_SIGFIGS)) {
+        fprintf(stderr, "Could not allocate statistics\n");
+        return 1;
+    }
+
+    struct pollfd pfds[co->count];
+    interval = opts->report_interval * 1000000000UL;
+    next_report = start + interval + REPORT_GRACE;
+    remaining = co->count;
+    while (remaining > 0) {
+        // pass an interrupt on, and wait for the agents' results
+        if (__atomic_load_n(&stopping, __ATOMIC_RELAXED) && !stop_sent) {
+            for (i=0; i<co->count; i++)
+                if (!co->agents[i].finished)
+                    wire_send(co->agents[i].fd, MSG_STOP, NULL, 0);
+            stop_sent = 1;
+        }
+
+        for (i=0; i<co->count; i++) {
+            pfds[i].fd = (co->agents[i].finished ? -1 : co->agents[i].fd);
+            pfds[i].events = POLLIN;
+            pfds[i].revents = 0;
+        }
+        if (poll(pfds, co->count, 50) > 0) {
+            for (i=0; i<co->count; i++) {
+                agent_link* link = &co->agents[i];
+                if (pfds[i].revents == 0)
+                    continue;
+
+                if (wire_recv(link->fd, &type, &body, &length) != 0) {
+                    finish(link, 1);
+                    remaining--;
+                    continue;
+                }
+                if ((type == MSG_STATS || type == MSG_FINAL) && wire_decode_stats(&link->latest, body, length) != 0) {
+                    fprintf(stderr, "Agent %s sent malformed results\n", link->address);
+                    finish(link, 1);
+                    remaining--;
+                } else if (type == MSG_FINAL) {
+                    finish(link, 0);
+                    remaining--;
+                }
+                free(body);
+            }
+        }
+
+        // the agents send their totals on the second from the
+        // start, so each agent's latest merged, less the previous
+        // merge, is what they all did during the interval
+        if (interval && nanos() >= next_report) {
+            cur = !cur;
+            stats_clear(&snapshots[cur]);
+            for (i=0; i<co->count; i++)
+                stats_merge(&snapshots[cur], &co->agents[i].latest);
+            reporter_print(&snapshots[cur], &snapshots[!cur], &window, interval, next_report - REPORT_GRACE - start, opts->rate != 0);
+            next_report += interval;
+        }
+    }
+
+    stats_clear(summary);
+    for (i=0; i<co->count; i++)
+        stats_merge(summary, &co->agents[i].latest);
+
+    stats_free(&snapshots[0]);
+    stats_free(&snapshots[1]);
+    hist_free(&window);
+    return 0;
+}
+
+/**
+ * Print a line per agent.
+ */
+void coordinator_print(const coordinator* co, const options* opts)
+{
+    unsigned long i;
+
+    printf("Agent                            requests  failures      p50      p99      max (ms)\n");
+    for (i=0; i<co->count; i++) {
+        const agent_link* link = &co->agents[i];
+        // open-loop latency counts from each request's intended start
+        const histogram* h = (opts->rate ? &link->latest.corrected : &link->latest.latency);
+
+        printf(" %-30s %10lu %9lu %8.3f %8.3f %8.3f%s\n",
+               link->address, link->latest.requests, link->latest.failures,
+               hist_percentile(h, 50) / 1000.0,
+               hist_percentile(h, 99) / 1000.0,
+               h->max / 1000.0,
+               (link->lost ? "  (lost)" : ""));
+    }
+    printf("\n");
+}
+
+void coordinator_free(coordinator* co)
+{
+    unsigned long i;
+
+    for (i=0; i<co->count; i++)
+        stats_free(&co->agents[i].latest);
+    free(co->agents);
+    free(co->addresses);
+}
@@ -0,0 +1,46 @@
+#ifndef WIDELOAD_COORDINATOR_H
+#define WIDELOAD_COORDINATOR_H
+
+#include "cli.h"
+#include "stats.h"
+
+/**
+ * A connection to one agent, and the latest running totals it
+ * has sent.
+ */
+typedef struct {
+    const char*    address;
+    int            fd;
+    stats          latest;
+    unsigned char  finished;
+    unsigned char  lost;
+} agent_link;
+
+/**
+ * A test run on several agents at once.
+ */
+typedef struct {
+    agent_link*    agents;
+    unsigned long  count;
+    char*          addresses;  /* the list the agents' addresses point into */
+    unsigned char  weighted;   /* whether the request set has a weighted mix */
+} coordinator;
+
+/**
+ * Send the test described by `opts` (whose own command line is
+ * `argv`) and the request set to each agent named by
+ * opts->coordinator, start them all at the same moment, and wait
+ * for them to finish, printing merged running totals each
+ * report interval. Fill in `summary` with the merged totals.
+ * Return 1 on error or 0 on success.
+ */
+int coordinator_run(coordinator* co, const options* opts, int argc, char* argv[], stats* summary);
+
+/**
+ * Print a line per agent.
+ */
+void coordinator_print(const coordinator* co, const options* opts);
+
+void coordinator_free(coordinator* co);
+
+#endif
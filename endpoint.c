@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "endpoint.h"
+#include "stats.h"
+#include "hash.h"
+
+/* the widest an endpoint's label is printed */
+#define LABEL_WIDTH 40
+
+/* slots in the table endpoints are found by, at most half full */
+#define ENDPOINTS_TABLE 256
+
+/**
+ * Return 1 if the two requests belong to the same endpoint.
+ */
+static int same_endpoint(const request* a, const request* b)
+{
+    if (a->name != NULL || b->name != NULL)
+        return (a->name != NULL && b->name != NULL && strcmp(a->name, b->name) == 0);
+    return (a->method == b->method && strcmp(a->url, b->url) == 0);
+}
+
+/**
+ * Return the hash of what same_endpoint() compares.
+ */
+static uint64_t endpoint_hash(const request* req)
+{
+    if (req->name != NULL)
+        return hash_string(HASH_START, req->name);
+    return hash_string(hash_bytes(HASH_START, req->method == HTTP_POST ? "P" : "G", 1), req->url);
+}
+
+/**
+ * Group the requests into endpoints, setting each one's `endpoint`.
+ * Leaves eps->count 0 if there are more than ENDPOINTS_MAX.
+ */
+void endpoints_group(endpoints* eps, requests reqs)
+{
+    const request* first[ENDPOINTS_MAX];
+    unsigned long table[ENDPOINTS_TABLE];  /* 1 + endpoint, or 0 if free */
+    unsigned long i, k, slot;
+
+    memset(eps, 0, sizeof(endpoints));
+    memset(table, 0, sizeof(table));
+    for (i=0; i<reqs.count; i++) {
+        request* req = &reqs.reqs[i];
+
+        eps->named |= (req->name != NULL);
+        eps->shown |= (req->timeout != 0 || req->expect[0] != 0);
+        // a URLs file can have millions of entries, so find each one's
+        // endpoint by hash rather than comparing it with every one
+        slot = endpoint_hash(req) & (ENDPOINTS_TABLE - 1);
+        while (table[slot] != 0 && !same_endpoint(first[table[slot] - 1], req))
+            slot = (slot + 1) & (ENDPOINTS_TABLE - 1);
+        k = (table[slot] != 0 ? table[slot] - 1 : eps->count);
+        if (k == eps->count) {
+            if (eps->count == ENDPOINTS_MAX) {
+                eps->overflow = 1;
+                eps->count = 0;
+                eps->shown = 0;
+                for (; i<reqs.count; i++)
+                    eps->named |= (reqs.reqs[i].name != NULL);
+                return;
+            }
+            first[eps->count++] = req;
+            table[slot] = eps->count;
+        }
+        req->endpoint = k;
+    }
+    eps->shown |= (eps->count > 1);
+
+    if (!(eps->labels = calloc(eps->count, sizeof(char*)))) {
+        fprintf(stderr, "Could not allocate statistics\n");
+        exit(2);
+    }
+    for (k=0; k<eps->count; k++) {
+        if (first[k]->name != NULL)
+            eps->labels[k] = strdup(first[k]->name);
+        else if (asprintf(&eps->labels[k], "%s %s", first[k]->method == HTTP_POST ? "POST" : "GET", first[k]->url) < 0)
+            eps->labels[k] = NULL;
+        if (eps->labels[k] == NULL) {
+            fprintf(stderr, "Could not allocate statistics\n");
+            exit(2);
+        }
+    }
+}
+
+void endpoints_free(endpoints* eps)
+{
+    unsigned long k;
+
+    for (k=0; k<eps->count; k++)
+        free(eps->labels[k]);
+    free(eps->labels);
+}
+
+/**
+ * Allocate empty totals for `count` endpoints, or return NULL on error.
+ */
+endpoint_stats* endpoint_stats_new(unsigned long count)
+{
+    endpoint_stats* es;
+    unsigned long k;
+
+    if (!(es = calloc(count, sizeof(endpoint_stats))))
+        return NULL;
+    for (k=0; k<count; k++) {
+        if (hist_init(&es[k].latency, LATENCY_HIGHEST, ENDPOINT_SIGFIGS)) {
+            endpoint_stats_free(es, k);
+            return NULL;
+        }
+    }
+    return es;
+}
+
+void endpoint_stats_free(endpoint_stats* es, unsigned long count)
+{
+    unsigned long k;
+
+    if (es == NULL)
+        return;
+    for (k=0; k<count; k++)
+        hist_free(&es[k].latency);
+    free(es);
+}
+
+/**
+ * Count a completed result against its request's endpoint.
+ */
+void endpoint_record(endpoint_stats* es, const result* rslt, const options* opts)
+{
+    endpoint_stats* e = &es[rslt->req->endpoint];
+    int status = rslt->status;
+
+    // only the summary reads these, once the worker has finished
+    e->requests++;
+    if (status == 598)
+        e->timeouts++;
+    else
+        e->classes[(status >= 100 && status < 598 ? status / 100 : 0)]++;
+    // open-loop latency counts from when the request was due, as in
+    // the summary above the table
+    if (result_failed(rslt, opts))
+        e->failures++;
+    else
+        hist_record(&e->latency, (rslt->time_end - rslt->time_start + (opts->rate ? result_lateness(rslt) : 0)) / 1000);
+}
+
+/**
+ * Print a line per endpoint, from the workers' merged totals.
+ */
+void endpoints_print(const endpoints* eps, const threadstate* states, unsigned long nthreads, const options* opts)
+{
+    endpoint_stats total;
+    unsigned long i, k, c, began = 0, ended = 0;
+    int width = 9, length;
+    double secs;
+
+    if (eps->count == 0) {
+        if (eps->overflow && eps->named)
+            printf("No breakdown by endpoint: more than %d of them\n\n", ENDPOINTS_MAX);
+        return;
+    }
+    if (!eps->shown)
+        return;
+
+    for (i=0; i<nthreads; i++) {
+        if (began == 0 || states[i].time_begun < began)
+            began = states[i].time_begun;
+        if (states[i].time_ended > ended)
+            ended = states[i].time_ended;
+    }
+    secs = (ended > began ? (ended - began) / 1000000000.0 : 0);
+    for (k=0; k<eps->count; k++) {
+        length = strlen(eps->labels[k]);
+        if (length > width)
+            width = (length < LABEL_WIDTH ? length : LABEL_WIDTH);
+    }
+
+    if (hist_init(&total.latency, LATENCY_HIGHEST, ENDPOINT_SIGFIGS)) {
+        fprintf(stderr, "Could not allocate statistics\n");
+        exit(2);
+    }
+    printf("%-*s   requests      req/s      p50      p99      max (ms%s failures    met %%  timeouts     2xx     3xx     4xx     5xx   other\n",
+           width + 1, "Endpoints", opts->rate ? "*)" : ") ");
+    for (k=0; k<eps->count; k++) {
+        memset(total.classes, 0, sizeof(total.classes));
+        total.requests = total.failures = total.timeouts = 0;
+        hist_clear(&total.latency);
+        for (i=0; i<nthreads; i++) {
+            const endpoint_stats* e = &states[i].endpoints[k];
+            total.requests += e->requests;
+            total.failures += e->failures;
+            total.timeouts += e->timeouts;
+            for (c=0; c<6; c++)
+                total.classes[c] += e->classes[c];
+            hist_merge(&total.latency, &e->latency);
+        }
+
+        length = strlen(eps->labels[k]);
+        if (length > width)
+            printf(" %.*s...", width - 3, eps->labels[k]);
+        else
+            printf(" %-*s", width, eps->labels[k]);
+        printf(" %10lu %10.1f", total.requests, secs > 0 ? total.requests / secs : 0);
+        if (total.latency.total > 0)
+            printf(" %8.3f %8.3f %8.3f",
+                   hist_percentile(&total.latency, 50) / 1000.0,
+                   hist_percentile(&total.latency, 99) / 1000.0,
+                   total.latency.max / 1000.0);
+        else
+            printf(" %8s %8s %8s", "-", "-", "-");
+        printf(" %14lu %8.2f %9lu %7lu %7lu %7lu %7lu %7lu\n",
+               total.failures,
+               total.requests > 0 ? 100.0 * (total.requests - total.failures) / total.requests : 0,
+               total.timeouts,
+               total.classes[2], total.classes[3], total.classes[4], total.classes[5],
+               total.classes[0] + total.classes[1]);
+    }
+    if (opts->rate)
+        printf(" * from each request's intended start\n");
+    printf("\n");
+    hist_free(&total.latency);
+}
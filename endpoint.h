@@ -0,0 +1,70 @@
+#ifndef WIDELOAD_ENDPOINT_H
+#define WIDELOAD_ENDPOINT_H
+
+#include "loader.h"
+#include "histogram.h"
+
+/*
+ * The summary breaks its results down by endpoint: each group of
+ * entries sharing a `name`, or, for entries without one, each
+ * distinct method and URL. Workers count their results straight
+ * into their own endpoint_stats, as they do their stats, and the
+ * summary merges them.
+ */
+
+/* the most endpoints broken down; a URLs file with more should
+   group them with `name` */
+#define ENDPOINTS_MAX 100
+
+/* endpoint latencies only need the precision of the table */
+#define ENDPOINT_SIGFIGS 2
+
+typedef struct {
+    unsigned long count;
+    char**        labels;   /* the name, or the method and URL */
+    char          named;    /* some entry has a name */
+    char          overflow; /* there were more than ENDPOINTS_MAX */
+    char          shown;    /* the summary breaks results down: there
+                               are several endpoints, or some entry has
+                               its own timeout or expected statuses */
+} endpoints;
+
+/**
+ * Running totals for one endpoint in one worker thread.
+ */
+typedef struct _endpoint_stats {
+    unsigned long requests;
+    unsigned long failures;
+    unsigned long timeouts;
+    unsigned long classes[6];  /* by status / 100, with any other status
+                                  but a timeout in 0 */
+    histogram     latency;     /* successful requests, in micros, from
+                                  the intended start if open-loop */
+} endpoint_stats;
+
+/**
+ * Group the requests into endpoints, setting each one's `endpoint`.
+ * Leaves eps->count 0 if there are more than ENDPOINTS_MAX.
+ */
+void endpoints_group(endpoints* eps, requests reqs);
+
+void endpoints_free(endpoints* eps);
+
+/**
+ * Allocate empty totals for `count` endpoints, or return NULL on error.
+ */
+endpoint_stats* endpoint_stats_new(unsigned long count);
+
+void endpoint_stats_free(endpoint_stats* es, unsigned long count);
+
+/**
+ * Count a completed result against its request's endpoint.
+ */
+void endpoint_record(endpoint_stats* es, const result* rslt, const options* opts);
+
+/**
+ * Print a line per endpoint, from the workers' merged totals.
+ */
+void endpoints_print(const endpoints* eps, const threadstate* states, unsigned long nthreads, const options* opts);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef WIDELOAD_HASH_H
+#define WIDELOAD_HASH_H
+
+#include <stdint.h>
+
+/*
+ * FNV-1a, for the open-addressed tables that look up URLs and other
+ * strings once per request or record, in place of comparing against
+ * each candidate in turn. Hashes chain, so that a key of several
+ * strings can be hashed one after another from HASH_START.
+ */
+
+#define HASH_START 0xcbf29ce484222325ULL
+
+/**
+ * Continue hash `h` with `length` bytes of s.
+ */
+static inline uint64_t hash_bytes(uint64_t h, const char* s, unsigned long length)
+{
+    unsigned long i;
+
+    for (i=0; i<length; i++)
+        h = (h ^ (unsigned char)s[i]) * 0x100000001b3ULL;
+    return h;
+}
+
+/**
+ * Continue hash `h` with the NUL-terminated string s.
+ */
+static inline uint64_t hash_string(uint64_t h, const char* s)
+{
+    for (; *s!='\0'; s++)
+        h = (h ^ (unsigned char)*s) * 0x100000001b3ULL;
+    return h;
+}
+
+/**
+ * Return a table size (a power of two) that keeps `count` keys at
+ * most half full, so that probes stay short.
+ */
+static inline unsigned long hash_table_size(unsigned long count)
+{
+    unsigned long size = 16;
+
+    while (size < count * 2)
+        size *= 2;
+    return size;
+}
+
+#endif
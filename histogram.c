@@ -0,0 +1,242 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "histogram.h"
+
+/*
+ * Counts are laid out as in HdrHistogram: bucket 0 covers values
+ * 0..sub_bucket_count-1 one by one, and each later bucket covers
+ * twice the range of the one before at half the resolution, so
+ * only its upper half of sub-buckets is stored.
+ */
+
+static inline int bucket_index(const histogram* h, unsigned long value)
+{
+    int pow2ceiling = 64 - __builtin_clzl(value | h->sub_bucket_mask);
+    return pow2ceiling - (h->sub_bucket_half_magnitude + 1);
+}
+
+static inline int counts_index(const histogram* h, unsigned long value)
+{
+    int bucket = bucket_index(h, value);
+    unsigned long sub_bucket = value >> bucket;
+    return ((bucket + 1) << h->sub_bucket_half_magnitude) + (sub_bucket - (h->sub_bucket_count / 2));
+}
+
+/**
+ * Return the lowest value in counts[index], and set *size to the
+ * number of distinct values which share that count.
+ */
+static inline unsigned long index_value(const histogram* h, int index, unsigned long* size)
+{
+    int bucket = (index >> h->sub_bucket_half_magnitude) - 1;
+    unsigned long sub_bucket = (index & ((h->sub_bucket_count / 2) - 1)) + (h->sub_bucket_count / 2);
+
+    if (bucket < 0) {
+        sub_bucket -= h->sub_bucket_count / 2;
+        bucket = 0;
+    }
+
+    *size = 1UL << bucket;
+    return sub_bucket << bucket;
+}
+
+/**
+ * Set up a histogram tracking 1..highest with `sigfigs` (1-5)
+ * significant digits. Return 1 on error or 0 on success.
+ */
+int hist_init(histogram* h, unsigned long highest, int sigfigs)
+{
+    unsigned long largest_single_unit = 2 * (unsigned long)pow(10, sigfigs);
+    unsigned long smallest_untrackable;
+    int magnitude = (int)ceil(log2((double)largest_single_unit));
+    int buckets = 1;
+
+    if (sigfigs < 1 || sigfigs > 5 || highest < 2)
+        return 1;
+
+    h->highest = highest;
+    h->sub_bucket_half_magnitude = magnitude - 1;
+    h->sub_bucket_count = 1UL << magnitude;
+    h->sub_bucket_mask = h->sub_bucket_count - 1;
+
+    smallest_untrackable = h->sub_bucket_count;
+    while (smallest_untrackable <= highest) {
+        smallest_untrackable <<= 1;
+        buckets++;
+    }
+    h->counts_len = (buckets + 1) * (h->sub_bucket_count / 2);
+
+    h->counts = calloc(h->counts_len, sizeof(unsigned long));
+    h->total = 0;
+    h->min = 0;
+    h->max = 0;
+
+    return h->counts == NULL;
+}
+
+void hist_free(histogram* h)
+{
+    free(h->counts);
+    h->counts = NULL;
+}
+
+/**
+ * Record one value; larger values than `highest` are clamped.
+ * Only the owning thread may call this.
+ */
+void hist_record(histogram* h, unsigned long value)
+{
+    int index;
+
+    if (value > h->highest)
+        value = h->highest;
+    index = counts_index(h, value);
+
+    // a single writer needs no read-modify-write atomics, only
+    // stores that concurrent readers can't see torn
+    __atomic_store_n(&h->counts[index], h->counts[index] + 1, __ATOMIC_RELAXED);
+    if (h->total == 0 || value < h->min)
+        __atomic_store_n(&h->min, value, __ATOMIC_RELAXED);
+    if (value > h->max)
+        __atomic_store_n(&h->max, value, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->total, h->total + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Add all of `from`'s values into `into`; both must have been
+ * set up with the same range and precision.
+ */
+void hist_merge(histogram* into, const histogram* from)
+{
+    int i;
+    unsigned long total = __atomic_load_n(&from->total, __ATOMIC_ACQUIRE);
+    unsigned long min = __atomic_load_n(&from->min, __ATOMIC_RELAXED);
+    unsigned long max = __atomic_load_n(&from->max, __ATOMIC_RELAXED);
+
+    if (total == 0)
+        return;
+
+    for (i=0; i<into->counts_len; i++)
+        into->counts[i] += __atomic_load_n(&from->counts[i], __ATOMIC_RELAXED);
+
+    if (into->total == 0 || min < into->min)
+        into->min = min;
+    if (max > into->max)
+        into->max = max;
+    into->total += total;
+}
+
+/**
+ * Forget all recorded values.
+ */
+void hist_clear(histogram* h)
+{
+    memset(h->counts, 0, h->counts_len * sizeof(unsigned long));
+    h->total = 0;
+    h->min = 0;
+    h->max = 0;
+}
+
+/**
+ * Set `out` to the values recorded in `cur` but not `prev`, where
+ * `prev` is an earlier copy of the same histogram.
+ */
+void hist_diff(histogram* out, const histogram* cur, const histogram* prev)
+{
+    unsigned long size, value;
+    int i, lowest = -1, highest = -1;
+
+    out->total = 0;
+    for (i=0; i<out->counts_len; i++) {
+        out->counts[i] = cur->counts[i] - prev->counts[i];
+        out->total += out->counts[i];
+        if (out->counts[i] != 0) {
+            if (lowest < 0)
+                lowest = i;
+            highest = i;
+        }
+    }
+
+    // the exact extremes of the difference aren't known, so use
+    // the edges of the occupied ranges, within what `cur` saw
+    out->min = 0;
+    out->max = 0;
+    if (out->total > 0) {
+        out->min = index_value(out, lowest, &size);
+        if (out->min < cur->min)
+            out->min = cur->min;
+        value = index_value(out, highest, &size) + size - 1;
+        out->max = (value < cur->max ? value : cur->max);
+    }
+}
+
+/**
+ * Return the value at the given percentile (0-100).
+ */
+unsigned long hist_percentile(const histogram* h, double pct)
+{
+    unsigned long target, seen = 0, size, value;
+    int i;
+
+    if (h->total == 0)
+        return 0;
+
+    target = (unsigned long)ceil(pct / 100.0 * h->total);
+    if (target < 1)
+        target = 1;
+
+    for (i=0; i<h->counts_len; i++) {
+        seen += h->counts[i];
+        if (seen >= target) {
+            // report the top of the matching range, but never
+            // more than was actually seen
+            value = index_value(h, i, &size);
+            value += size - 1;
+            return value < h->max ? value : h->max;
+        }
+    }
+
+    return h->max;
+}
+
+double hist_mean(const histogram* h)
+{
+    unsigned long size, value;
+    double sum = 0;
+    int i;
+
+    if (h->total == 0)
+        return 0;
+
+    for (i=0; i<h->counts_len; i++) {
+        if (h->counts[i] == 0)
+            continue;
+        value = index_value(h, i, &size);
+        sum += (double)(value + size / 2) * h->counts[i];
+    }
+
+    return sum / h->total;
+}
+
+double hist_stddev(const histogram* h)
+{
+    unsigned long size, value;
+    double mean = hist_mean(h);
+    double sum = 0, dev;
+    int i;
+
+    if (h->total == 0)
+        return 0;
+
+    for (i=0; i<h->counts_len; i++) {
+        if (h->counts[i] == 0)
+            continue;
+        value = index_value(h, i, &size);
+        dev = (double)(value + size / 2) - mean;
+        sum += dev * dev * h->counts[i];
+    }
+
+    return sqrt(sum / h->total);
+}
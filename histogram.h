@@ -0,0 +1,65 @@
+#ifndef WIDELOAD_HISTOGRAM_H
+#define WIDELOAD_HISTOGRAM_H
+
+/**
+ * A log-linear ("HDR") histogram of non-negative integer values.
+ *
+ * Values are bucketed with a fixed number of significant digits,
+ * so memory depends only on the range and precision, never on
+ * the number of values recorded. Each histogram has a single
+ * writer, which records without locks; other threads may read
+ * it at any time and see a slightly stale but consistent view.
+ */
+typedef struct {
+    unsigned long  highest;
+    int            sub_bucket_half_magnitude;
+    unsigned long  sub_bucket_count;
+    unsigned long  sub_bucket_mask;
+    int            counts_len;
+
+    unsigned long* counts;
+    unsigned long  total;
+    unsigned long  min;
+    unsigned long  max;
+} histogram;
+
+/**
+ * Set up a histogram tracking 1..highest with `sigfigs` (1-5)
+ * significant digits. Return 1 on error or 0 on success.
+ */
+int hist_init(histogram* h, unsigned long highest, int sigfigs);
+
+void hist_free(histogram* h);
+
+/**
+ * Record one value; larger values than `highest` are clamped.
+ * Only the owning thread may call this.
+ */
+void hist_record(histogram* h, unsigned long value);
+
+/**
+ * Add all of `from`'s values into `into`; both must have been
+ * set up with the same range and precision.
+ */
+void hist_merge(histogram* into, const histogram* from);
+
+/**
+ * Forget all recorded values.
+ */
+void hist_clear(histogram* h);
+
+/**
+ * Set `out` to the values recorded in `cur` but not `prev`, where
+ * `prev` is an earlier copy of the same histogram.
+ */
+void hist_diff(histogram* out, const histogram* cur, const histogram* prev);
+
+/**
+ * Return the value at the given percentile (0-100).
+ */
+unsigned long hist_percentile(const histogram* h, double pct);
+
+double hist_mean(const histogram* h);
+double hist_stddev(const histogram* h);
+
+#endif
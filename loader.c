@@ -2,78 +2,167 @@
 #include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
-#include <sys/time.h>
+#include <time.h>
+#include <sched.h>
 
 #include <curl/curl.h>
 
 #include "main.h"
 #include "loader.h"
 #include "list.h"
+#include "stream.h"
+#include "mix.h"
+#include "overhead.h"
+#include "share.h"
+#include "standby.h"
+#include "template.h"
+#include "endpoint.h"
 
-static inline unsigned long micros()
-{
-    struct timeval now;
-    gettimeofday(&now, NULL);
-    return now.tv_sec * 1000000 + now.tv_usec;
-}
+int stopping = 0;
 
 CURL* setup(options opts)
 {
     CURL* handle = curl_easy_init();
-    curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1);
-    curl_easy_setopt(handle, CURLOPT_NOPROGRESS, 1);
+    curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(handle, CURLOPT_NOPROGRESS, 1L);
     curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, on_response);
     curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, on_header);
     curl_easy_setopt(handle, CURLOPT_USERAGENT, "wideload " VERSION " (libcurl " LIBCURL_VERSION ")");
+    share_attach(handle);
 
     if (opts.fail_after != 0)
-        curl_easy_setopt(handle, CURLOPT_TIMEOUT_MS, opts.fail_after);
+        curl_easy_setopt(handle, CURLOPT_TIMEOUT_MS, (long)opts.fail_after);
+
+    // libcurl would otherwise negotiate HTTP/2 for https:// on its
+    // own. CURLOPT_PIPEWAIT is left off: a waiting request can wait
+    // forever on a connection whose every stream timed out
+    if (opts.http == HTTP_2_PRIOR_KNOWLEDGE)
+        curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE);
+    else if (opts.http == HTTP_2)
+        curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2_0);
+    else
+        curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_1_1);
 
     return handle;
 }
 
 /**
- * Make the given request, and populate rslt. If necessary, reconnect
- * and reinitialize handle (e.g. if the request timed out).
+ * Point the handle at the given request, expanded into exp if it's
+ * templated, with its timeout, and reset rslt to receive its response.
  */
-void make_request(CURL** handle, result* rslt, request* req, options opts)
+void prepare_request(CURL* handle, result* rslt, request* req, expansion* exp, const options* opts)
 {
+    const request* sent = template_expand(req, exp);
+
     rslt->req = req;
 
-    curl_easy_setopt(*handle, CURLOPT_URL, req->url);
-    curl_easy_setopt(*handle, CURLOPT_WRITEDATA, rslt);
-    curl_easy_setopt(*handle, CURLOPT_HEADERDATA, rslt);
+    curl_easy_setopt(handle, CURLOPT_URL, sent->url);
+    curl_easy_setopt(handle, CURLOPT_WRITEDATA, rslt);
+    curl_easy_setopt(handle, CURLOPT_HEADERDATA, rslt);
 
-    if (req->method == HTTP_POST) {
-        curl_easy_setopt(*handle, CURLOPT_POST, 1);
-        curl_easy_setopt(*handle, CURLOPT_POSTFIELDS, req->payload);
-        curl_easy_setopt(*handle, CURLOPT_POSTFIELDSIZE, req->payload_length);
+    if (sent->method == HTTP_POST) {
+        curl_easy_setopt(handle, CURLOPT_POST, 1L);
+        curl_easy_setopt(handle, CURLOPT_POSTFIELDS, sent->payload);
+        // libcurl sends straight from the payload, without copying it
+        curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)sent->payload_length);
     } else {
-        curl_easy_setopt(*handle, CURLOPT_HTTPGET, 0);
+        curl_easy_setopt(handle, CURLOPT_HTTPGET, 1L);
     }
 
-    if (req->num_headers > 0) {
-        curl_easy_setopt(*handle, CURLOPT_HTTPHEADER, req->curl_headers);
+    if (sent->num_headers > 0) {
+        curl_easy_setopt(handle, CURLOPT_HTTPHEADER, sent->curl_headers);
     } else {
-        curl_easy_setopt(*handle, CURLOPT_HTTPHEADER, NULL);
+        curl_easy_setopt(handle, CURLOPT_HTTPHEADER, NULL);
     }
 
-    rslt->time_first_byte = 0;
+    // an entry's own timeout replaces --fail-after, for it alone
+    if (req->timeout != 0)
+        curl_easy_setopt(handle, CURLOPT_TIMEOUT_MS, (long)req->timeout);
+    else
+        curl_easy_setopt(handle, CURLOPT_TIMEOUT_MS, (long)opts->fail_after);
+
     rslt->num_bytes = 0;
     rslt->status = 0;
+    rslt->url = NULL;
+}
+
+/**
+ * Fill in rslt's phase timings and sizes from the handle's
+ * just-finished transfer.
+ */
+void collect_timings(CURL* handle, result* rslt)
+{
+    curl_off_t dns = 0, connect = 0, tls = 0, pretransfer = 0, ttfb = 0;
+    long header_bytes = 0, request_bytes = 0, connects = 0;
+
+    curl_easy_getinfo(handle, CURLINFO_NAMELOOKUP_TIME_T, &dns);
+    curl_easy_getinfo(handle, CURLINFO_CONNECT_TIME_T, &connect);
+    curl_easy_getinfo(handle, CURLINFO_APPCONNECT_TIME_T, &tls);
+    curl_easy_getinfo(handle, CURLINFO_PRETRANSFER_TIME_T, &pretransfer);
+    curl_easy_getinfo(handle, CURLINFO_STARTTRANSFER_TIME_T, &ttfb);
+    curl_easy_getinfo(handle, CURLINFO_HEADER_SIZE, &header_bytes);
+    curl_easy_getinfo(handle, CURLINFO_REQUEST_SIZE, &request_bytes);
+    curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &connects);
+
+    // libcurl measures in micros
+    rslt->reused = (connects == 0);
+    rslt->time_dns = (rslt->reused ? 0 : dns * 1000);
+    rslt->time_connect = (rslt->reused ? 0 : connect * 1000);
+    rslt->time_tls = (rslt->reused ? 0 : tls * 1000);
+    rslt->time_pretransfer = pretransfer * 1000;
+    rslt->time_ttfb = ttfb * 1000;
+    rslt->header_bytes = header_bytes;
+    rslt->request_bytes = request_bytes;
+
+    if (ttfb > 0)
+        rslt->time_first_byte = rslt->time_start + rslt->time_ttfb;
+    else
+        rslt->time_first_byte = rslt->time_end;
+}
+
+/**
+ * Return 1 if the result is a failure: a status its request doesn't
+ * expect, or without expectations, one at or above --fail-status.
+ */
+int result_failed(const result* rslt, const options* opts)
+{
+    const request* req = rslt->req;
+    int i;
+
+    if (req->expect[0] == 0)
+        return (rslt->status >= opts->fail_status);
+    for (i=0; i<EXPECT_MAX && req->expect[i]!=0; i++)
+        if (rslt->status == req->expect[i])
+            return 0;
+    return 1;
+}
+
+/**
+ * Make the given request, expanding it into exp if it's templated,
+ * and populate rslt. If necessary, reconnect
+ * and reinitialize handle (e.g. if the request timed out), connecting
+ * ahead of the next request if given a standby.
+ */
+void make_request(CURL** handle, result* rslt, request* req, expansion* exp, options opts, standby* sb)
+{
+    prepare_request(*handle, rslt, req, exp, &opts);
 
-    rslt->time_start = micros();
+    rslt->time_start = nanos();
     int timeout = curl_easy_perform(*handle);
-    rslt->time_end = micros();
+    rslt->time_end = nanos();
 
-    if (rslt->time_first_byte == 0)
-        rslt->time_first_byte = rslt->time_end;
+    collect_timings(*handle, rslt);
 
     if (timeout) {
         // Force a reconnect, as the wire may now contain
-        // bytes we haven't read from this failed request
+        // bytes we haven't read from this failed request; the
+        // standby connects within the same budget the request had
+        if (sb != NULL)
+            standby_open(sb, *handle, req->timeout ? req->timeout : opts.fail_after ? opts.fail_after : STANDBY_TIMEOUT);
         curl_easy_cleanup(*handle);
         *handle = setup(opts);
+        if (sb != NULL)
+            standby_attach(sb, *handle);
 
         // Non-standard status 598 is used by some proxies
         // to indicate a read timeout. Close enough.
@@ -82,77 +171,203 @@ void make_request(CURL** handle, result* rslt, request* req, options opts)
 }
 
 /**
- * Load test worker thread
+ * Return the next request to make, for a connection whose place
+ * in the request list is *next.
  */
-void* load_thread(void* st)
+request* next_request(threadstate* state, unsigned long* next)
 {
-    threadstate* state = (threadstate*)st;
-    request* reqs = state->reqs;
-    options opts = state->opts;
-    unsigned long i = 0;
-    unsigned long r = 0;
-    if (opts.randomize)
-        r = rand() % state->req_count;
+    if (state->stream != NULL)
+        return stream_next(state->stream, &state->chunk);
+    if (state->mix != NULL)
+        return &state->reqs[mix_sample(state->mix, &state->rng)];
 
-    CURL* handle = setup(opts);
+    return &state->reqs[(*next)++ % state->req_count];
+}
+
+/**
+ * Return 1 if the connection numbered k should be making requests
+ * at time now, or 0 if the --profile has it parked.
+ */
+int conn_active(threadstate* state, unsigned long k, unsigned long now)
+{
+    const options* opts = &state->opts;
+
+    if (opts->profile == NULL || opts->rate_profile)
+        return 1;
+    return k < profile_level(opts->profile, now);
+}
+
+/**
+ * Return 1 if the request's result should carry the URL it was
+ * sent to: its URL is templated, so the detailed results would
+ * otherwise show only the template.
+ */
+int result_keeps_url(const threadstate* state, const request* req)
+{
+    // the binary format keeps only an index into its request table
+    return (state->opts.detailed && !state->opts.binary && req->tmpl != NULL && req->tmpl->url != NULL);
+}
 
-    if (opts.run_requests) {
-        state->rslts = malloc(sizeof(result) * opts.run_requests);
+/**
+ * Count a completed result in the thread's stats, and keep a
+ * copy of it if detailed results were asked for.
+ */
+void record_result(threadstate* state, result* rslt)
+{
+    result* kept;
+
+    stats_record(&state->stats, rslt, &state->opts);
+    if (state->endpoints != NULL)
+        endpoint_record(state->endpoints, rslt, &state->opts);
+    if (state->sched != NULL)
+        hist_record(&state->lateness, result_lateness(rslt) / 1000);
+    if (!state->opts.detailed) {
+        stream_release(rslt->req);
+        return;
+    }
 
-        while (i < opts.run_requests) {
-            make_request(&handle, &state->rslts[i], &reqs[(r + i) % state->req_count], opts);
-            i++;
+    if (state->batch == NULL) {
+        // reuse a batch the writer has finished with, if any
+        if ((state->batch = ring_pop(&state->spare)) == NULL) {
+            state->batch = malloc(sizeof(result_batch));
+            state->batch->urls = NULL;
+            state->batch->urls_size = 0;
         }
+        state->batch->count = 0;
+        state->batch->urls_length = 0;
+    }
 
-        state->rslt_count = i;
-    } else if (opts.run_seconds) {
-        unsigned long end_time = micros() + (1000000 * opts.run_seconds);
+    kept = &state->batch->rslts[state->batch->count++];
+    *kept = *rslt;
+    if (rslt->url != NULL) {
+        // the engine expands its next request over the URL, so copy
+        // it into the batch, whose space is reused once written
+        kept->url_offset = state->batch->urls_length;
+        state->batch->urls_length = template_put(&state->batch->urls, &state->batch->urls_size,
+                                                 state->batch->urls_length, rslt->url, rslt->url_length);
+        state->batch->urls_length = template_put(&state->batch->urls, &state->batch->urls_size,
+                                                 state->batch->urls_length, "", 1);
+    }
 
-        list* resultlist = list_new();
-        node* n;
-        result resultbuf[1000];
-        result* resultcpy;
+    if (state->batch->count == RESULT_BATCH_SIZE)
+        flush_results(state);
+}
 
-        while (micros() < end_time) {
-            make_request(&handle, &resultbuf[i % 1000], &reqs[(r + i) % state->req_count], opts);
+/**
+ * Hand any partly filled batch of results to the writer thread.
+ */
+void flush_results(threadstate* state)
+{
+    struct timespec backoff = {0, 100000};
 
-            if (i % 1000 == 999) {
-                // copy the resultbuf and count into a list node,
-                // and recycle the resultbuf for the next batch
-                resultcpy = malloc(1000 * sizeof(result));
-                memcpy(resultcpy, resultbuf, 1000 * sizeof(result));
-                n = list_node_new(resultcpy);
-                list_push(resultlist, n);
-            }
+    if (state->batch == NULL || state->batch->count == 0)
+        return;
 
-            i++;
-        }
+    // if the writer has fallen this far behind, wait for it
+    // rather than let memory grow without bound
+    while (!ring_push(&state->full, state->batch)) {
+        state->stalls++;
+        nanosleep(&backoff, NULL);
+    }
+    state->batch = NULL;
+}
+
+/**
+ * Free a batch of results and the URLs it keeps.
+ */
+void result_batch_free(result_batch* batch)
+{
+    if (batch == NULL)
+        return;
+    free(batch->urls);
+    free(batch);
+}
 
-        state->rslt_count = 0;
+/**
+ * Sleep until the given time (in nanos), if it's still ahead, or
+ * until the run is stopped.
+ */
+static void wait_until(unsigned long when)
+{
+    struct timespec delay;
+    unsigned long now;
+
+    // a signal can cut the sleep short, and only a stop should
+    while ((now = nanos()) < when && !__atomic_load_n(&stopping, __ATOMIC_RELAXED)) {
+        delay.tv_sec = (when - now) / 1000000000;
+        delay.tv_nsec = (when - now) % 1000000000;
+        nanosleep(&delay, NULL);
+    }
+}
 
-        n = resultlist->head;
-        while (n != NULL) {
-            state->rslt_count += 1000;
-            n = n->next;
-        }
-        // account for any left in resultbuf
-        state->rslt_count += i % 1000;
-        state->rslts = malloc(sizeof(result) * state->rslt_count);
-
-        unsigned long offset = 0;
-        n = resultlist->head;
-        while (n != NULL) {
-            memcpy(&state->rslts[offset], n->data, 1000 * sizeof(result));
-            offset += 1000;
-            n = n->next;
+/**
+ * Load test worker thread
+ */
+void* load_thread(void* st)
+{
+    threadstate* state = (threadstate*)st;
+    options opts = state->opts;
+    result rslt;
+    unsigned long i = 0;
+    unsigned long next = 0;
+    unsigned long end_time = 0;
+    unsigned long intended = 0;
+    unsigned long waited = 0, idle;
+    standby sb;
+    expansion exp;
+    if (opts.randomize)
+        next = rng_below(&state->rng, state->req_count);
+
+    overhead_begin(state);
+    CURL* handle = setup(opts);
+    standby_init(&sb);
+    expansion_init(&exp, &state->rng);
+    if (opts.standby)
+        standby_attach(&sb, handle);
+
+    if (opts.profile != NULL)
+        end_time = opts.profile->start + opts.profile->length;
+    else if (opts.run_seconds)
+        end_time = nanos() + (1000000000UL * opts.run_seconds);
+
+    while ((opts.run_requests ? i < opts.run_requests : nanos() < end_time) && !__atomic_load_n(&stopping, __ATOMIC_RELAXED)) {
+        if (state->sched != NULL) {
+            // open-loop: take the next slot in the shared schedule,
+            // and wait for it unless we're already running late
+            intended = schedule_claim(state->sched, &state->rng);
+            if (end_time && intended >= end_time)
+                break;
+            idle = nanos();
+            wait_until(intended);
+            waited += nanos() - idle;
+            if (__atomic_load_n(&stopping, __ATOMIC_RELAXED))
+                break;
+        } else if (!conn_active(state, state->conn_first, nanos())) {
+            // parked by the profile; look again shortly
+            idle = nanos();
+            wait_until(idle + PARKED_POLL);
+            waited += nanos() - idle;
+            continue;
         }
-        // copy any left in resultbuf
-        memcpy(&state->rslts[offset], resultbuf, (i % 1000) * sizeof(result));
 
-        list_free(resultlist, 1);
+        make_request(&handle, &rslt, next_request(state, &next), &exp, opts, opts.standby ? &sb : NULL);
+        rslt.time_intended = (state->sched != NULL ? intended : rslt.time_start);
+        if (result_keeps_url(state, rslt.req)) {
+            rslt.url = exp.req.url;
+            rslt.url_length = strlen(exp.req.url);
+        }
+        record_result(state, &rslt);
+        waited += rslt.time_end - rslt.time_start;
+        i++;
     }
 
     curl_easy_cleanup(handle);
+    standby_close(&sb);
+    expansion_free(&exp);
+    overhead_end(state, waited);
+    state->last_cpu = sched_getcpu();
+    stream_drop(&state->chunk);
+    flush_results(state);
 
     return NULL;
 }
@@ -178,8 +393,9 @@ size_t on_header(void* buffer, size_t size, size_t nmemb, void* ctx)
     unsigned long num_bytes = size * nmemb;
     result* rslt = (result *)ctx;
 
-    if (rslt->status == 0) {
-        // Parse the status from "HTTP/1.X NNN message"
+    if (num_bytes > 5 && strncmp(buffer, "HTTP/", 5) == 0) {
+        // Parse the status from "HTTP/1.X NNN message"; if there
+        // are interim (1xx) responses, the last status line wins
         char * tmp = buffer;
         char * status;
         strsep(&tmp, " ");
@@ -187,7 +403,6 @@ size_t on_header(void* buffer, size_t size, size_t nmemb, void* ctx)
         strsep(&tmp, " \r\n");
 
         rslt->status = strtol(status, NULL, 10);
-        rslt->time_first_byte = micros();
     }
 
     return num_bytes;
@@ -1,7 +1,14 @@
 #ifndef WIDELOAD_LOADER_H
 #define WIDELOAD_LOADER_H
 
+#include <curl/curl.h>
+
 #include "cli.h"
+#include "schedule.h"
+#include "stats.h"
+#include "ring.h"
+#include "timing.h"
+#include "rng.h"
 
 typedef enum {
     HTTP_GET,
@@ -13,41 +20,249 @@ typedef struct {
     char* value;
 } header;
 
+/* the most statuses an entry can expect */
+#define EXPECT_MAX 4
+
+struct _stream;
+struct _stream_chunk;
+struct _payload_file;
+struct _mix;
+struct _raw_request;
+struct _request_template;
+struct _expansion;
+struct _endpoint_stats;
+
 typedef struct {
     http_method   method;
     char*         url;
     char*         payload;
     unsigned long payload_length;
+    /* the mapped file the payload points into (see payload.h),
+       or NULL if the payload is the request's own */
+    struct _payload_file* payload_map;
     header*       headers;
     unsigned long num_headers;
     struct curl_slist* curl_headers;
+
+    /* the compiled placeholders of its URL, headers and payload
+       (see template.h), or NULL if it's sent as it is */
+    struct _request_template* tmpl;
+
+    /* relative share of the mix; see mix.h */
+    double        weight;
+
+    /* the endpoint it's reported under in the summary (see
+       endpoint.h), and its name if the URLs file gave one */
+    char*         name;
+    unsigned long endpoint;
+
+    /* the entry's own --fail-after (ms), or 0 to use the run's; and
+       the statuses it succeeds with (up to the first 0), or none to
+       fail at --fail-status */
+    unsigned long timeout;
+    unsigned short expect[EXPECT_MAX];
+
+    /* the stream chunk this request was read into (see stream.h),
+       or NULL if it belongs to a fully loaded requests */
+    struct _stream_chunk* chunk;
 } request;
 
 typedef struct {
     unsigned long count;
     request*      reqs;
+
+    /* for a compiled request set, the file mapping and the
+       arrays shared by all the requests' headers */
+    void*         mapping;
+    unsigned long mapping_size;
+    header*       header_pool;
+    struct curl_slist* curl_header_pool;
 } requests;
 
-typedef struct {
+typedef struct _result {
     request*      req;
     int           status;
     unsigned long num_bytes;
 
+    /* the URL it was sent to, if that was expanded from a template
+       and detailed results are CSV (see result_keeps_url()), or
+       NULL; it points into the engine's expansion until recorded,
+       when record_result() copies it, NUL-terminated, to url_offset
+       in its batch's urls */
+    const char*   url;
+    unsigned long url_length;
+    unsigned long url_offset;
+
+    /* monotonic nanos (see timing.h); time_intended is when the
+       request should have started, equal to time_start unless an
+       open-loop schedule fell behind */
+    unsigned long time_intended;
     unsigned long time_start;
     unsigned long time_first_byte;
     unsigned long time_end;
+
+    /* when each of libcurl's phases finished, in nanos after
+       time_start; connection phases are 0 on a reused connection */
+    unsigned long time_dns;
+    unsigned long time_connect;
+    unsigned long time_tls;
+    unsigned long time_pretransfer;
+    unsigned long time_ttfb;
+
+    unsigned long header_bytes;
+    unsigned long request_bytes;
+    char          reused;
 } result;
 
+/* how often a connection parked by a --profile checks whether it's
+   needed again (ns) */
+#define PARKED_POLL 10000000UL
+
+/* how often the multi engine samples its HTTP/2 connections' streams (ns) */
+#define STREAMS_SAMPLE 10000000UL
+
+#define RESULT_BATCH_SIZE 1000
+#define RESULT_RING_SIZE 256
+
+/**
+ * Results on their way to the writer. The expanded URLs they keep are
+ * copied end to end into urls, which is reused with the batch, so
+ * keeping them costs no allocation per request.
+ */
+typedef struct {
+    unsigned long count;
+    result        rslts[RESULT_BATCH_SIZE];
+    char*         urls;
+    unsigned long urls_length;
+    unsigned long urls_size;
+} result_batch;
+
 typedef struct {
     options       opts;
 
     unsigned long req_count;
     request*      reqs;
 
-    unsigned long rslt_count;
-    result*       rslts;
+    /* if the requests are weighted, they're drawn from this
+       instead of taken in turn */
+    struct _mix*  mix;
+
+    /* for the raw engine, each of reqs serialized (see raw.h) */
+    struct _raw_request*  raw;
+
+    /* when streaming the URL file, requests come a chunk at a
+       time from the shared stream instead of from reqs */
+    struct _stream*       stream;
+    struct _stream_chunk* chunk;
+
+    /* connections driven by this thread; always 1 for the easy engine */
+    unsigned long conn_count;
+
+    /* the run-wide number of the thread's first connection, and the
+       step to its next; under a --profile, connection k only makes
+       requests while the profile's level is above k */
+    unsigned long conn_first;
+    unsigned long conn_stride;
+
+    /* shared open-loop schedule, or NULL when running closed-loop */
+    schedule*     sched;
+    rng           rng;
+
+    stats         stats;
+
+    /* the same for each endpoint, unless the summary has no
+       breakdown by endpoint; see endpoint.h */
+    struct _endpoint_stats* endpoints;
+
+    /* with HTTP/2, how many streams were in flight on each of the
+       thread's connections, sampled every STREAMS_SAMPLE */
+    histogram     streams;
+
+    /* the thread's own cost (see overhead.h): when it ran, its CPU
+       time and the time it was busy, in nanos; and with a rate, how
+       late each request started, in micros */
+    unsigned long time_begun;
+    unsigned long time_ended;
+    unsigned long cpu_time;
+    unsigned long busy;
+    histogram     lateness;
+
+    /* the CPU the thread is pinned to, or -1; and the one it was
+       last seen on (see placement.h) */
+    int           cpu;
+    int           last_cpu;
+
+    /* if opts.detailed, results are gathered into batches, and
+       passed to the writer thread through `full`; it passes the
+       emptied batches back through `spare` */
+    result_batch* batch;
+    ring          full;
+    ring          spare;
+    unsigned long stalls;
 } threadstate;
 
+/**
+ * Set when the run should wind down early (e.g. on SIGINT).
+ */
+extern int stopping;
+
+/**
+ * Create and configure a new libcurl handle.
+ */
+CURL* setup(options opts);
+
+/**
+ * Point the handle at the given request, expanded into exp if it's
+ * templated, with its timeout, and reset rslt to receive its response.
+ */
+void prepare_request(CURL* handle, result* rslt, request* req, struct _expansion* exp, const options* opts);
+
+/**
+ * Return 1 if the result is a failure: a status its request doesn't
+ * expect, or without expectations, one at or above --fail-status.
+ */
+int result_failed(const result* rslt, const options* opts);
+
+/**
+ * Fill in rslt's phase timings and sizes from the handle's
+ * just-finished transfer.
+ */
+void collect_timings(CURL* handle, result* rslt);
+
+/**
+ * Return the next request to make, for a connection whose place
+ * in the request list is *next.
+ */
+request* next_request(threadstate* state, unsigned long* next);
+
+/**
+ * Return 1 if the connection numbered k should be making requests
+ * at time now, or 0 if the --profile has it parked.
+ */
+int conn_active(threadstate* state, unsigned long k, unsigned long now);
+
+/**
+ * Return 1 if the request's result should carry the URL it was
+ * sent to: its URL is templated, so the detailed results would
+ * otherwise show only the template.
+ */
+int result_keeps_url(const threadstate* state, const request* req);
+
+/**
+ * Count a completed result in the thread's stats, and keep a
+ * copy of it if detailed results were asked for.
+ */
+void record_result(threadstate* state, result* rslt);
+
+/**
+ * Hand any partly filled batch of results to the writer thread.
+ */
+void flush_results(threadstate* state);
+
+/**
+ * Free a batch of results and the URLs it keeps.
+ */
+void result_batch_free(result_batch* batch);
 
 /**
  * Main thread entry point.
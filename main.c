@@ -1,110 +1,521 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <pthread.h>
 #include <time.h>
+#include <signal.h>
+
+#include <curl/curl.h>
 
 #include "cli.h"
 #include "urlfile.h"
 #include "loader.h"
+#include "multi.h"
+#include "raw.h"
+#include "writer.h"
+#include "reporter.h"
+#include "reqset.h"
+#include "stream.h"
+#include "mix.h"
+#include "endpoint.h"
+#include "placement.h"
+#include "overhead.h"
+#include "share.h"
+#include "search.h"
+#include "agent.h"
+#include "coordinator.h"
+#include "template.h"
+
 
+/**
+ * Stop starting new requests, and let the in-flight ones and
+ * the summary finish as usual.
+ */
+void on_interrupt(int sig)
+{
+    __atomic_store_n(&stopping, 1, __ATOMIC_RELAXED);
+}
 
-int cmp_ul_asc(const void* aa, const void* bb)
+/**
+ * Print the distribution of a latency histogram (in micros).
+ */
+void print_timings(const char* title, const histogram* h)
 {
-    const unsigned long *a = aa, *b = bb;
-    return (*a < *b) ? -1 : (*a > *b);
+    static const double percentiles[] = {50, 75, 90, 95, 99, 99.9, 99.99};
+    unsigned long i;
+
+    if (h->total == 0)
+        return;
+
+    printf("%s\n", title);
+    printf("   mean: %.3f (stddev %.3f)\n", hist_mean(h) / 1000.0, hist_stddev(h) / 1000.0);
+    for (i=0; i<sizeof(percentiles) / sizeof(percentiles[0]); i++)
+        printf(" %6g%%: %.3f\n", percentiles[i], hist_percentile(h, percentiles[i]) / 1000.0);
+    printf("    max: %.3f\n", h->max / 1000.0);
+    printf("\n");
+}
+
+/**
+ * Print the latency of successful requests, and for an open-loop
+ * test how well the schedule was kept.
+ */
+void print_latency(const options* opts, const stats* summary)
+{
+    if (opts->rate) {
+        // open-loop latency counts from when each request was
+        // due, so a stalled schedule can't hide queueing delay
+        print_timings("Successful request time from intended start (ms)", &summary->corrected);
+        print_timings("Successful request time from actual start (ms)", &summary->latency);
+        printf("Started more than 1ms late: %lu (max %.3f ms)\n", summary->late, summary->max_late / 1000000.0);
+        if (summary->late > 0)
+            printf("  (raise --concurrency if the schedule keeps slipping)\n");
+        printf("\n");
+    } else {
+        print_timings("Successful request time (ms)", &summary->latency);
+    }
+}
+
+/**
+ * Print a line per request phase (in micros).
+ */
+void print_phases(const stats* st)
+{
+    int i;
+
+    printf("Request phases (ms)     mean      p50      p99      max\n");
+    for (i=0; i<PHASE_COUNT; i++) {
+        const histogram* h = &st->phases[i];
+        if (h->total == 0)
+            continue;
+        printf(" %-12s %11.3f %8.3f %8.3f %8.3f\n",
+               phase_names[i],
+               hist_mean(h) / 1000.0,
+               hist_percentile(h, 50) / 1000.0,
+               hist_percentile(h, 99) / 1000.0,
+               h->max / 1000.0);
+    }
+    printf("New connections: %lu of %lu requests\n", st->connects, st->requests);
+    printf("\n");
+}
+
+/**
+ * Print how many HTTP/2 streams each connection carried at once.
+ */
+void print_streams(const options* opts, const threadstate* states, unsigned long nthreads)
+{
+    histogram h;
+    unsigned long i;
+
+    if (hist_init(&h, opts->streams + 1, 3)) {
+        fprintf(stderr, "Could not allocate statistics\n");
+        exit(2);
+    }
+    for (i=0; i<nthreads; i++)
+        hist_merge(&h, &states[i].streams);
+
+    if (h.total > 0) {
+        printf("HTTP/2 streams in flight per connection (sampled every %lums, at most %lu)\n", STREAMS_SAMPLE / 1000000, opts->streams);
+        printf("   mean: %.1f  p50: %lu  p99: %lu  max: %lu\n",
+               hist_mean(&h), hist_percentile(&h, 50), hist_percentile(&h, 99), h.max);
+        printf("\n");
+    }
+    hist_free(&h);
+}
+
+/**
+ * Wait out each stage of the profile, filling in stage_stats[i]
+ * with what the workers did during stage i. Return the number of
+ * stages finished, which is fewer than all if the run is stopped.
+ */
+unsigned long watch_stages(const profile* prof, threadstate* states, unsigned long nthreads, stats* stage_stats)
+{
+    stats snapshots[2];
+    struct timespec tick = {0, 50000000};
+    unsigned long i, s, end, now;
+    int cur = 0;
+
+    if (stats_init(&snapshots[0]) || stats_init(&snapshots[1])) {
+        fprintf(stderr, "Could not allocate statistics\n");
+        exit(2);
+    }
+
+    for (s=0; s<prof->count; s++) {
+        end = profile_stage_end(prof, s);
+        while ((now = nanos()) < end && !__atomic_load_n(&stopping, __ATOMIC_RELAXED)) {
+            if (end - now < 50000000)
+                tick.tv_nsec = end - now;
+            nanosleep(&tick, NULL);
+        }
+        tick.tv_nsec = 50000000;
+
+        // as for the reporter: a merged copy less the previous
+        // one is what happened in between
+        cur = !cur;
+        stats_clear(&snapshots[cur]);
+        for (i=0; i<nthreads; i++)
+            stats_merge(&snapshots[cur], &states[i].stats);
+        stats_diff(&stage_stats[s], &snapshots[cur], &snapshots[!cur]);
+
+        if (__atomic_load_n(&stopping, __ATOMIC_RELAXED))
+            break;
+    }
+
+    stats_free(&snapshots[0]);
+    stats_free(&snapshots[1]);
+    return (s < prof->count ? s + 1 : s);
+}
+
+/**
+ * Print a line of throughput and latency per profile stage.
+ */
+void print_stages(const options* opts, stats* stage_stats, unsigned long count)
+{
+    const profile* prof = opts->profile;
+    const char* unit = (opts->rate_profile ? "req/s" : "connections");
+    char level[64];
+    unsigned long s;
+
+    printf("Stage                              secs   requests      req/s  failures      p50      p99      max (ms)\n");
+    for (s=0; s<count; s++) {
+        const stage* st = &prof->stages[s];
+        const stats* ss = &stage_stats[s];
+        // open-loop latency counts from each request's intended start
+        const histogram* h = (opts->rate_profile ? &ss->corrected : &ss->latency);
+        double seconds = st->duration / 1000000000.0;
+
+        if (st->from == st->to)
+            snprintf(level, sizeof(level), "%g %s", st->from, unit);
+        else
+            snprintf(level, sizeof(level), "%g-%g %s", st->from, st->to, unit);
+        printf(" %3lu  %-26s %7.1f %10lu %10.1f %9lu %8.3f %8.3f %8.3f\n",
+               s + 1, level, seconds, ss->requests, ss->requests / seconds, ss->failures,
+               hist_percentile(h, 50) / 1000.0,
+               hist_percentile(h, 99) / 1000.0,
+               h->max / 1000.0);
+    }
+    printf("\n");
+}
+
+/**
+ * Run the test on the agents in opts->coordinator instead of here,
+ * and print the merged summary. Return the exit status.
+ */
+int coordinate(options* opts, int argc, char* argv[])
+{
+    coordinator co;
+    stats summary;
+
+    if (stats_init(&summary)) {
+        fprintf(stderr, "Could not allocate statistics\n");
+        exit(2);
+    }
+
+    signal(SIGINT, on_interrupt);
+    signal(SIGTERM, on_interrupt);
+
+    if (coordinator_run(&co, opts, argc, argv, &summary) != 0)
+        exit(2);
+
+    print_latency(opts, &summary);
+    print_phases(&summary);
+    coordinator_print(&co, opts);
+
+    printf("Failures: %lu\n", summary.failures);
+    if (!opts->seeded && (co.weighted || opts->randomize || opts->poisson))
+        printf("Random seed: %lu (repeat with --seed)\n", opts->seed);
+
+    coordinator_free(&co);
+    stats_free(&summary);
+    if (opts->profile != NULL) {
+        profile_free(opts->profile);
+        free(opts->profile);
+    }
+
+    return 0;
 }
 
 int main(int argc, char* argv[])
 {
-    unsigned long i, j, k;
-    unsigned long* timings;
-    unsigned long failures = 0;
-    unsigned long total = 0;
-    FILE* csv;
+    unsigned long i;
+    unsigned long stalls;
+    unsigned long nthreads;
+    void* (*entry)(void*);
+    schedule sched;
+    stream urls;
+    requests reqs;
+    mix weighted;
+    char mixing;
+    endpoints eps;
+    raw_requests raw;
+    placement pl;
+    pthread_attr_t attr;
+    stats* stage_stats = NULL;
+    search srch;
+    unsigned long stages_run = 0;
+    stats summary;
+    writer wr;
+    reporter rp;
+    result_batch* batch;
+    agent ag;
+    char agent_mode = 0;
 
     options opts = command_line_options(argc, argv);
-    requests reqs = parse_urls(opts.url_filename);
-    if (opts.randomize)
-        srand(time(NULL));
+    if (opts.agent_port) {
+        // each run takes the coordinator's options in place of ours
+        if (agent_serve(&ag, opts.agent_address, opts.agent_port, &argc, &argv) != 0)
+            exit(2);
+        opts = command_line_options(argc, argv);
+        agent_mode = 1;
+        // a coordinator chooses the test, but not what's written on
+        // the agent's machine
+        if (opts.agent_port || opts.coordinator != NULL || opts.compile_to != NULL) {
+            fprintf(stderr, "Coordinator sent --agent, --coordinator or --compile; not running\n");
+            exit(1);
+        }
+        // nor what's read there: the set must be compiled, with every
+        // payload and CSV file it needs inside it
+        if (opts.stream || !reqset_detect(opts.url_filename)) {
+            fprintf(stderr, "Coordinator sent something other than a compiled request set; not running\n");
+            exit(1);
+        }
+        template_forbid_files();
+        opts.detailed = 0;
+    }
+    if (timing_init() != 0)
+        exit(2);
+    if (opts.coordinator != NULL)
+        return coordinate(&opts, argc, argv);
+    if (opts.stream) {
+        // nothing is loaded up front; the workers share the stream
+        if (stream_open(&urls, opts.url_filename) != 0)
+            exit(1);
+        memset(&reqs, 0, sizeof(reqs));
+    } else {
+        reqs = load_requests(opts.url_filename);
+    }
+    if (opts.compile_to != NULL) {
+        if (reqset_write(opts.compile_to, reqs) != 0)
+            exit(1);
+        printf("Compiled %lu requests to %s\n", reqs.count, opts.compile_to);
+        free_requests(reqs);
+        return 0;
+    }
+    // a mix is only needed when some weights differ; otherwise the
+    // requests are taken in turn, as they always have been
+    mixing = (!opts.stream && mix_weighted(reqs));
+    if (mixing && mix_init(&weighted, reqs) != 0)
+        exit(1);
+    // streamed requests aren't known up front, so can't be grouped
+    if (opts.stream)
+        memset(&eps, 0, sizeof(eps));
+    else
+        endpoints_group(&eps, reqs);
 
-    pthread_t threads[opts.concurrency];
-    threadstate states[opts.concurrency];
+    if (curl_global_init(CURL_GLOBAL_ALL) != 0) {
+        fprintf(stderr, "Could not initialize libcurl\n");
+        exit(2);
+    }
+    // every handle shares one DNS cache and TLS session cache
+    if (share_init() != 0)
+        exit(2);
 
+    // the easy engine runs a thread per connection; the multi and
+    // raw engines spread the connections over a few event loops
+    if (opts.engine == ENGINE_MULTI) {
+        nthreads = opts.threads;
+        entry = multi_thread;
+    } else if (opts.engine == ENGINE_RAW) {
+        if (raw_prepare(&raw, reqs, &opts) != 0)
+            exit(1);
+        nthreads = opts.threads;
+        entry = raw_thread;
+    } else {
+        nthreads = opts.concurrency;
+        entry = load_thread;
+    }
 
-    for (i=0; i<opts.concurrency; i++) {
+    pthread_t threads[nthreads];
+    threadstate states[nthreads];
+
+    if (placement_init(&pl, opts.cpus, opts.reserve_cpus) != 0)
+        exit(11);
+
+    if (opts.rate)
+        schedule_init(&sched, opts.rate, opts.poisson);
+
+    for (i=0; i<nthreads; i++) {
+        memset(&states[i], 0, sizeof(threadstate));
         states[i].reqs = reqs.reqs;
         states[i].req_count = reqs.count;
+        states[i].stream = (opts.stream ? &urls : NULL);
         states[i].opts = opts;
-        if (pthread_create(&threads[i], NULL, load_thread, &states[i]) != 0) {
-            perror("thread error");
+        states[i].conn_count = opts.concurrency / nthreads + (i < opts.concurrency % nthreads ? 1 : 0);
+        states[i].conn_first = i;
+        states[i].conn_stride = nthreads;
+        states[i].sched = (opts.rate ? &sched : NULL);
+        states[i].mix = (mixing ? &weighted : NULL);
+        states[i].raw = (opts.engine == ENGINE_RAW ? raw.reqs : NULL);
+        rng_seed(&states[i].rng, opts.seed + i);
+        states[i].cpu = placement_cpu(&pl, i);
+        states[i].last_cpu = -1;
+
+        // allocate what the worker writes on every request from its
+        // own CPU, so that first touch puts it on the worker's node
+        placement_enter(&pl, i);
+        if (stats_init(&states[i].stats) || overhead_init(&states[i]) ||
+                (eps.shown && (states[i].endpoints = endpoint_stats_new(eps.count)) == NULL) ||
+                (opts.http != HTTP_1_1 && hist_init(&states[i].streams, opts.streams + 1, 3))) {
+            fprintf(stderr, "Could not allocate statistics\n");
+            exit(2);
+        }
+        if (pl.pinned) {
+            stats_clear(&states[i].stats);
+            if (opts.detailed && (states[i].batch = malloc(sizeof(result_batch))) != NULL)
+                memset(states[i].batch, 0, sizeof(result_batch));
+        }
+        placement_leave(&pl);
+
+        if (opts.detailed && (ring_init(&states[i].full, RESULT_RING_SIZE) || ring_init(&states[i].spare, RESULT_RING_SIZE))) {
+            fprintf(stderr, "Could not allocate result queues\n");
             exit(2);
         }
     }
 
-    for (i=0; i<opts.concurrency; i++) {
-        pthread_join(threads[i], NULL);
-        pthread_detach(threads[i]);
+    // an agent starts when the coordinator says, and its schedule
+    // from then
+    if (agent_mode) {
+        if (agent_ready(&ag) != 0)
+            exit(2);
+        if (opts.rate)
+            sched.next = nanos();
     }
 
-    // compute summary statistics
-    csv = fopen("detailed-results.csv", "w");
-    fprintf(csv, "method,url,time_start,time_first_byte,time_finish,status,bytes_received\n");
-
-    for (i=0; i<opts.concurrency; i++) {
-        threadstate state = states[i];
-        for (j=0; j<state.rslt_count; j++) {
-            result* rslt = &state.rslts[j];
-            if (rslt->status >= opts.fail_status)
-                failures++;
-            else
-                total++;
-            fprintf(csv, "%s,%s,%.3f,%.3f,%.3f,%d,%lu\n",
-                    rslt->req->method == HTTP_GET ? "GET" : "POST",
-                    rslt->req->url,
-                    rslt->time_start / 1000000.0,
-                    rslt->time_first_byte / 1000000.0,
-                    rslt->time_end / 1000000.0,
-                    rslt->status,
-                    rslt->num_bytes);
-        }
+    if (opts.detailed) {
+        if (writer_start(&wr, opts, reqs, states, nthreads) != 0)
+            exit(2);
+        placement_reserve(&pl, wr.thread);
+    }
+
+    if (opts.report_interval) {
+        if (reporter_start(&rp, states, nthreads, opts.report_interval) != 0)
+            exit(2);
+        placement_reserve(&pl, rp.thread);
     }
 
-    if (NULL != (timings = malloc(sizeof(unsigned long) * total))) {
-        k = 0;
-        for (i=0; i<opts.concurrency; i++) {
-            threadstate state = states[i];
-            for (j=0; j<state.rslt_count; j++) {
-                if (state.rslts[j].status >= opts.fail_status)
-                    continue;
-                timings[k] = state.rslts[j].time_end - state.rslts[j].time_start;
-                k++;
+    signal(SIGINT, on_interrupt);
+    signal(SIGTERM, on_interrupt);
+
+    if (opts.profile != NULL) {
+        stage_stats = malloc(opts.profile->count * sizeof(stats));
+        for (i=0; i<opts.profile->count; i++) {
+            if (stage_stats == NULL || stats_init(&stage_stats[i])) {
+                fprintf(stderr, "Could not allocate statistics\n");
+                exit(2);
             }
         }
 
-        qsort(timings, total, sizeof(unsigned long), cmp_ul_asc);
+        // the profile, and any schedule following it, starts now
+        opts.profile->start = nanos();
+        if (opts.rate_profile) {
+            sched.next = opts.profile->start;
+            sched.prof = opts.profile;
+        }
+    }
 
-        printf("Successful request time (ms)\n");
-        printf(" 50%%: %lu\n", (unsigned long)(timings[total / 2] / 1000.0));
-        printf(" 75%%: %lu\n", (unsigned long)(timings[(unsigned long)(total * 0.75)] / 1000.0));
-        printf(" 95%%: %lu\n", (unsigned long)(timings[(unsigned long)(total * 0.95)] / 1000.0));
-        printf(" max: %lu\n", (unsigned long)(timings[total - 1] / 1000.0));
-        printf("\n");
+    for (i=0; i<nthreads; i++) {
+        pthread_attr_init(&attr);
+        placement_attr(&pl, &attr, i);
+        if (pthread_create(&threads[i], &attr, entry, &states[i]) != 0) {
+            perror("thread error");
+            exit(2);
+        }
+        pthread_attr_destroy(&attr);
+    }
+    if (agent_mode && agent_start(&ag, states, nthreads) != 0)
+        exit(2);
+
+    if (opts.profile != NULL)
+        stages_run = watch_stages(opts.profile, states, nthreads, stage_stats);
+    if (opts.search)
+        search_run(&srch, &sched, states, nthreads, &opts);
+
+    for (i=0; i<nthreads; i++) {
+        pthread_join(threads[i], NULL);
+        pthread_detach(threads[i]);
+    }
 
-        printf("Failures: %lu\n", failures);
+    if (agent_mode)
+        agent_stop(&ag);
+    if (opts.report_interval)
+        reporter_stop(&rp);
+    if (opts.detailed)
+        writer_stop(&wr);
 
-        free(timings);
+    // compute summary statistics
+    if (stats_init(&summary)) {
+        fprintf(stderr, "Could not allocate statistics\n");
+        exit(2);
     }
+    for (i=0; i<nthreads; i++)
+        stats_merge(&summary, &states[i].stats);
+    if (agent_mode)
+        agent_finish(&ag, &summary);
+
+    print_latency(&opts, &summary);
+    print_phases(&summary);
+    endpoints_print(&eps, states, nthreads, &opts);
+    if (opts.http != HTTP_1_1)
+        print_streams(&opts, states, nthreads);
+    if (opts.profile != NULL)
+        print_stages(&opts, stage_stats, stages_run);
+    if (opts.search)
+        search_print(&srch, &opts);
+    placement_print(&pl, states, nthreads);
+    overhead_print(&opts, states, nthreads);
 
-    for (i=0; i<opts.concurrency; i++) {
-        threadstate state = states[i];
-        free(state.rslts);
+    printf("Failures: %lu\n", summary.failures);
+    if (!opts.seeded && (mixing || opts.randomize || opts.poisson))
+        printf("Random seed: %lu (repeat with --seed)\n", opts.seed);
+
+    for (i=0, stalls=0; i<nthreads; i++)
+        stalls += states[i].stalls;
+    if (stalls > 0)
+        printf("Workers waited %lu times for detailed results to be written\n", stalls);
+
+    for (i=0; i<nthreads; i++) {
+        threadstate* state = &states[i];
+        stats_free(&state->stats);
+        endpoint_stats_free(state->endpoints, eps.count);
+        overhead_free(state);
+        if (opts.http != HTTP_1_1)
+            hist_free(&state->streams);
+        if (opts.detailed) {
+            while ((batch = ring_pop(&state->spare)) != NULL)
+                result_batch_free(batch);
+            result_batch_free(state->batch);
+            ring_free(&state->full);
+            ring_free(&state->spare);
+        }
     }
-    for (i=0; i<reqs.count; i++) {
-        free(reqs.reqs[i].url);
-        if (reqs.reqs[i].payload_length)
-            free(reqs.reqs[i].payload);
+    stats_free(&summary);
+    placement_free(&pl);
+    if (opts.profile != NULL) {
+        for (i=0; i<opts.profile->count; i++)
+            stats_free(&stage_stats[i]);
+        free(stage_stats);
+        profile_free(opts.profile);
+        free(opts.profile);
     }
-    free(reqs.reqs);
+    if (mixing)
+        mix_free(&weighted);
+    endpoints_free(&eps);
+    if (opts.engine == ENGINE_RAW)
+        raw_free(&raw);
+    if (opts.stream)
+        stream_close(&urls);
+    free_requests(reqs);
+    share_free();
+    curl_global_cleanup();
 
     return 0;
 }
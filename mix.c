@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mix.h"
+
+/**
+ * Return 1 if any of the requests has a weight other than 1.
+ */
+int mix_weighted(requests reqs)
+{
+    unsigned long i;
+
+    for (i=0; i<reqs.count; i++)
+        if (reqs.reqs[i].weight != 1.0)
+            return 1;
+    return 0;
+}
+
+/**
+ * Set column i to keep itself with probability p, else go to `alias`.
+ */
+static void set_column(mix* m, unsigned long i, double p, unsigned long alias)
+{
+    m->threshold[i] = (p >= 1.0 ? UINT64_MAX : (uint64_t)(p * 18446744073709551616.0));
+    m->alias[i] = alias;
+}
+
+/**
+ * Build the table for reqs. Return 1 on error (including weights
+ * which sum to zero) or 0 on success.
+ */
+int mix_init(mix* m, requests reqs)
+{
+    unsigned long i, s, l, num_small = 0, num_large = 0;
+    unsigned long* small;
+    unsigned long* large;
+    double* scaled;
+    double total = 0;
+
+    for (i=0; i<reqs.count; i++)
+        total += reqs.reqs[i].weight;
+    if (total <= 0) {
+        fprintf(stderr, "Request weights must not all be zero\n");
+        return 1;
+    }
+
+    m->count = reqs.count;
+    m->threshold = malloc(reqs.count * sizeof(uint64_t));
+    m->alias = malloc(reqs.count * sizeof(uint32_t));
+    scaled = malloc(reqs.count * sizeof(double));
+    small = malloc(reqs.count * sizeof(unsigned long));
+    large = malloc(reqs.count * sizeof(unsigned long));
+    if (!m->threshold || !m->alias || !scaled || !small || !large) {
+        fprintf(stderr, "Could not allocate request mix\n");
+        exit(2);
+    }
+
+    // Vose's method: scale the weights to average 1, then pair each
+    // column under 1 with one over it, which tops it up
+    for (i=0; i<reqs.count; i++) {
+        scaled[i] = reqs.reqs[i].weight * reqs.count / total;
+        if (scaled[i] < 1.0)
+            small[num_small++] = i;
+        else
+            large[num_large++] = i;
+    }
+
+    while (num_small > 0 && num_large > 0) {
+        s = small[--num_small];
+        l = large[--num_large];
+        set_column(m, s, scaled[s], l);
+        scaled[l] -= 1.0 - scaled[s];
+        if (scaled[l] < 1.0)
+            small[num_small++] = l;
+        else
+            large[num_large++] = l;
+    }
+
+    // whatever is left is 1, give or take rounding
+    while (num_large > 0) {
+        l = large[--num_large];
+        set_column(m, l, 1.0, l);
+    }
+    while (num_small > 0) {
+        s = small[--num_small];
+        set_column(m, s, 1.0, s);
+    }
+
+    free(scaled);
+    free(small);
+    free(large);
+    return 0;
+}
+
+void mix_free(mix* m)
+{
+    free(m->threshold);
+    free(m->alias);
+}
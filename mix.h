@@ -0,0 +1,42 @@
+#ifndef WIDELOAD_MIX_H
+#define WIDELOAD_MIX_H
+
+#include <stdint.h>
+
+#include "loader.h"
+#include "rng.h"
+
+/**
+ * A Walker alias table over the requests' weights, which picks a
+ * request in proportion to its weight in constant time: choose a
+ * column uniformly, then either its own request or its alias.
+ */
+typedef struct _mix {
+    unsigned long count;
+    uint64_t*     threshold;  /* keep column i if the next 64 bits are below this */
+    uint32_t*     alias;
+} mix;
+
+/**
+ * Build the table for reqs. Return 1 on error (including weights
+ * which sum to zero) or 0 on success.
+ */
+int mix_init(mix* m, requests reqs);
+
+void mix_free(mix* m);
+
+/**
+ * Return 1 if any of the requests has a weight other than 1.
+ */
+int mix_weighted(requests reqs);
+
+/**
+ * Pick the index of a request, in proportion to the weights.
+ */
+static inline unsigned long mix_sample(const mix* m, rng* r)
+{
+    unsigned long i = rng_below(r, m->count);
+    return (rng_next(r) < m->threshold[i] ? i : m->alias[i]);
+}
+
+#endif
@@ -0,0 +1,420 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/epoll.h>
+
+#include <curl/curl.h>
+
+#include "main.h"
+#include "loader.h"
+#include "multi.h"
+#include "stream.h"
+#include "overhead.h"
+#include "template.h"
+
+#define MAX_EVENTS 256
+
+typedef struct {
+    CURL*         handle;
+    result        rslt;
+    unsigned long next;   /* index of the next request to make */
+    unsigned long made;   /* requests made so far */
+    unsigned long index;  /* run-wide connection number */
+    char          busy;
+    char          fresh;  /* force a new connection for the next request */
+    expansion     exp;    /* what the transfer sends, if its request is templated */
+} connection;
+
+typedef struct {
+    int           epfd;
+    CURLM*        multi;
+    unsigned long deadline;  /* when libcurl wants a timeout action, or 0 */
+} eventloop;
+
+/**
+ * Called by libcurl to tell us which events to wait for on a socket.
+ */
+static int on_socket(CURL* easy, curl_socket_t s, int what, void* userp, void* socketp)
+{
+    eventloop* loop = (eventloop*)userp;
+    struct epoll_event ev;
+
+    if (what == CURL_POLL_REMOVE) {
+        epoll_ctl(loop->epfd, EPOLL_CTL_DEL, s, NULL);
+        return 0;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.data.fd = s;
+    if (what & CURL_POLL_IN)
+        ev.events |= EPOLLIN;
+    if (what & CURL_POLL_OUT)
+        ev.events |= EPOLLOUT;
+
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_MOD, s, &ev) != 0 && errno == ENOENT)
+        epoll_ctl(loop->epfd, EPOLL_CTL_ADD, s, &ev);
+
+    return 0;
+}
+
+/**
+ * Called by libcurl to (re)schedule its single timeout.
+ */
+static int on_timer(CURLM* multi, long timeout_ms, void* userp)
+{
+    eventloop* loop = (eventloop*)userp;
+
+    if (timeout_ms < 0)
+        loop->deadline = 0;
+    else
+        loop->deadline = nanos() + 1000000UL * timeout_ms;
+
+    return 0;
+}
+
+/**
+ * Begin the connection's next request.
+ */
+static void start_request(eventloop* loop, connection* conn, threadstate* state)
+{
+    request* req = next_request(state, &conn->next);
+
+    prepare_request(conn->handle, &conn->rslt, req, &conn->exp, &state->opts);
+    curl_easy_setopt(conn->handle, CURLOPT_PRIVATE, conn);
+    curl_easy_setopt(conn->handle, CURLOPT_FRESH_CONNECT, conn->fresh ? 1L : 0L);
+    curl_easy_setopt(conn->handle, CURLOPT_FORBID_REUSE, 0L);
+    conn->fresh = 0;
+
+    conn->busy = 1;
+    conn->made++;
+    conn->rslt.time_start = nanos();
+    curl_multi_add_handle(loop->multi, conn->handle);
+}
+
+/**
+ * Record the outcome of a finished transfer. If necessary,
+ * reconnect (e.g. if the request timed out).
+ */
+static void finish_request(eventloop* loop, connection* conn, threadstate* state, CURLcode code)
+{
+    conn->rslt.time_end = nanos();
+    collect_timings(conn->handle, &conn->rslt);
+    curl_multi_remove_handle(loop->multi, conn->handle);
+    conn->busy = 0;
+
+    if (code != CURLE_OK && state->opts.http == HTTP_1_1) {
+        // As with the easy engine, don't trust the connection after
+        // a timeout: replace the handle and insist on a fresh one
+        curl_easy_cleanup(conn->handle);
+        conn->handle = setup(state->opts);
+        conn->fresh = 1;
+    }
+    if (code != CURLE_OK)
+        conn->rslt.status = 598;
+    if (result_keeps_url(state, conn->rslt.req)) {
+        conn->rslt.url = conn->exp.req.url;
+        conn->rslt.url_length = strlen(conn->exp.req.url);
+    }
+
+    record_result(state, &conn->rslt);
+}
+
+static int compare_ids(const void* a, const void* b)
+{
+    curl_off_t x = *(const curl_off_t*)a, y = *(const curl_off_t*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Record how many streams are in flight on each of the loop's
+ * connections, using `ids` (room for a connection id per handle).
+ * Transfers started since `since` aren't counted, as libcurl has
+ * yet to take them up.
+ */
+static void sample_streams(connection* conns, unsigned long count, unsigned long since, curl_off_t* ids, histogram* h)
+{
+#if LIBCURL_VERSION_NUM >= 0x080200
+    unsigned long i, j, n = 0;
+    curl_off_t id, sent;
+
+    // a transfer waiting for a stream reports the connection it
+    // last used, so only count those whose request has been sent
+    for (i=0; i<count; i++) {
+        if (!conns[i].busy || conns[i].rslt.time_start >= since)
+            continue;
+        if (curl_easy_getinfo(conns[i].handle, CURLINFO_PRETRANSFER_TIME_T, &sent) != CURLE_OK || sent == 0)
+            continue;
+        if (curl_easy_getinfo(conns[i].handle, CURLINFO_CONN_ID, &id) == CURLE_OK && id >= 0)
+            ids[n++] = id;
+    }
+    qsort(ids, n, sizeof(curl_off_t), compare_ids);
+    for (i=0; i<n; i=j) {
+        for (j=i; j<n && ids[j] == ids[i]; j++)
+            ;
+        hist_record(h, j - i);
+    }
+#endif
+}
+
+/**
+ * Find the transfers in flight on the same connection as `conn`'s
+ * last, which has just timed out, and leave them in `dropped`,
+ * marked so that libcurl closes the connection once they've all
+ * been removed. Return how many were found.
+ */
+static unsigned long drop_connection(connection* conns, unsigned long count, connection* conn, connection** dropped)
+{
+    unsigned long i, n = 0;
+#if LIBCURL_VERSION_NUM >= 0x080200
+    curl_off_t id, other, sent;
+
+    if (curl_easy_getinfo(conn->handle, CURLINFO_CONN_ID, &id) != CURLE_OK || id < 0)
+        return 0;
+    for (i=0; i<count; i++) {
+        if (!conns[i].busy || &conns[i] == conn)
+            continue;
+        if (curl_easy_getinfo(conns[i].handle, CURLINFO_PRETRANSFER_TIME_T, &sent) != CURLE_OK || sent == 0)
+            continue;
+        if (curl_easy_getinfo(conns[i].handle, CURLINFO_CONN_ID, &other) == CURLE_OK && other == id) {
+            curl_easy_setopt(conns[i].handle, CURLOPT_FORBID_REUSE, 1L);
+            dropped[n++] = &conns[i];
+        }
+    }
+#endif
+    return n;
+}
+
+/**
+ * Event loop thread entry point; drives state->conn_count
+ * connections with a single curl_multi handle.
+ */
+void* multi_thread(void* st)
+{
+    threadstate* state = (threadstate*)st;
+    options opts = state->opts;
+    struct epoll_event events[MAX_EVENTS];
+    eventloop loop;
+    connection* conns;
+    connection** idle;
+    connection** dropped = NULL;
+    connection* conn;
+    CURLcode code;
+    CURLMsg* msg;
+    unsigned long i, now, due, end_time = 0;
+    unsigned long busy = 0, num_idle = 0, num_dropped = 0, made = 0;
+    unsigned long quota = opts.run_requests * state->conn_count;
+    unsigned long pending = 0, next_sample = 0, asleep, waited = 0;
+    curl_off_t* ids = NULL;
+    char scheduling = (state->sched != NULL);
+    char parking = (!scheduling && opts.profile != NULL);
+    int running, n, j, flags, wait;
+
+    overhead_begin(state);
+    loop.deadline = 0;
+    loop.epfd = epoll_create1(0);
+    loop.multi = curl_multi_init();
+    if (loop.epfd < 0 || loop.multi == NULL) {
+        perror("event loop error");
+        exit(2);
+    }
+
+    curl_multi_setopt(loop.multi, CURLMOPT_SOCKETFUNCTION, on_socket);
+    curl_multi_setopt(loop.multi, CURLMOPT_SOCKETDATA, &loop);
+    curl_multi_setopt(loop.multi, CURLMOPT_TIMERFUNCTION, on_timer);
+    curl_multi_setopt(loop.multi, CURLMOPT_TIMERDATA, &loop);
+    // keep every connection's keep-alive socket in the cache
+    curl_multi_setopt(loop.multi, CURLMOPT_MAXCONNECTS, (long)state->conn_count);
+    if (opts.http != HTTP_1_1) {
+        // with HTTP/2, the loop's requests share as few connections
+        // as --streams allows
+        curl_multi_setopt(loop.multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+        curl_multi_setopt(loop.multi, CURLMOPT_MAX_CONCURRENT_STREAMS, (long)opts.streams);
+        curl_multi_setopt(loop.multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)((state->conn_count + opts.streams - 1) / opts.streams));
+        ids = malloc(state->conn_count * sizeof(curl_off_t));
+        dropped = malloc(state->conn_count * sizeof(connection*));
+    }
+
+    conns = calloc(state->conn_count, sizeof(connection));
+    idle = malloc(state->conn_count * sizeof(connection*));
+    for (i=0; i<state->conn_count; i++) {
+        conns[i].handle = setup(opts);
+        conns[i].index = state->conn_first + i * state->conn_stride;
+        expansion_init(&conns[i].exp, &state->rng);
+        if (opts.randomize)
+            conns[i].next = rng_below(&state->rng, state->req_count);
+    }
+
+    if (opts.profile != NULL)
+        end_time = opts.profile->start + opts.profile->length;
+    else if (opts.run_seconds)
+        end_time = nanos() + (1000000000UL * opts.run_seconds);
+
+    if (scheduling || parking) {
+        // open-loop: connections wait idle for their next slot;
+        // profiled: they wait until the profile calls for them
+        for (i=0; i<state->conn_count; i++)
+            idle[num_idle++] = &conns[i];
+    } else {
+        for (i=0; i<state->conn_count; i++) {
+            start_request(&loop, &conns[i], state);
+            conns[i].rslt.time_intended = conns[i].rslt.time_start;
+            busy++;
+        }
+    }
+
+    while (busy > 0 || scheduling || parking) {
+        now = nanos();
+
+        // start any parked connections the profile now calls for
+        if (parking) {
+            if (now >= end_time || __atomic_load_n(&stopping, __ATOMIC_RELAXED)) {
+                parking = 0;
+            } else {
+                for (i=0; i<num_idle; ) {
+                    conn = idle[i];
+                    if (!conn_active(state, conn->index, now)) {
+                        i++;
+                        continue;
+                    }
+                    idle[i] = idle[--num_idle];
+                    start_request(&loop, conn, state);
+                    conn->rslt.time_intended = conn->rslt.time_start;
+                    busy++;
+                }
+            }
+        }
+
+        // hand every due slot in the schedule to an idle connection;
+        // if none is idle, the slot waits, and its latency counts
+        // from when it was due
+        while (scheduling && num_idle > 0) {
+            if (pending == 0) {
+                if ((opts.run_requests ? made >= quota : schedule_peek(state->sched) >= end_time) || __atomic_load_n(&stopping, __ATOMIC_RELAXED)) {
+                    scheduling = 0;
+                    break;
+                }
+                if (schedule_peek(state->sched) > now)
+                    break;
+                pending = schedule_claim(state->sched, &state->rng);
+                if (end_time && pending >= end_time) {
+                    pending = 0;
+                    scheduling = 0;
+                    break;
+                }
+            }
+            if (pending > now)
+                break;
+
+            conn = idle[--num_idle];
+            start_request(&loop, conn, state);
+            conn->rslt.time_intended = pending;
+            pending = 0;
+            made++;
+            busy++;
+        }
+
+        if (busy == 0 && !scheduling && !parking)
+            break;
+
+        wait = -1;
+        if (loop.deadline != 0)
+            wait = (loop.deadline > now ? (loop.deadline - now + 999999) / 1000000 : 0);
+        if (scheduling && num_idle > 0) {
+            due = (pending != 0 ? pending : schedule_peek(state->sched));
+            due = (due > now ? (due - now + 999999) / 1000000 : 0);
+            if (wait < 0 || (int)due < wait)
+                wait = (int)due;
+        }
+        if (parking && num_idle > 0 && (wait < 0 || wait > (int)(PARKED_POLL / 1000000)))
+            wait = PARKED_POLL / 1000000;
+        if (ids != NULL && busy > 0 && (wait < 0 || wait > (int)(STREAMS_SAMPLE / 1000000)))
+            wait = STREAMS_SAMPLE / 1000000;
+
+        asleep = nanos();
+        n = epoll_wait(loop.epfd, events, MAX_EVENTS, wait);
+        waited += nanos() - asleep;
+        if (n < 0 && errno != EINTR) {
+            perror("epoll_wait");
+            exit(2);
+        }
+
+        for (j=0; j<n; j++) {
+            flags = 0;
+            if (events[j].events & EPOLLIN)
+                flags |= CURL_CSELECT_IN;
+            if (events[j].events & EPOLLOUT)
+                flags |= CURL_CSELECT_OUT;
+            if (events[j].events & (EPOLLERR | EPOLLHUP))
+                flags |= CURL_CSELECT_ERR;
+            curl_multi_socket_action(loop.multi, events[j].data.fd, flags, &running);
+        }
+
+        // under load there may always be socket activity, so check
+        // the timer whether or not epoll_wait() timed out
+        if (loop.deadline != 0 && nanos() >= loop.deadline) {
+            loop.deadline = 0;
+            curl_multi_socket_action(loop.multi, CURL_SOCKET_TIMEOUT, 0, &running);
+        }
+
+        now = nanos();
+
+        while (num_dropped > 0 || (msg = curl_multi_info_read(loop.multi, &n)) != NULL) {
+            if (num_dropped > 0) {
+                conn = dropped[--num_dropped];
+                code = CURLE_RECV_ERROR;
+            } else if (msg->msg == CURLMSG_DONE) {
+                curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**)&conn);
+                code = msg->data.result;
+            } else {
+                continue;
+            }
+
+            // a timed-out HTTP/2 stream has been reset, leaving the
+            // connection to its other streams; with --close-on-timeout
+            // they fail too, as if the client had hung up
+            if (code == CURLE_OPERATION_TIMEDOUT && opts.close_on_timeout)
+                num_dropped = drop_connection(conns, state->conn_count, conn, dropped);
+
+            finish_request(&loop, conn, state, code);
+            busy--;
+
+            if (state->sched != NULL) {
+                idle[num_idle++] = conn;
+            } else if ((opts.run_requests ? conn->made < opts.run_requests : nanos() < end_time) && !__atomic_load_n(&stopping, __ATOMIC_RELAXED)) {
+                if (parking && !conn_active(state, conn->index, nanos())) {
+                    idle[num_idle++] = conn;
+                    continue;
+                }
+                start_request(&loop, conn, state);
+                conn->rslt.time_intended = conn->rslt.time_start;
+                busy++;
+            }
+        }
+
+        if (ids != NULL && now >= next_sample) {
+            sample_streams(conns, state->conn_count, now, ids, &state->streams);
+            next_sample = now + STREAMS_SAMPLE;
+        }
+    }
+
+    for (i=0; i<state->conn_count; i++) {
+        curl_easy_cleanup(conns[i].handle);
+        expansion_free(&conns[i].exp);
+    }
+    free(conns);
+    free(idle);
+    free(ids);
+    free(dropped);
+    curl_multi_cleanup(loop.multi);
+    close(loop.epfd);
+    overhead_end(state, waited);
+
+    state->last_cpu = sched_getcpu();
+    stream_drop(&state->chunk);
+    flush_results(state);
+
+    return NULL;
+}
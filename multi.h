@@ -0,0 +1,12 @@
+#ifndef WIDELOAD_MULTI_H
+#define WIDELOAD_MULTI_H
+
+#include "loader.h"
+
+/**
+ * Event loop thread entry point; drives state->conn_count
+ * connections with a single curl_multi handle.
+ */
+void* multi_thread(void* arg);
+
+#endif
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+#include <sys/resource.h>
+
+#include "overhead.h"
+
+/**
+ * Set up the state's accounting. Return 1 on error or 0 on success.
+ */
+int overhead_init(threadstate* state)
+{
+    // lateness only means anything against a schedule
+    if (state->sched != NULL)
+        return hist_init(&state->lateness, LATENCY_HIGHEST, PHASE_SIGFIGS);
+    return 0;
+}
+
+void overhead_free(threadstate* state)
+{
+    if (state->sched != NULL)
+        hist_free(&state->lateness);
+}
+
+/**
+ * Note that the calling worker thread has started.
+ */
+void overhead_begin(threadstate* state)
+{
+    state->time_begun = nanos();
+}
+
+/**
+ * Note that the calling worker thread has finished, having spent
+ * `waited` nanos blocked on the network (or, for the easy engine,
+ * in libcurl's transfers).
+ */
+void overhead_end(threadstate* state, unsigned long waited)
+{
+    struct rusage usage;
+
+    state->time_ended = nanos();
+    state->busy = (state->time_ended - state->time_begun > waited ? state->time_ended - state->time_begun - waited : 0);
+
+    // only the thread itself can ask for its own CPU time
+    if (getrusage(RUSAGE_THREAD, &usage) == 0)
+        state->cpu_time = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000UL +
+                          (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000UL;
+}
+
+/**
+ * Print what the workers cost, and a warning if the generator
+ * was saturated.
+ */
+void overhead_print(const options* opts, const threadstate* states, unsigned long nthreads)
+{
+    unsigned long i, run, begun = (unsigned long)-1, ended = 0;
+    unsigned long cpu = 0, requests = 0, late = 0;
+    double share, cpu_max = 0, busy_mean = 0, busy_max = 0, process;
+    const char* busy_name = (opts->engine != ENGINE_EASY ? "event loop busy" : "outside libcurl");
+    cpu_set_t allowed;
+    histogram lateness;
+    int ncpus = 1;
+
+    for (i=0; i<nthreads; i++) {
+        const threadstate* state = &states[i];
+        run = state->time_ended - state->time_begun;
+        if (state->time_ended == 0 || run == 0)
+            continue;
+        if (state->time_begun < begun)
+            begun = state->time_begun;
+        if (state->time_ended > ended)
+            ended = state->time_ended;
+
+        cpu += state->cpu_time;
+        requests += state->stats.requests;
+        late += state->stats.late;
+        if ((share = (double)state->cpu_time / run) > cpu_max)
+            cpu_max = share;
+        share = (double)state->busy / run;
+        busy_mean += share / nthreads;
+        if (share > busy_max)
+            busy_max = share;
+    }
+    if (ended <= begun)
+        return;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+        ncpus = CPU_COUNT(&allowed);
+    process = (double)cpu / ((double)(ended - begun) * ncpus);
+
+    printf("Generator overhead (%% of run)   mean      max\n");
+    printf(" %-25s %9.1f %8.1f\n", "worker cpu", 100.0 * cpu / (ended - begun) / nthreads, 100.0 * cpu_max);
+    printf(" %-25s %9.1f %8.1f\n", busy_name, 100.0 * busy_mean, 100.0 * busy_max);
+    printf("Workers' CPU: %.1f%% of %d CPU%s, %.1f us per request\n",
+           100.0 * process, ncpus, ncpus == 1 ? "" : "s",
+           requests ? cpu / 1000.0 / requests : 0.0);
+
+    if (states[0].sched != NULL && hist_init(&lateness, LATENCY_HIGHEST, PHASE_SIGFIGS) == 0) {
+        for (i=0; i<nthreads; i++)
+            hist_merge(&lateness, &states[i].lateness);
+        printf("Start lateness (ms): p50 %.3f  p99 %.3f  max %.3f\n",
+               hist_percentile(&lateness, 50) / 1000.0,
+               hist_percentile(&lateness, 99) / 1000.0,
+               lateness.max / 1000.0);
+        hist_free(&lateness);
+    }
+    printf("\n");
+
+    // a saturated worker delays the requests it should be timing,
+    // and that delay is indistinguishable from a slow target
+    if (busy_max < SATURATED_SHARE && cpu_max < SATURATED_SHARE && process < SATURATED_SHARE)
+        return;
+    printf("WARNING: wideload itself was the bottleneck, not the target: ");
+    if (process >= SATURATED_SHARE)
+        printf("its workers used %.0f%% of the %d CPU%s available", 100.0 * process, ncpus, ncpus == 1 ? "" : "s");
+    else if (opts->engine != ENGINE_EASY && busy_max >= SATURATED_SHARE)
+        printf("an event loop was busy for %.0f%% of the run", 100.0 * busy_max);
+    else
+        printf("a worker kept a CPU %.0f%% busy", 100.0 * cpu_max);
+    if (late > 0)
+        printf(", and %lu requests started more than 1ms late", late);
+    printf(".\nLatencies include time spent waiting on wideload; %s\n\n",
+           opts->engine != ENGINE_EASY ?
+           "spread the load over more event loops (--threads), CPUs or agents (--coordinator)." :
+           "try the multi engine, or spread the load over more CPUs or agents (--coordinator).");
+}
@@ -0,0 +1,43 @@
+#ifndef WIDELOAD_OVERHEAD_H
+#define WIDELOAD_OVERHEAD_H
+
+#include "loader.h"
+
+/*
+ * Each worker keeps account of its own cost: its CPU time, and the
+ * time it spent outside libcurl's transfers (the easy engine) or
+ * outside epoll_wait() (the multi engine), when it isn't waiting on
+ * the network. With a rate, it also records how late each request
+ * started. From these the summary tells whether wideload itself,
+ * rather than the target, held the results back.
+ */
+
+/* a thread or process busy for this share of the run was saturated */
+#define SATURATED_SHARE 0.9
+
+/**
+ * Set up the state's accounting. Return 1 on error or 0 on success.
+ */
+int overhead_init(threadstate* state);
+
+void overhead_free(threadstate* state);
+
+/**
+ * Note that the calling worker thread has started.
+ */
+void overhead_begin(threadstate* state);
+
+/**
+ * Note that the calling worker thread has finished, having spent
+ * `waited` nanos blocked on the network (or, for the easy engine,
+ * in libcurl's transfers).
+ */
+void overhead_end(threadstate* state, unsigned long waited);
+
+/**
+ * Print what the workers cost, and a warning if the generator
+ * was saturated.
+ */
+void overhead_print(const options* opts, const threadstate* states, unsigned long nthreads);
+
+#endif
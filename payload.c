@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "payload.h"
+
+/* every mapped payload file; streaming workers parse concurrently */
+static payload_file* mapped = NULL;
+static pthread_mutex_t mapped_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Map the file at `path`, or take another reference to it if it
+ * is already mapped. Return NULL on error.
+ */
+payload_file* payload_open(const char* path)
+{
+    payload_file* pf;
+    struct stat st;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return NULL;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&mapped_lock);
+
+    // files are known by inode, so different spellings of
+    // the same path still share one mapping
+    for (pf=mapped; pf!=NULL; pf=pf->next) {
+        if (pf->dev == st.st_dev && pf->ino == st.st_ino) {
+            pf->refs++;
+            pthread_mutex_unlock(&mapped_lock);
+            close(fd);
+            return pf;
+        }
+    }
+
+    if (!(pf = malloc(sizeof(payload_file))))
+        goto payload_open_error;
+    pf->dev = st.st_dev;
+    pf->ino = st.st_ino;
+    pf->length = st.st_size;
+    pf->refs = 1;
+
+    if (pf->length == 0) {
+        // mmap() can't map nothing
+        pf->data = "";
+    } else {
+        pf->data = mmap(NULL, pf->length, PROT_READ, MAP_SHARED, fd, 0);
+        if (pf->data == MAP_FAILED) {
+            free(pf);
+            goto payload_open_error;
+        }
+    }
+
+    pf->next = mapped;
+    mapped = pf;
+    pthread_mutex_unlock(&mapped_lock);
+    close(fd);
+    return pf;
+
+payload_open_error:
+    pthread_mutex_unlock(&mapped_lock);
+    close(fd);
+    return NULL;
+}
+
+/**
+ * Drop a reference to a payload file, unmapping it with the last.
+ */
+void payload_close(payload_file* pf)
+{
+    payload_file** link;
+
+    pthread_mutex_lock(&mapped_lock);
+    if (--pf->refs > 0) {
+        pthread_mutex_unlock(&mapped_lock);
+        return;
+    }
+    for (link=&mapped; *link!=pf; link=&(*link)->next)
+        ;
+    *link = pf->next;
+    pthread_mutex_unlock(&mapped_lock);
+
+    if (pf->length > 0)
+        munmap(pf->data, pf->length);
+    free(pf);
+}
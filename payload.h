@@ -0,0 +1,30 @@
+#ifndef WIDELOAD_PAYLOAD_H
+#define WIDELOAD_PAYLOAD_H
+
+#include <sys/types.h>
+
+/**
+ * A payload file, memory-mapped read-only and shared by every
+ * request that names it, however many there are.
+ */
+typedef struct _payload_file {
+    dev_t         dev;
+    ino_t         ino;
+    char*         data;
+    unsigned long length;
+    unsigned long refs;
+    struct _payload_file* next;
+} payload_file;
+
+/**
+ * Map the file at `path`, or take another reference to it if it
+ * is already mapped. Return NULL on error.
+ */
+payload_file* payload_open(const char* path);
+
+/**
+ * Drop a reference to a payload file, unmapping it with the last.
+ */
+void payload_close(payload_file* pf);
+
+#endif
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "placement.h"
+
+/**
+ * Parse a CPU list like "0-3,8,10-11" into set. Return 1 on error
+ * or 0 on success.
+ */
+int parse_cpu_list(const char* list, cpu_set_t* set)
+{
+    const char* p = list;
+    char* end;
+    long first, last, cpu;
+
+    CPU_ZERO(set);
+    while (*p) {
+        first = strtol(p, &end, 10);
+        if (end == p || first < 0)
+            return 1;
+        last = first;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first)
+                return 1;
+        }
+        if (last >= CPU_SETSIZE)
+            return 1;
+        for (cpu=first; cpu<=last; cpu++)
+            CPU_SET(cpu, set);
+
+        if (*end == ',')
+            end++;
+        else if (*end != '\0')
+            return 1;
+        p = end;
+    }
+
+    return CPU_COUNT(set) == 0;
+}
+
+/**
+ * Plan placement from the --cpus and --reserve-cpus lists (either
+ * may be NULL). Return 1 on error or 0 on success.
+ */
+int placement_init(placement* pl, const char* cpus, const char* reserve)
+{
+    cpu_set_t workers;
+    int cpu;
+
+    pl->pinned = (cpus != NULL || reserve != NULL);
+    pl->reserved = (reserve != NULL);
+    pl->cpus = NULL;
+    pl->ncpus = 0;
+    CPU_ZERO(&pl->reserve);
+
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &pl->original) != 0) {
+        perror("sched_getaffinity");
+        return 1;
+    }
+    if (!pl->pinned)
+        return 0;
+
+    // only CPUs we're allowed to run on are any use
+    if (reserve != NULL) {
+        parse_cpu_list(reserve, &pl->reserve);
+        CPU_AND(&pl->reserve, &pl->reserve, &pl->original);
+        if (CPU_COUNT(&pl->reserve) == 0) {
+            fprintf(stderr, "None of --reserve-cpus %s are available\n", reserve);
+            return 1;
+        }
+    }
+    if (cpus != NULL) {
+        parse_cpu_list(cpus, &workers);
+        CPU_AND(&workers, &workers, &pl->original);
+        if (CPU_COUNT(&workers) == 0) {
+            fprintf(stderr, "None of --cpus %s are available\n", cpus);
+            return 1;
+        }
+    } else {
+        memcpy(&workers, &pl->original, sizeof(cpu_set_t));
+    }
+    for (cpu=0; cpu<CPU_SETSIZE; cpu++)
+        if (CPU_ISSET(cpu, &pl->reserve))
+            CPU_CLR(cpu, &workers);
+    if (CPU_COUNT(&workers) == 0) {
+        fprintf(stderr, "No CPUs are left for the workers\n");
+        return 1;
+    }
+
+    pl->cpus = malloc(CPU_COUNT(&workers) * sizeof(int));
+    for (cpu=0; cpu<CPU_SETSIZE; cpu++)
+        if (CPU_ISSET(cpu, &workers))
+            pl->cpus[pl->ncpus++] = cpu;
+
+    return 0;
+}
+
+void placement_free(placement* pl)
+{
+    free(pl->cpus);
+}
+
+/**
+ * Return the CPU worker i is pinned to, or -1 if it isn't.
+ */
+int placement_cpu(const placement* pl, unsigned long i)
+{
+    return (pl->pinned ? pl->cpus[i % pl->ncpus] : -1);
+}
+
+/**
+ * Set up attr so that worker i starts on its CPU.
+ */
+void placement_attr(const placement* pl, pthread_attr_t* attr, unsigned long i)
+{
+    cpu_set_t set;
+
+    if (!pl->pinned)
+        return;
+    CPU_ZERO(&set);
+    CPU_SET(placement_cpu(pl, i), &set);
+    pthread_attr_setaffinity_np(attr, sizeof(cpu_set_t), &set);
+}
+
+/**
+ * Move the calling thread onto worker i's CPU, so that memory it
+ * touches for the worker is local to it; placement_leave() moves
+ * it back.
+ */
+void placement_enter(const placement* pl, unsigned long i)
+{
+    cpu_set_t set;
+
+    if (!pl->pinned)
+        return;
+    CPU_ZERO(&set);
+    CPU_SET(placement_cpu(pl, i), &set);
+    // setting our own affinity migrates us before it returns
+    sched_setaffinity(0, sizeof(cpu_set_t), &set);
+}
+
+void placement_leave(const placement* pl)
+{
+    if (pl->pinned)
+        sched_setaffinity(0, sizeof(cpu_set_t), &pl->original);
+}
+
+/**
+ * Confine a writer or reporter thread to the reserved CPUs.
+ */
+void placement_reserve(const placement* pl, pthread_t thread)
+{
+    if (pl->reserved)
+        pthread_setaffinity_np(thread, sizeof(cpu_set_t), &pl->reserve);
+}
+
+/**
+ * Return the NUMA node of cpu, or -1 if unknown.
+ */
+int cpu_node(int cpu)
+{
+    char path[64];
+    DIR* dir;
+    struct dirent* entry;
+    int node = -1;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    if ((dir = opendir(path)) == NULL)
+        return -1;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9') {
+            node = atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+
+    return node;
+}
+
+/**
+ * Print where the workers ran.
+ */
+void placement_print(const placement* pl, const threadstate* states, unsigned long nthreads)
+{
+    unsigned long i, workers[CPU_SETSIZE];
+    int cpu;
+
+    memset(workers, 0, sizeof(workers));
+    for (i=0; i<nthreads; i++) {
+        cpu = (states[i].cpu >= 0 ? states[i].cpu : states[i].last_cpu);
+        if (cpu >= 0 && cpu < CPU_SETSIZE)
+            workers[cpu]++;
+    }
+
+    printf("Worker placement (%s)\n", pl->pinned ? "pinned" : "not pinned; where each last ran");
+    for (cpu=0; cpu<CPU_SETSIZE; cpu++)
+        if (workers[cpu] > 0)
+            printf(" cpu %3d (node %d): %lu thread%s\n", cpu, cpu_node(cpu), workers[cpu], workers[cpu] == 1 ? "" : "s");
+    if (pl->reserved) {
+        printf(" writer and reporter: cpu");
+        for (cpu=0; cpu<CPU_SETSIZE; cpu++)
+            if (CPU_ISSET(cpu, &pl->reserve))
+                printf(" %d", cpu);
+        printf("\n");
+    }
+    printf("\n");
+}
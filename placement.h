@@ -0,0 +1,75 @@
+#ifndef WIDELOAD_PLACEMENT_H
+#define WIDELOAD_PLACEMENT_H
+
+#include <sched.h>
+#include <pthread.h>
+
+#include "loader.h"
+
+/**
+ * Where the worker, writer and reporter threads may run.
+ *
+ * Workers are pinned one CPU each, in turn, from their list; the
+ * writer and reporter may float over the reserved CPUs, which the
+ * workers then stay off. Memory a worker uses on every request is
+ * first touched from the worker's own CPU, so that the kernel's
+ * first-touch policy puts it on that CPU's NUMA node.
+ */
+typedef struct {
+    char          pinned;    /* workers have CPUs of their own */
+    char          reserved;  /* writer and reporter have CPUs of their own */
+    int*          cpus;      /* the workers' CPUs, in the order they're used */
+    unsigned long ncpus;
+    cpu_set_t     reserve;
+    cpu_set_t     original;  /* the main thread's own affinity */
+} placement;
+
+/**
+ * Parse a CPU list like "0-3,8,10-11" into set. Return 1 on error
+ * or 0 on success.
+ */
+int parse_cpu_list(const char* list, cpu_set_t* set);
+
+/**
+ * Plan placement from the --cpus and --reserve-cpus lists (either
+ * may be NULL). Return 1 on error or 0 on success.
+ */
+int placement_init(placement* pl, const char* cpus, const char* reserve);
+
+void placement_free(placement* pl);
+
+/**
+ * Return the CPU worker i is pinned to, or -1 if it isn't.
+ */
+int placement_cpu(const placement* pl, unsigned long i);
+
+/**
+ * Set up attr so that worker i starts on its CPU.
+ */
+void placement_attr(const placement* pl, pthread_attr_t* attr, unsigned long i);
+
+/**
+ * Move the calling thread onto worker i's CPU, so that memory it
+ * touches for the worker is local to it; placement_leave() moves
+ * it back.
+ */
+void placement_enter(const placement* pl, unsigned long i);
+
+void placement_leave(const placement* pl);
+
+/**
+ * Confine a writer or reporter thread to the reserved CPUs.
+ */
+void placement_reserve(const placement* pl, pthread_t thread);
+
+/**
+ * Return the NUMA node of cpu, or -1 if unknown.
+ */
+int cpu_node(int cpu);
+
+/**
+ * Print where the workers ran.
+ */
+void placement_print(const placement* pl, const threadstate* states, unsigned long nthreads);
+
+#endif
@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <yaml.h>
+
+#include "profile.h"
+
+/**
+ * Append the stage, or if steps > 1, that many holds stepping
+ * evenly from `from` to `to`. Return 1 on error or 0 on success.
+ */
+static int add_stage(profile* p, double seconds, double from, double to, long steps)
+{
+    long k;
+    stage* grown;
+
+    if (seconds <= 0 || from < 0 || to < 0 || steps < 1) {
+        fprintf(stderr, "Profile stages need a positive duration, levels of at least 0 and at least 1 step\n");
+        return 1;
+    }
+    if (!(grown = realloc(p->stages, (p->count + steps) * sizeof(stage)))) {
+        fprintf(stderr, "Could not allocate profile\n");
+        return 1;
+    }
+    p->stages = grown;
+
+    if (steps == 1) {
+        p->stages[p->count].duration = (unsigned long)(seconds * 1e9);
+        p->stages[p->count].from = from;
+        p->stages[p->count].to = to;
+        p->length += p->stages[p->count++].duration;
+        return 0;
+    }
+    for (k=0; k<steps; k++) {
+        stage* st = &p->stages[p->count++];
+        st->duration = (unsigned long)(seconds / steps * 1e9);
+        st->from = st->to = from + (to - from) * k / (steps - 1);
+        p->length += st->duration;
+    }
+    return 0;
+}
+
+/**
+ * Parse a stage of the form SECONDS:FROM[-TO[/STEPS]].
+ * Return 1 on error or 0 on success.
+ */
+static int parse_stage(profile* p, const char* text)
+{
+    char* end;
+    double seconds, from, to;
+    long steps = 1;
+
+    seconds = strtod(text, &end);
+    if (end == text)
+        return 1;
+    if (*end == 's')
+        end++;
+    if (*end++ != ':')
+        return 1;
+
+    text = end;
+    from = to = strtod(text, &end);
+    if (end == text)
+        return 1;
+    if (*end == '-') {
+        text = end + 1;
+        to = strtod(text, &end);
+        if (end == text)
+            return 1;
+        if (*end == '/') {
+            text = end + 1;
+            steps = strtol(text, &end, 10);
+            if (end == text)
+                return 1;
+        }
+    }
+    if (*end != '\0')
+        return 1;
+
+    return add_stage(p, seconds, from, to, steps);
+}
+
+/**
+ * Return the numeric value of the scalar under `key` in a YAML
+ * mapping node, or `missing` if there is none.
+ */
+static double mapping_number(yaml_document_t* doc, yaml_node_t* map, const char* key, double missing)
+{
+    yaml_node_pair_t* pair;
+    yaml_node_t* k;
+    yaml_node_t* v;
+
+    for (pair=map->data.mapping.pairs.start; pair<map->data.mapping.pairs.top; pair++) {
+        k = yaml_document_get_node(doc, pair->key);
+        v = yaml_document_get_node(doc, pair->value);
+        if (k->type == YAML_SCALAR_NODE && v->type == YAML_SCALAR_NODE &&
+                strcmp((const char*)k->data.scalar.value, key) == 0)
+            return strtod((const char*)v->data.scalar.value, NULL);
+    }
+    return missing;
+}
+
+/**
+ * Parse a YAML list of stages from `filename`.
+ * Return 1 on error or 0 on success.
+ */
+static int parse_file(profile* p, const char* filename)
+{
+    FILE* in;
+    yaml_parser_t parser;
+    yaml_document_t doc;
+    yaml_node_t* root;
+    yaml_node_t* item;
+    yaml_node_item_t* it;
+    double level;
+    int err = 0;
+
+    if ((in = fopen(filename, "r")) == NULL) {
+        perror(filename);
+        return 1;
+    }
+    yaml_parser_initialize(&parser);
+    yaml_parser_set_input_file(&parser, in);
+    if (!yaml_parser_load(&parser, &doc)) {
+        fprintf(stderr, "%s: invalid YAML\n", filename);
+        yaml_parser_delete(&parser);
+        fclose(in);
+        return 1;
+    }
+
+    root = yaml_document_get_root_node(&doc);
+    if (root == NULL || root->type != YAML_SEQUENCE_NODE) {
+        fprintf(stderr, "%s: expected a list of stages\n", filename);
+        err = 1;
+    }
+    for (it=(err ? NULL : root->data.sequence.items.start); !err && it<root->data.sequence.items.top; it++) {
+        item = yaml_document_get_node(&doc, *it);
+        if (item->type != YAML_MAPPING_NODE) {
+            fprintf(stderr, "%s: each stage must be a mapping\n", filename);
+            err = 1;
+            break;
+        }
+        level = mapping_number(&doc, item, "level", -1);
+        err = add_stage(p,
+                        mapping_number(&doc, item, "duration", 0),
+                        mapping_number(&doc, item, "from", level),
+                        mapping_number(&doc, item, "to", mapping_number(&doc, item, "from", level)),
+                        (long)mapping_number(&doc, item, "steps", 1));
+    }
+
+    yaml_document_delete(&doc);
+    yaml_parser_delete(&parser);
+    fclose(in);
+    return err;
+}
+
+/**
+ * Parse a profile from a comma-separated list of stages, each
+ * SECONDS:LEVEL (hold), SECONDS:FROM-TO (linear ramp), or
+ * SECONDS:FROM-TO/STEPS (STEPS equal holds from FROM to TO); or,
+ * if spec is "@FILE", from a YAML list of stages with keys duration
+ * and either level or from/to (and optionally steps). Return 1 on
+ * error or 0 on success.
+ */
+int profile_parse(profile* p, const char* spec)
+{
+    char* copy;
+    char* rest;
+    char* text;
+    int err = 0;
+
+    p->count = 0;
+    p->stages = NULL;
+    p->length = 0;
+    p->start = 0;
+
+    if (spec[0] == '@') {
+        err = parse_file(p, spec + 1);
+    } else {
+        rest = copy = strdup(spec);
+        while (!err && (text = strsep(&rest, ",")) != NULL) {
+            if (parse_stage(p, text)) {
+                fprintf(stderr, "Invalid profile stage '%s' (expected SECONDS:LEVEL, SECONDS:FROM-TO or SECONDS:FROM-TO/STEPS)\n", text);
+                err = 1;
+            }
+        }
+        free(copy);
+    }
+
+    if (!err && p->count == 0) {
+        fprintf(stderr, "The profile has no stages\n");
+        err = 1;
+    }
+    if (!err && profile_max(p) <= 0) {
+        fprintf(stderr, "The profile never rises above 0\n");
+        err = 1;
+    }
+    return err;
+}
+
+void profile_free(profile* p)
+{
+    free(p->stages);
+}
+
+/**
+ * Return the level at monotonic time t, or 0 outside the profile.
+ */
+double profile_value(const profile* p, unsigned long t)
+{
+    unsigned long i, offset;
+
+    if (t < p->start)
+        return 0;
+    offset = t - p->start;
+
+    for (i=0; i<p->count; i++) {
+        const stage* st = &p->stages[i];
+        if (offset < st->duration)
+            return st->from + (st->to - st->from) * offset / st->duration;
+        offset -= st->duration;
+    }
+    return 0;
+}
+
+/**
+ * Return the level at monotonic time t, rounded to a whole number.
+ */
+unsigned long profile_level(const profile* p, unsigned long t)
+{
+    return (unsigned long)(profile_value(p, t) + 0.5);
+}
+
+/**
+ * Return the highest level anywhere in the profile.
+ */
+double profile_max(const profile* p)
+{
+    unsigned long i;
+    double max = 0;
+
+    for (i=0; i<p->count; i++) {
+        if (p->stages[i].from > max)
+            max = p->stages[i].from;
+        if (p->stages[i].to > max)
+            max = p->stages[i].to;
+    }
+    return max;
+}
+
+/**
+ * Return the monotonic time at which stage i ends.
+ */
+unsigned long profile_stage_end(const profile* p, unsigned long i)
+{
+    unsigned long j, end = p->start;
+
+    for (j=0; j<=i && j<p->count; j++)
+        end += p->stages[j].duration;
+    return end;
+}
@@ -0,0 +1,58 @@
+#ifndef WIDELOAD_PROFILE_H
+#define WIDELOAD_PROFILE_H
+
+/**
+ * One stage of a load profile: the level (connections, or requests
+ * per second) goes linearly from `from` to `to` over `duration`; a
+ * stage which holds steady has from == to.
+ */
+typedef struct {
+    unsigned long duration;  /* nanos */
+    double        from;
+    double        to;
+} stage;
+
+/**
+ * A load profile: stages run back to back from `start`, a monotonic
+ * time in nanos set when the test begins.
+ */
+typedef struct {
+    unsigned long count;
+    stage*        stages;
+    unsigned long length;  /* nanos, all stages together */
+    unsigned long start;
+} profile;
+
+/**
+ * Parse a profile from a comma-separated list of stages, each
+ * SECONDS:LEVEL (hold), SECONDS:FROM-TO (linear ramp), or
+ * SECONDS:FROM-TO/STEPS (STEPS equal holds from FROM to TO); or,
+ * if spec is "@FILE", from a YAML list of stages with keys duration
+ * and either level or from/to (and optionally steps). Return 1 on
+ * error or 0 on success.
+ */
+int profile_parse(profile* p, const char* spec);
+
+void profile_free(profile* p);
+
+/**
+ * Return the level at monotonic time t, or 0 outside the profile.
+ */
+double profile_value(const profile* p, unsigned long t);
+
+/**
+ * Return the level at monotonic time t, rounded to a whole number.
+ */
+unsigned long profile_level(const profile* p, unsigned long t);
+
+/**
+ * Return the highest level anywhere in the profile.
+ */
+double profile_max(const profile* p);
+
+/**
+ * Return the monotonic time at which stage i ends.
+ */
+unsigned long profile_stage_end(const profile* p, unsigned long i);
+
+#endif
@@ -0,0 +1,1266 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sched.h>
+#include <stdint.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "main.h"
+#include "loader.h"
+#include "raw.h"
+#include "uring.h"
+#include "overhead.h"
+#include "template.h"
+#include "hash.h"
+
+/* room for a response's head, and for as much of its body as one
+   receive brings in */
+#define RAW_BUFFER 16384
+
+/* the user_data of cancellations, whose own completions are ignored */
+#define CANCEL_TAG (~0ULL)
+
+/* the operations on a connection, kept in the low bits of their
+   user_data (a raw_conn is aligned to at least 8 bytes) */
+typedef enum {
+    OP_CONNECT = 1,
+    OP_SEND,
+    OP_RECV,
+    OP_SETTLE    /* a no-op, to settle a connection with nothing to cancel */
+} raw_op;
+
+#define OP_MASK 7
+
+typedef enum {
+    PARSE_HEAD,
+    PARSE_BODY,         /* `remaining` bytes of Content-Length to come */
+    PARSE_CHUNK_SIZE,
+    PARSE_CHUNK_DATA,   /* `remaining` bytes of the chunk to come */
+    PARSE_CHUNK_END,
+    PARSE_TRAILER,
+    PARSE_UNTIL_CLOSE,  /* no length given: the body ends with the connection */
+    PARSE_DONE
+} parse_state;
+
+/* why a connection is waiting for its operations to be cancelled */
+typedef enum {
+    DRAIN_NONE,
+    DRAIN_RETRY,  /* to send its requests again on a new connection */
+    DRAIN_ABORT   /* its requests have failed */
+} drain_reason;
+
+typedef struct {
+    raw_request*  rr;
+    result        rslt;
+
+    /* what's sent: the request's own head and payload, or, if it's
+       templated, its expansion into buf */
+    const char*   head;
+    unsigned long head_length;
+    const char*   payload;
+    unsigned long payload_length;
+    char*         buf;
+    unsigned long size;
+
+    unsigned long seq;        /* which of the connection's requests it is */
+    unsigned long deadline;   /* when it fails, with --fail-after */
+    char          retried;
+} raw_slot;
+
+typedef struct {
+    int           fd;
+    raw_target*   target;     /* what fd is connected to, or NULL */
+    unsigned long next;       /* index of the next request to make */
+    unsigned long made;       /* requests made so far */
+    unsigned long index;      /* run-wide connection number */
+
+    /* the requests in flight (up to --pipeline), in the order they
+       were made, from slots[first]: the first `sent` of them are
+       wholly sent, and `partial` bytes of the next */
+    raw_slot*     slots;
+    unsigned long depth;
+    unsigned long first;
+    unsigned long count;
+    unsigned long sent;
+    unsigned long partial;
+    unsigned long held;       /* slots of failed requests, free once drained */
+
+    unsigned char inflight;   /* a bit per raw_op in flight */
+    char          draining;
+    char          closing;    /* the server closes the connection after this response */
+    struct iovec* iov;
+    int           max_iov;
+    struct msghdr msg;
+
+    parse_state   parse;
+    unsigned long remaining;
+    unsigned long length;     /* bytes in buf */
+    char          buf[RAW_BUFFER];
+} raw_conn;
+
+/* the nth of the connection's requests in flight */
+#define SLOT(conn, n) (&(conn)->slots[((conn)->first + (n)) % (conn)->depth])
+
+/**
+ * The requests in flight with the same timeout, in the order they
+ * started, which is also the order they time out in. Entries for
+ * requests that have finished are skipped as they come up.
+ */
+typedef struct {
+    struct {
+        raw_conn*     conn;
+        unsigned long seq;
+        unsigned long deadline;
+    }*            items;
+    unsigned long size;
+    unsigned long head;
+    unsigned long count;
+} timeouts;
+
+/**
+ * Return 1 if `token` appears in s (up to end), ignoring case.
+ */
+static int has_token(const char* s, const char* end, const char* token)
+{
+    unsigned long n = strlen(token);
+
+    for (; s + n <= end; s++)
+        if (strncasecmp(s, token, n) == 0)
+            return 1;
+    return 0;
+}
+
+/**
+ * Return 1 if the request sets the named header itself.
+ */
+static int has_header(const request* req, const char* name)
+{
+    unsigned long i;
+
+    for (i=0; i<req->num_headers; i++)
+        if (strcasecmp(req->headers[i].name, name) == 0)
+            return 1;
+    return 0;
+}
+
+/**
+ * Return the target for the given host[:port], resolving it if
+ * it's new. Return NULL on error.
+ */
+static raw_target* find_target(raw_requests* raw, const char* authority, unsigned long length)
+{
+    struct addrinfo hints, *found;
+    raw_target* target;
+    char* host = NULL;
+    char* port = "80";
+    char* p;
+    unsigned long i, slot, mask;
+    int err;
+
+    // every request looks its target up, so find it by hash, keeping
+    // the table at most half full
+    if (raw->num_targets * 2 >= raw->target_table_size) {
+        free(raw->target_table);
+        raw->target_table_size = hash_table_size(raw->num_targets + 1);
+        if ((raw->target_table = calloc(raw->target_table_size, sizeof(unsigned long))) == NULL)
+            return NULL;
+        mask = raw->target_table_size - 1;
+        for (i=0; i<raw->num_targets; i++) {
+            slot = hash_string(HASH_START, raw->targets[i].authority) & mask;
+            while (raw->target_table[slot] != 0)
+                slot = (slot + 1) & mask;
+            raw->target_table[slot] = i + 1;
+        }
+    }
+    mask = raw->target_table_size - 1;
+    for (slot=hash_bytes(HASH_START, authority, length) & mask; raw->target_table[slot]!=0; slot=(slot + 1) & mask) {
+        target = &raw->targets[raw->target_table[slot] - 1];
+        if (strlen(target->authority) == length && strncmp(target->authority, authority, length) == 0)
+            return target;
+    }
+
+    target = &raw->targets[raw->num_targets];
+    if ((target->authority = strndup(authority, length)) == NULL || (host = strdup(target->authority)) == NULL)
+        goto find_target_error;
+    if (strchr(host, '@') != NULL) {
+        fprintf(stderr, "The raw engine doesn't send credentials in URLs: %s\n", host);
+        goto find_target_error;
+    }
+
+    // an IPv6 address is bracketed, and may be followed by a port
+    if (*host == '[' && (p = strchr(host, ']')) != NULL) {
+        *p = '\0';
+        if (p[1] == ':')
+            port = p + 2;
+        memmove(host, host + 1, strlen(host));
+    } else if ((p = strrchr(host, ':')) != NULL) {
+        *p = '\0';
+        port = p + 1;
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if ((err = getaddrinfo(host, port, &hints, &found)) != 0) {
+        fprintf(stderr, "Could not resolve %s: %s\n", target->authority, gai_strerror(err));
+        goto find_target_error;
+    }
+    memcpy(&target->addr, found->ai_addr, found->ai_addrlen);
+    target->addrlen = found->ai_addrlen;
+    freeaddrinfo(found);
+    free(host);
+
+    raw->target_table[slot] = ++raw->num_targets;
+    return target;
+
+find_target_error:
+    // it isn't counted among the targets, so raw_free() won't see it
+    free(target->authority);
+    target->authority = NULL;
+    free(host);
+    return NULL;
+}
+
+/**
+ * Write the request's head (everything before its payload) as
+ * libcurl would send it, or all but its Content-Length and the
+ * blank line after it if `open`. Return 1 on error or 0 on success.
+ */
+static int serialize(raw_request* rr, const request* req, const char* authority, unsigned long authority_length, const char* path, int open)
+{
+    unsigned long i, size;
+    FILE* out;
+
+    if ((out = open_memstream(&rr->head, &size)) == NULL)
+        return 1;
+
+    // the fragment stays with the client, and the path is never empty
+    fprintf(out, "%s %s%.*s HTTP/1.1\r\n",
+            req->method == HTTP_POST ? "POST" : "GET",
+            *path == '/' ? "" : "/",
+            (int)strcspn(path, "#"), path);
+
+    // as with libcurl, the request's own headers replace the
+    // defaults, and one with no value removes it
+    if (!has_header(req, "Host"))
+        fprintf(out, "Host: %.*s\r\n", (int)authority_length, authority);
+    if (!has_header(req, "User-Agent"))
+        fprintf(out, "User-Agent: wideload " VERSION " (raw)\r\n");
+    if (!has_header(req, "Accept"))
+        fprintf(out, "Accept: */*\r\n");
+    for (i=0; i<req->num_headers; i++)
+        if (req->headers[i].value[strspn(req->headers[i].value, " \t")] != '\0')
+            fprintf(out, "%s: %s\r\n", req->headers[i].name, req->headers[i].value);
+    if (req->method == HTTP_POST) {
+        if (!has_header(req, "Content-Type"))
+            fprintf(out, "Content-Type: application/x-www-form-urlencoded\r\n");
+        if (!open)
+            fprintf(out, "Content-Length: %lu\r\n", req->payload_length);
+    }
+    if (!open)
+        fprintf(out, "\r\n");
+
+    if (fclose(out) != 0)
+        return 1;
+    rr->head_length = size;
+    return 0;
+}
+
+/**
+ * Serialize every request for the raw engine, resolving their hosts.
+ * Only plain http:// URLs can be sent this way.
+ * Return 1 on error or 0 on success.
+ */
+int raw_prepare(raw_requests* raw, requests reqs, const options* opts)
+{
+    unsigned long i, k;
+    const char* authority;
+    const char* path;
+    template* host;
+    int open;
+
+    memset(raw, 0, sizeof(raw_requests));
+    raw->reqs = calloc(reqs.count, sizeof(raw_request));
+    raw->targets = calloc(reqs.count, sizeof(raw_target));
+    raw->lanes = calloc(reqs.count, sizeof(unsigned long));
+    if (raw->reqs == NULL || raw->targets == NULL || raw->lanes == NULL)
+        return 1;
+    raw->count = reqs.count;
+
+    for (i=0; i<reqs.count; i++) {
+        const request* req = &reqs.reqs[i];
+
+        if (strncasecmp(req->url, "http://", 7) != 0) {
+            fprintf(stderr, "The raw engine only speaks plain HTTP, not %s\n", req->url);
+            return 1;
+        }
+        authority = req->url + 7;
+        path = authority + strcspn(authority, "/?#");
+
+        // connections are made to targets resolved up front
+        if (template_compile(authority, path - authority, &host) != 0)
+            return 1;
+        if (host != NULL) {
+            template_free(host);
+            fprintf(stderr, "The raw engine can't template the host of %s\n", req->url);
+            return 1;
+        }
+
+        if ((raw->reqs[i].target = find_target(raw, authority, path - authority)) == NULL)
+            return 1;
+        open = (req->tmpl != NULL && req->tmpl->payload != NULL);
+        if (serialize(&raw->reqs[i], req, authority, path - authority, path, open) != 0) {
+            fprintf(stderr, "Could not serialize %s\n", req->url);
+            return 1;
+        }
+        if (req->tmpl != NULL) {
+            raw->reqs[i].templated = 1;
+            if (template_compile(raw->reqs[i].head, raw->reqs[i].head_length, &raw->reqs[i].head_template) != 0)
+                return 1;
+        }
+
+        raw->reqs[i].timeout = (req->timeout != 0 ? req->timeout : opts->fail_after);
+        if (raw->reqs[i].timeout != 0) {
+            for (k=0; k<raw->num_lanes && raw->lanes[k]!=raw->reqs[i].timeout; k++)
+                ;
+            if (k == raw->num_lanes)
+                raw->lanes[raw->num_lanes++] = raw->reqs[i].timeout;
+            raw->reqs[i].lane = k;
+        }
+    }
+
+    return 0;
+}
+
+void raw_free(raw_requests* raw)
+{
+    unsigned long i;
+
+    for (i=0; i<raw->count; i++) {
+        free(raw->reqs[i].head);
+        template_free(raw->reqs[i].head_template);
+    }
+    for (i=0; i<raw->num_targets; i++)
+        free(raw->targets[i].authority);
+    free(raw->reqs);
+    free(raw->targets);
+    free(raw->target_table);
+    free(raw->lanes);
+}
+
+/**
+ * Remember when the slot's request times out.
+ */
+static void timeouts_push(timeouts* t, raw_conn* conn, raw_slot* slot)
+{
+    unsigned long i, size;
+    void* grown;
+
+    if (t->count == t->size) {
+        size = (t->size ? 2 * t->size : 64);
+        if ((grown = malloc(size * sizeof(*t->items))) == NULL) {
+            perror("event loop error");
+            exit(2);
+        }
+        for (i=0; i<t->count; i++)
+            memcpy((char*)grown + i * sizeof(*t->items), &t->items[(t->head + i) % t->size], sizeof(*t->items));
+        free(t->items);
+        t->items = grown;
+        t->size = size;
+        t->head = 0;
+    }
+
+    i = (t->head + t->count++) % t->size;
+    t->items[i].conn = conn;
+    t->items[i].seq = slot->seq;
+    t->items[i].deadline = slot->deadline;
+}
+
+/**
+ * Return the connection whose request is the next in the lane to
+ * time out, and that request's seq and deadline, or NULL if none is
+ * in flight.
+ */
+static raw_conn* timeouts_peek(timeouts* t, unsigned long* seq, unsigned long* deadline)
+{
+    raw_conn* conn;
+
+    while (t->count > 0) {
+        conn = t->items[t->head].conn;
+        if (conn->count > 0 && t->items[t->head].seq >= SLOT(conn, 0)->seq) {
+            *seq = t->items[t->head].seq;
+            *deadline = t->items[t->head].deadline;
+            return conn;
+        }
+        t->head = (t->head + 1) % t->size;
+        t->count--;
+    }
+    return NULL;
+}
+
+/**
+ * As timeouts_peek(), for the next request in any of the lanes.
+ */
+static raw_conn* timeouts_next(timeouts* lanes, unsigned long num_lanes, unsigned long* seq, unsigned long* deadline)
+{
+    raw_conn* next = NULL;
+    raw_conn* conn;
+    unsigned long i, s, d;
+
+    for (i=0; i<num_lanes; i++) {
+        if ((conn = timeouts_peek(&lanes[i], &s, &d)) != NULL && (next == NULL || d < *deadline)) {
+            next = conn;
+            *seq = s;
+            *deadline = d;
+        }
+    }
+    return next;
+}
+
+/**
+ * Return a submission entry for the operation on the connection (or,
+ * with no connection, for a cancellation), or exit if the ring
+ * can't take one.
+ */
+static struct io_uring_sqe* submission(uring* ring, raw_conn* conn, raw_op op)
+{
+    struct io_uring_sqe* sqe = uring_sqe(ring);
+
+    if (sqe == NULL) {
+        perror("io_uring_enter");
+        exit(2);
+    }
+    if (conn == NULL) {
+        sqe->user_data = CANCEL_TAG;
+    } else {
+        sqe->user_data = (uintptr_t)conn | op;
+        conn->inflight |= (1 << op);
+    }
+    return sqe;
+}
+
+/**
+ * Close the connection's socket, if it's open.
+ */
+static void drop(raw_conn* conn)
+{
+    if (conn->fd >= 0)
+        close(conn->fd);
+    conn->fd = -1;
+    conn->target = NULL;
+}
+
+/**
+ * Open a new connection to the first request's target.
+ */
+static void submit_connect(uring* ring, raw_conn* conn)
+{
+    struct io_uring_sqe* sqe = submission(ring, conn, OP_CONNECT);
+    raw_target* target = SLOT(conn, 0)->rr->target;
+    int one = 1;
+
+    // a socket that can't be opened fails the request like one that
+    // can't connect, once the no-op completes
+    if ((conn->fd = socket(target->addr.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+        sqe->opcode = IORING_OP_NOP;
+        return;
+    }
+    // as libcurl does
+    setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    conn->target = target;
+
+    sqe->opcode = IORING_OP_CONNECT;
+    sqe->fd = conn->fd;
+    sqe->addr = (uintptr_t)&target->addr;
+    sqe->off = target->addrlen;
+}
+
+/**
+ * Send what's left of the requests not yet sent, each head followed
+ * by its payload, as far as the next for another target.
+ */
+static void submit_send(uring* ring, raw_conn* conn)
+{
+    struct io_uring_sqe* sqe;
+    unsigned long i, skip = conn->partial, now = nanos();
+    int n = 0;
+
+    for (i=conn->sent; i<conn->count && n + 2 <= conn->max_iov; i++, skip=0) {
+        raw_slot* slot = SLOT(conn, i);
+        if (slot->rr->target != conn->target)
+            break;
+        if (skip == 0)
+            slot->rslt.time_pretransfer = now - slot->rslt.time_start;
+
+        // the payload goes straight from where it was loaded
+        if (skip < slot->head_length) {
+            conn->iov[n].iov_base = (char*)slot->head + skip;
+            conn->iov[n++].iov_len = slot->head_length - skip;
+            skip = 0;
+        } else {
+            skip -= slot->head_length;
+        }
+        if (slot->payload_length > skip) {
+            conn->iov[n].iov_base = (char*)slot->payload + skip;
+            conn->iov[n++].iov_len = slot->payload_length - skip;
+        }
+    }
+
+    sqe = submission(ring, conn, OP_SEND);
+    sqe->fd = conn->fd;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    if (n == 1) {
+        sqe->opcode = IORING_OP_SEND;
+        sqe->addr = (uintptr_t)conn->iov[0].iov_base;
+        sqe->len = conn->iov[0].iov_len;
+        return;
+    }
+
+    memset(&conn->msg, 0, sizeof(conn->msg));
+    conn->msg.msg_iov = conn->iov;
+    conn->msg.msg_iovlen = n;
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->addr = (uintptr_t)&conn->msg;
+}
+
+/**
+ * Receive more of the responses, after what's already buffered.
+ */
+static void submit_recv(uring* ring, raw_conn* conn)
+{
+    struct io_uring_sqe* sqe = submission(ring, conn, OP_RECV);
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn->fd;
+    sqe->addr = (uintptr_t)(conn->buf + conn->length);
+    sqe->len = RAW_BUFFER - conn->length;
+}
+
+/**
+ * Submit whatever the connection's requests are ready for next: a
+ * connection, the sending of those not yet sent, or the receiving
+ * of the responses to those that have been.
+ */
+static void pump(uring* ring, raw_conn* conn)
+{
+    if (conn->draining || conn->count == 0)
+        return;
+
+    // a connection only carries requests to one target, so one for
+    // another waits for those before it to be answered
+    if (conn->fd >= 0 && conn->target != SLOT(conn, 0)->rr->target &&
+            conn->sent == 0 && conn->partial == 0 && conn->inflight == 0)
+        drop(conn);
+
+    if (conn->inflight & (1 << OP_CONNECT))
+        return;
+    if (conn->fd < 0) {
+        submit_connect(ring, conn);
+        return;
+    }
+    if (!(conn->inflight & (1 << OP_SEND)) && conn->sent < conn->count && SLOT(conn, conn->sent)->rr->target == conn->target)
+        submit_send(ring, conn);
+    if (!(conn->inflight & (1 << OP_RECV)) && conn->sent > 0)
+        submit_recv(ring, conn);
+}
+
+/**
+ * Expand the slot's templated request into its buffer: the payload
+ * first, so that the head can end with its length, then (if
+ * keep_url) the URL it's sent to, for its result.
+ */
+static void expand(raw_slot* slot, request* req, rng* r, char keep_url)
+{
+    raw_request* rr = slot->rr;
+    template_vars v;
+    unsigned long at = 0, head, url, path, path_length, authority;
+    char length[48];
+
+    template_draw(req->tmpl, &v, r);
+    if (req->tmpl->payload != NULL)
+        at = template_write(req->tmpl->payload, &v, r, &slot->buf, &slot->size, 0);
+    slot->payload_length = at;
+
+    head = at;
+    if (rr->head_template != NULL)
+        at = template_write(rr->head_template, &v, r, &slot->buf, &slot->size, at);
+    else
+        at = template_put(&slot->buf, &slot->size, at, rr->head, rr->head_length);
+    if (req->tmpl->payload != NULL)
+        at = template_put(&slot->buf, &slot->size, at, length,
+                          snprintf(length, sizeof(length), "Content-Length: %lu\r\n\r\n", slot->payload_length));
+    slot->head_length = at - head;
+
+    // the URL sent to is the path in the request line, at the target
+    // the template can't change; it goes after the request, so that
+    // recording it needs no allocation
+    if (keep_url) {
+        path = (const char*)memchr(slot->buf + head, ' ', slot->head_length) + 1 - slot->buf;
+        path_length = (const char*)memchr(slot->buf + path, ' ', head + slot->head_length - path) - (slot->buf + path);
+        authority = strlen(rr->target->authority);
+        url = at;
+        // reserved up front, as the path is copied from within buf
+        template_reserve(&slot->buf, &slot->size, at + 7 + authority + path_length);
+        at = template_put(&slot->buf, &slot->size, at, "http://", 7);
+        at = template_put(&slot->buf, &slot->size, at, rr->target->authority, authority);
+        memcpy(slot->buf + at, slot->buf + path, path_length);
+        at += path_length;
+        slot->rslt.url = slot->buf + url;
+        slot->rslt.url_length = at - url;
+    }
+
+    slot->head = slot->buf + head;
+    slot->payload = (req->tmpl->payload != NULL ? slot->buf : req->payload);
+    if (req->tmpl->payload == NULL)
+        slot->payload_length = req->payload_length;
+}
+
+/**
+ * Begin another request on the connection, behind any in flight
+ * (with --pipeline), and return its result.
+ */
+static result* start_request(uring* ring, raw_conn* conn, threadstate* state, timeouts* lanes)
+{
+    request* req = next_request(state, &conn->next);
+    raw_slot* slot = SLOT(conn, conn->count++);
+
+    memset(&slot->rslt, 0, sizeof(result));
+    slot->rslt.req = req;
+    slot->rr = &state->raw[req - state->reqs];
+    slot->seq = conn->made++;
+    slot->retried = 0;
+    if (slot->rr->templated) {
+        expand(slot, req, &state->rng, result_keeps_url(state, req));
+    } else {
+        slot->head = slot->rr->head;
+        slot->head_length = slot->rr->head_length;
+        slot->payload = req->payload;
+        slot->payload_length = req->payload_length;
+    }
+
+    slot->rslt.time_start = nanos();
+    if (slot->rr->timeout != 0) {
+        slot->deadline = slot->rslt.time_start + 1000000UL * slot->rr->timeout;
+        timeouts_push(&lanes[slot->rr->lane], conn, slot);
+    }
+
+    // only a request that opens the connection is timed connecting
+    slot->rslt.reused = (conn->fd >= 0 && !conn->draining && conn->target == slot->rr->target);
+    pump(ring, conn);
+
+    return &slot->rslt;
+}
+
+/**
+ * Count the slot's request, which ended now.
+ */
+static void record(raw_slot* slot, threadstate* state)
+{
+    result* rslt = &slot->rslt;
+
+    rslt->time_end = nanos();
+    rslt->request_bytes = slot->head_length + slot->payload_length;
+    if (rslt->time_ttfb > 0)
+        rslt->time_first_byte = rslt->time_start + rslt->time_ttfb;
+    else
+        rslt->time_first_byte = rslt->time_end;
+
+
+    record_result(state, rslt);
+}
+
+/**
+ * Cancel the connection's operations, to close it once they're done.
+ */
+static void drain(uring* ring, raw_conn* conn, drain_reason why)
+{
+    struct io_uring_sqe* sqe;
+    int op;
+
+    conn->draining = why;
+    for (op=OP_CONNECT; op<=OP_RECV; op++) {
+        if (!(conn->inflight & (1 << op)))
+            continue;
+        sqe = submission(ring, NULL, 0);
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = (uintptr_t)conn | op;
+    }
+
+    // with nothing to cancel, it settles when a no-op completes
+    if (conn->inflight == 0)
+        submission(ring, conn, OP_SETTLE)->opcode = IORING_OP_NOP;
+}
+
+/**
+ * Close a drained connection, and carry on with any requests still
+ * to make on it. Return how many of its slots are free again.
+ */
+static unsigned long settle(uring* ring, raw_conn* conn)
+{
+    unsigned long freed = conn->held;
+
+    drop(conn);
+    conn->held = 0;
+    conn->sent = 0;
+    conn->partial = 0;
+    conn->length = 0;
+    conn->parse = PARSE_HEAD;
+    conn->draining = DRAIN_NONE;
+    pump(ring, conn);
+
+    return freed;
+}
+
+/**
+ * Fail every request in flight on the connection: the nth with
+ * `status`, and any others with 599, as they were lost with the
+ * connection. Their slots are free once it's closed.
+ */
+static void abort_requests(uring* ring, raw_conn* conn, threadstate* state, unsigned long n, int status)
+{
+    unsigned long i;
+
+    for (i=0; i<conn->count; i++) {
+        SLOT(conn, i)->rslt.status = (i == n ? status : 599);
+        record(SLOT(conn, i), state);
+    }
+    conn->first = (conn->first + conn->count) % conn->depth;
+    conn->held += conn->count;
+    conn->count = 0;
+    drain(ring, conn, DRAIN_ABORT);
+}
+
+/**
+ * Close the connection, whose server closes it after the response
+ * just finished. Any requests behind that one went unanswered, so
+ * they're sent again on a new connection.
+ */
+static void closed(uring* ring, raw_conn* conn)
+{
+    if (conn->count == 0 && conn->inflight == 0) {
+        drop(conn);
+        return;
+    }
+    if (conn->count > 0)
+        SLOT(conn, 0)->rslt.reused = 0;
+    drain(ring, conn, DRAIN_RETRY);
+}
+
+/**
+ * A server may close a kept-alive connection just as a request is
+ * sent on it. Like libcurl, send the requests again on a new
+ * connection, once, if none of the first's response came; and as
+ * the curl path does on any other error, fail them otherwise.
+ */
+static void retry(uring* ring, raw_conn* conn, threadstate* state)
+{
+    raw_slot* first = SLOT(conn, 0);
+
+    if (conn->count == 0 || !first->rslt.reused || first->retried || first->rslt.time_ttfb != 0) {
+        abort_requests(ring, conn, state, 0, 598);
+        return;
+    }
+
+    first->retried = 1;
+    first->rslt.reused = 0;
+    drain(ring, conn, DRAIN_RETRY);
+}
+
+/**
+ * Parse a response head, of `length` bytes including the blank line
+ * that ends it, into rslt, and set up to read the body it announces.
+ * Return 1 if it's malformed or 0 on success.
+ */
+static int parse_head(raw_conn* conn, result* rslt, const char* head, unsigned long length)
+{
+    const char* end = head + length;
+    const char* line;
+    const char* eol;
+    const char* value;
+    long content_length = -1;
+    char chunked = 0, keep_alive;
+    int status;
+
+    if (length < 14 || strncmp(head, "HTTP/1.", 7) != 0 ||
+            !isdigit(head[9]) || !isdigit(head[10]) || !isdigit(head[11]))
+        return 1;
+    status = (head[9] - '0') * 100 + (head[10] - '0') * 10 + (head[11] - '0');
+    keep_alive = (head[7] != '0');
+
+    // the head ends in an empty line, and every line in \n
+    for (line = memchr(head, '\n', length) + 1; line < end - 2; line = eol + 1) {
+        eol = memchr(line, '\n', end - line);
+        if ((value = memchr(line, ':', eol - line)) == NULL)
+            continue;
+
+        if (value - line == 14 && strncasecmp(line, "Content-Length", 14) == 0)
+            content_length = strtol(value + 1, NULL, 10);
+        else if (value - line == 17 && strncasecmp(line, "Transfer-Encoding", 17) == 0)
+            chunked = has_token(value, eol, "chunked");
+        else if (value - line == 10 && strncasecmp(line, "Connection", 10) == 0)
+            keep_alive = (has_token(value, eol, "close") ? 0 : has_token(value, eol, "keep-alive") ? 1 : keep_alive);
+    }
+
+    rslt->header_bytes += length;
+
+    // interim responses are counted, and the final one follows
+    if (status / 100 == 1) {
+        if (status == 101)
+            return 1;
+        conn->parse = PARSE_HEAD;
+        return 0;
+    }
+
+    rslt->status = status;
+    conn->closing = !keep_alive;
+    if (status == 204 || status == 304) {
+        conn->parse = PARSE_DONE;
+    } else if (chunked) {
+        conn->parse = PARSE_CHUNK_SIZE;
+    } else if (content_length >= 0) {
+        conn->remaining = content_length;
+        conn->parse = (content_length > 0 ? PARSE_BODY : PARSE_DONE);
+    } else {
+        conn->parse = PARSE_UNTIL_CLOSE;
+        conn->closing = 1;
+    }
+    return 0;
+}
+
+/**
+ * Parse as much of the buffered response as has arrived into rslt,
+ * keeping any incomplete line, or what follows the response, for
+ * next time. Return 1 once the response is complete, 0 if more is
+ * needed, or -1 if it's malformed.
+ */
+static int parse(raw_conn* conn, result* rslt)
+{
+    char* p = conn->buf;
+    char* end = conn->buf + conn->length;
+    char* eol;
+    unsigned long n;
+
+    while (conn->parse != PARSE_DONE) {
+        switch (conn->parse) {
+        case PARSE_HEAD:
+            if ((eol = memmem(p, end - p, "\r\n\r\n", 4)) == NULL)
+                goto more;
+            if (parse_head(conn, rslt, p, eol + 4 - p) != 0)
+                return -1;
+            p = eol + 4;
+            break;
+
+        case PARSE_BODY:
+        case PARSE_CHUNK_DATA:
+            n = ((unsigned long)(end - p) < conn->remaining ? (unsigned long)(end - p) : conn->remaining);
+            rslt->num_bytes += n;
+            conn->remaining -= n;
+            p += n;
+            if (conn->remaining > 0)
+                goto more;
+            conn->parse = (conn->parse == PARSE_BODY ? PARSE_DONE : PARSE_CHUNK_END);
+            break;
+
+        case PARSE_CHUNK_SIZE:
+            if ((eol = memmem(p, end - p, "\r\n", 2)) == NULL)
+                goto more;
+            if (!isxdigit(*p))
+                return -1;
+            conn->remaining = strtoul(p, NULL, 16);
+            conn->parse = (conn->remaining > 0 ? PARSE_CHUNK_DATA : PARSE_TRAILER);
+            p = eol + 2;
+            break;
+
+        case PARSE_CHUNK_END:
+            if (end - p < 2)
+                goto more;
+            if (p[0] != '\r' || p[1] != '\n')
+                return -1;
+            conn->parse = PARSE_CHUNK_SIZE;
+            p += 2;
+            break;
+
+        case PARSE_TRAILER:
+            // trailer fields, if any, then an empty line
+            if ((eol = memmem(p, end - p, "\r\n", 2)) == NULL)
+                goto more;
+            if (eol == p)
+                conn->parse = PARSE_DONE;
+            p = eol + 2;
+            break;
+
+        case PARSE_UNTIL_CLOSE:
+            rslt->num_bytes += end - p;
+            p = end;
+            goto more;
+
+        case PARSE_DONE:
+            break;
+        }
+    }
+
+    conn->length = end - p;
+    memmove(conn->buf, p, conn->length);
+    return 1;
+
+more:
+    conn->length = end - p;
+    memmove(conn->buf, p, conn->length);
+    // a head or chunk size line that won't fit can't be parsed
+    return (conn->length == RAW_BUFFER ? -1 : 0);
+}
+
+/**
+ * Count `n` more bytes of the connection's requests as sent.
+ */
+static void advance(raw_conn* conn, unsigned long n)
+{
+    unsigned long left;
+
+    while (n > 0 && conn->sent < conn->count) {
+        raw_slot* slot = SLOT(conn, conn->sent);
+        left = slot->head_length + slot->payload_length - conn->partial;
+        if (n < left) {
+            conn->partial += n;
+            return;
+        }
+        n -= left;
+        conn->partial = 0;
+        conn->sent++;
+    }
+}
+
+/**
+ * Finish the connection's first request, whose response has been
+ * parsed.
+ */
+static void finish_first(raw_conn* conn, threadstate* state)
+{
+    record(SLOT(conn, 0), state);
+    conn->first = (conn->first + 1) % conn->depth;
+    conn->count--;
+    if (conn->sent > 0)
+        conn->sent--;
+    conn->parse = PARSE_HEAD;
+}
+
+/**
+ * Parse the responses buffered on the connection, finishing each
+ * request that's been answered. Return how many were.
+ */
+static unsigned long receive(uring* ring, raw_conn* conn, threadstate* state)
+{
+    unsigned long freed = 0, now = nanos();
+    raw_slot* first;
+    int parsed;
+
+    while (conn->length > 0) {
+        // nothing should arrive that wasn't asked for
+        if (conn->count == 0) {
+            abort_requests(ring, conn, state, 0, 599);
+            return freed;
+        }
+
+        first = SLOT(conn, 0);
+        if (first->rslt.time_ttfb == 0)
+            first->rslt.time_ttfb = now - first->rslt.time_start;
+        if ((parsed = parse(conn, &first->rslt)) < 0) {
+            abort_requests(ring, conn, state, 0, 598);
+            return freed;
+        }
+        if (parsed == 0)
+            break;
+
+        // an answer before the whole request was sent ends the
+        // connection, as the rest of the request can't follow
+        if (conn->sent == 0)
+            conn->closing = 1;
+        finish_first(conn, state);
+        freed++;
+        if (conn->closing) {
+            closed(ring, conn);
+            return freed;
+        }
+    }
+
+    pump(ring, conn);
+    return freed;
+}
+
+/**
+ * Carry on with the connection's requests now that its operation
+ * `op` has completed with `res`. Return how many of its slots that
+ * freed for new requests.
+ */
+static unsigned long complete(uring* ring, raw_conn* conn, raw_op op, int res, threadstate* state)
+{
+    unsigned long i, now;
+
+    conn->inflight &= ~(1 << op);
+    if (conn->draining)
+        return (conn->inflight == 0 ? settle(ring, conn) : 0);
+
+    switch (op) {
+    case OP_CONNECT:
+        if (res < 0 || conn->fd < 0) {
+            abort_requests(ring, conn, state, 0, 598);
+            return 0;
+        }
+        now = nanos();
+        for (i=0; i<conn->count; i++)
+            if (!SLOT(conn, i)->rslt.reused)
+                SLOT(conn, i)->rslt.time_connect = now - SLOT(conn, i)->rslt.time_start;
+        break;
+
+    case OP_SEND:
+        if (res < 0) {
+            retry(ring, conn, state);
+            return 0;
+        }
+        advance(conn, res);
+        break;
+
+    case OP_RECV:
+        if (res == 0 && conn->parse == PARSE_UNTIL_CLOSE && conn->count > 0) {
+            finish_first(conn, state);
+            closed(ring, conn);
+            return 1;
+        }
+        if (res <= 0) {
+            retry(ring, conn, state);
+            return 0;
+        }
+        conn->length += res;
+        return receive(ring, conn, state);
+
+    case OP_SETTLE:
+        break;
+    }
+
+    pump(ring, conn);
+    return 0;
+}
+
+/**
+ * Event loop thread entry point; drives state->conn_count
+ * connections with a single io_uring, speaking HTTP/1.1 itself
+ * rather than through libcurl.
+ */
+void* raw_thread(void* st)
+{
+    threadstate* state = (threadstate*)st;
+    options opts = state->opts;
+    uring ring;
+    timeouts* lanes;
+    raw_conn* conns;
+    raw_conn** idle;
+    raw_conn* conn;
+    struct io_uring_cqe* cqe;
+    unsigned long i, k, now, due, seq, deadline, end_time = 0, entries;
+    unsigned long num_lanes = 0;
+    unsigned long busy = 0, num_idle = 0, made = 0, freed;
+    unsigned long quota = opts.run_requests * state->conn_count;
+    unsigned long pending = 0, asleep, waited = 0;
+    unsigned long long data;
+    char scheduling = (state->sched != NULL);
+    char parking = (!scheduling && opts.profile != NULL);
+    long wait;
+    int res;
+
+    overhead_begin(state);
+
+    // each connection has at most three operations in flight, and
+    // as many cancellations
+    for (entries=64; entries<4 * state->conn_count && entries<32768; entries*=2)
+        ;
+    if (uring_init(&ring, entries) != 0) {
+        perror("io_uring_setup");
+        exit(2);
+    }
+
+    // a lane of timeouts for each distinct timeout among the requests
+    for (i=0; i<state->req_count; i++) {
+        if (state->raw[i].timeout != 0 && state->raw[i].lane >= num_lanes)
+            num_lanes = state->raw[i].lane + 1;
+    }
+    if (!(lanes = calloc(num_lanes + 1, sizeof(timeouts)))) {
+        perror("event loop error");
+        exit(2);
+    }
+
+    // the idle list has an entry for each free slot
+    conns = calloc(state->conn_count, sizeof(raw_conn));
+    idle = malloc(state->conn_count * opts.pipeline * sizeof(raw_conn*));
+    if (conns == NULL || idle == NULL) {
+        perror("event loop error");
+        exit(2);
+    }
+    for (i=0; i<state->conn_count; i++) {
+        conns[i].fd = -1;
+        conns[i].index = state->conn_first + i * state->conn_stride;
+        conns[i].depth = opts.pipeline;
+        conns[i].max_iov = (2 * opts.pipeline < IOV_MAX ? 2 * opts.pipeline : IOV_MAX);
+        conns[i].slots = calloc(opts.pipeline, sizeof(raw_slot));
+        conns[i].iov = calloc(conns[i].max_iov, sizeof(struct iovec));
+        if (conns[i].slots == NULL || conns[i].iov == NULL) {
+            perror("event loop error");
+            exit(2);
+        }
+        if (opts.randomize)
+            conns[i].next = rng_below(&state->rng, state->req_count);
+    }
+
+    if (opts.profile != NULL)
+        end_time = opts.profile->start + opts.profile->length;
+    else if (opts.run_seconds)
+        end_time = nanos() + (1000000000UL * opts.run_seconds);
+
+    if (scheduling || parking) {
+        // open-loop: connections wait idle for their next slot;
+        // profiled: they wait until the profile calls for them
+        for (k=0; k<opts.pipeline; k++)
+            for (i=0; i<state->conn_count; i++)
+                idle[num_idle++] = &conns[i];
+    } else {
+        for (i=0; i<state->conn_count; i++) {
+            for (k=0; k<opts.pipeline && (!opts.run_requests || k<opts.run_requests); k++) {
+                result* rslt = start_request(&ring, &conns[i], state, lanes);
+                rslt->time_intended = rslt->time_start;
+                busy++;
+            }
+        }
+    }
+
+    while (busy > 0 || scheduling || parking) {
+        now = nanos();
+
+        // start any parked connections the profile now calls for
+        if (parking) {
+            if (now >= end_time || __atomic_load_n(&stopping, __ATOMIC_RELAXED)) {
+                parking = 0;
+            } else {
+                for (i=0; i<num_idle; ) {
+                    conn = idle[i];
+                    if (!conn_active(state, conn->index, now)) {
+                        i++;
+                        continue;
+                    }
+                    idle[i] = idle[--num_idle];
+                    result* rslt = start_request(&ring, conn, state, lanes);
+                    rslt->time_intended = rslt->time_start;
+                    busy++;
+                }
+            }
+        }
+
+        // hand every due slot in the schedule to an idle connection;
+        // if none is idle, the slot waits, and its latency counts
+        // from when it was due
+        while (scheduling && num_idle > 0) {
+            if (pending == 0) {
+                if ((opts.run_requests ? made >= quota : schedule_peek(state->sched) >= end_time) || __atomic_load_n(&stopping, __ATOMIC_RELAXED)) {
+                    scheduling = 0;
+                    break;
+                }
+                if (schedule_peek(state->sched) > now)
+                    break;
+                pending = schedule_claim(state->sched, &state->rng);
+                if (end_time && pending >= end_time) {
+                    pending = 0;
+                    scheduling = 0;
+                    break;
+                }
+            }
+            if (pending > now)
+                break;
+
+            conn = idle[--num_idle];
+            start_request(&ring, conn, state, lanes)->time_intended = pending;
+            pending = 0;
+            made++;
+            busy++;
+        }
+
+        if (busy == 0 && !scheduling && !parking)
+            break;
+
+        wait = -1;
+        if (timeouts_next(lanes, num_lanes, &seq, &deadline) != NULL)
+            wait = (deadline > now ? deadline - now : 0);
+        if (scheduling && num_idle > 0) {
+            due = (pending != 0 ? pending : schedule_peek(state->sched));
+            due = (due > now ? due - now : 0);
+            if (wait < 0 || (long)due < wait)
+                wait = due;
+        }
+        if (parking && num_idle > 0 && (wait < 0 || wait > (long)PARKED_POLL))
+            wait = PARKED_POLL;
+
+        asleep = nanos();
+        if (uring_wait(&ring, wait) != 0) {
+            perror("io_uring_enter");
+            exit(2);
+        }
+        waited += nanos() - asleep;
+
+        while ((cqe = uring_peek(&ring)) != NULL) {
+            data = cqe->user_data;
+            res = cqe->res;
+            uring_seen(&ring);
+            if (data == CANCEL_TAG)
+                continue;
+
+            conn = (raw_conn*)(uintptr_t)(data & ~(unsigned long long)OP_MASK);
+            freed = complete(&ring, conn, data & OP_MASK, res, state);
+            busy -= freed;
+
+            for (; freed > 0; freed--) {
+                if (state->sched != NULL) {
+                    idle[num_idle++] = conn;
+                } else if ((opts.run_requests ? conn->made < opts.run_requests : nanos() < end_time) && !__atomic_load_n(&stopping, __ATOMIC_RELAXED)) {
+                    if (parking && !conn_active(state, conn->index, nanos())) {
+                        idle[num_idle++] = conn;
+                        continue;
+                    }
+                    result* rslt = start_request(&ring, conn, state, lanes);
+                    rslt->time_intended = rslt->time_start;
+                    busy++;
+                }
+            }
+        }
+
+        // fail whatever has passed its timeout since, losing whatever
+        // else is in flight on the same connection
+        now = nanos();
+        while ((conn = timeouts_next(lanes, num_lanes, &seq, &deadline)) != NULL && deadline <= now)
+            abort_requests(&ring, conn, state, seq - SLOT(conn, 0)->seq, 598);
+    }
+
+    for (i=0; i<state->conn_count; i++) {
+        drop(&conns[i]);
+        for (k=0; k<conns[i].depth; k++)
+            free(conns[i].slots[k].buf);
+        free(conns[i].slots);
+        free(conns[i].iov);
+    }
+    free(conns);
+    free(idle);
+    for (i=0; i<num_lanes; i++)
+        free(lanes[i].items);
+    free(lanes);
+    uring_free(&ring);
+    overhead_end(state, waited);
+
+    state->last_cpu = sched_getcpu();
+    flush_results(state);
+
+    return NULL;
+}
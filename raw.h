@@ -0,0 +1,66 @@
+#ifndef WIDELOAD_RAW_H
+#define WIDELOAD_RAW_H
+
+#include <sys/socket.h>
+
+#include "loader.h"
+
+/**
+ * A server the raw engine connects to: each distinct host and
+ * port among the requests, resolved once at load time.
+ */
+typedef struct {
+    char*                   authority;  /* host[:port], as in the URLs */
+    struct sockaddr_storage addr;
+    socklen_t               addrlen;
+} raw_target;
+
+/**
+ * A request serialized for the raw engine: its head (the request
+ * line and headers), sent as it is, followed by its payload. A
+ * templated request's head is compiled as a template too, and if
+ * its payload is templated, the head stops short of the
+ * Content-Length, which is added to each expansion.
+ */
+typedef struct _raw_request {
+    raw_target*   target;
+    char*         head;
+    unsigned long head_length;
+    char          templated;
+    struct _template* head_template;  /* NULL if only the payload is templated */
+
+    /* its timeout in ms (its own, or --fail-after), or 0 for none;
+       and which of the engine's lanes of timeouts it goes in, one
+       per distinct timeout */
+    unsigned long timeout;
+    unsigned long lane;
+} raw_request;
+
+typedef struct {
+    unsigned long count;
+    raw_request*  reqs;    /* in the same order as the requests */
+    unsigned long num_targets;
+    raw_target*   targets;
+    unsigned long* target_table;  /* 1 + a target, by its authority's hash, or 0 */
+    unsigned long target_table_size;
+    unsigned long num_lanes;
+    unsigned long* lanes;  /* the timeout of each lane */
+} raw_requests;
+
+/**
+ * Serialize every request for the raw engine, resolving their hosts.
+ * Only plain http:// URLs can be sent this way.
+ * Return 1 on error or 0 on success.
+ */
+int raw_prepare(raw_requests* raw, requests reqs, const options* opts);
+
+void raw_free(raw_requests* raw);
+
+/**
+ * Event loop thread entry point; drives state->conn_count
+ * connections with a single io_uring, speaking HTTP/1.1 itself
+ * rather than through libcurl.
+ */
+void* raw_thread(void* arg);
+
+#endif
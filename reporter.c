@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "loader.h"
+#include "reporter.h"
+
+/**
+ * Print the difference between two snapshots taken `elapsed`
+ * nanos apart.
+ */
+void reporter_print(stats* cur, stats* prev, histogram* window, unsigned long elapsed, unsigned long since_start, char open_loop)
+{
+    double seconds = elapsed / 1000000000.0;
+
+    // open-loop latency counts from each request's intended start
+    if (open_loop)
+        hist_diff(window, &cur->corrected, &prev->corrected);
+    else
+        hist_diff(window, &cur->latency, &prev->latency);
+
+    fprintf(stderr, "[%5lus] %9.1f req/s, %lu failures (%lu timeouts), %.2f MB/s, p50 %.3f p99 %.3f max %.3f ms\n",
+            since_start / 1000000000,
+            (cur->requests - prev->requests) / seconds,
+            cur->failures - prev->failures,
+            cur->timeouts - prev->timeouts,
+            (cur->bytes - prev->bytes) / seconds / (1024 * 1024),
+            hist_percentile(window, 50) / 1000.0,
+            hist_percentile(window, 99) / 1000.0,
+            window->max / 1000.0);
+}
+
+static void* reporter_thread(void* arg)
+{
+    reporter* rp = (reporter*)arg;
+    stats snapshots[2];
+    histogram window;
+    struct timespec tick = {0, 50000000};
+    unsigned long i, start, last, now;
+    int cur = 0;
+
+    if (stats_init(&snapshots[0]) || stats_init(&snapshots[1]) || hist_init(&window, LATENCY_HIGHEST, LATENCY_SIGFIGS)) {
+        fprintf(stderr, "Could not allocate statistics for reporting\n");
+        return NULL;
+    }
+
+    start = last = nanos();
+    while (!__atomic_load_n(&rp->done, __ATOMIC_ACQUIRE)) {
+        nanosleep(&tick, NULL);
+        now = nanos();
+        if (now - last < rp->interval * 1000000000UL)
+            continue;
+
+        // workers only ever add to their stats, so a merged copy
+        // less the previous one is this interval's activity
+        cur = !cur;
+        stats_clear(&snapshots[cur]);
+        for (i=0; i<rp->nthreads; i++)
+            stats_merge(&snapshots[cur], &rp->states[i].stats);
+
+        reporter_print(&snapshots[cur], &snapshots[!cur], &window, now - last, now - start, rp->states[0].sched != NULL);
+        last = now;
+    }
+
+    stats_free(&snapshots[0]);
+    stats_free(&snapshots[1]);
+    hist_free(&window);
+
+    return NULL;
+}
+
+/**
+ * Start reporting on every state each `interval` seconds.
+ * Return 1 on error or 0 on success.
+ */
+int reporter_start(reporter* rp, threadstate* states, unsigned long nthreads, unsigned long interval)
+{
+    rp->states = states;
+    rp->nthreads = nthreads;
+    rp->interval = interval;
+    rp->done = 0;
+
+    return pthread_create(&rp->thread, NULL, reporter_thread, rp) != 0;
+}
+
+/**
+ * Stop reporting; call once the workers have finished.
+ */
+void reporter_stop(reporter* rp)
+{
+    __atomic_store_n(&rp->done, 1, __ATOMIC_RELEASE);
+    pthread_join(rp->thread, NULL);
+}
@@ -0,0 +1,37 @@
+#ifndef WIDELOAD_REPORTER_H
+#define WIDELOAD_REPORTER_H
+
+#include <pthread.h>
+
+#include "loader.h"
+
+/**
+ * Background thread which prints each interval's throughput,
+ * failures and latency to stderr while the test runs.
+ */
+typedef struct {
+    threadstate*   states;
+    unsigned long  nthreads;
+    unsigned long  interval;  /* seconds */
+    int            done;
+    pthread_t      thread;
+} reporter;
+
+/**
+ * Start reporting on every state each `interval` seconds.
+ * Return 1 on error or 0 on success.
+ */
+int reporter_start(reporter* rp, threadstate* states, unsigned long nthreads, unsigned long interval);
+
+/**
+ * Stop reporting; call once the workers have finished.
+ */
+void reporter_stop(reporter* rp);
+
+/**
+ * Print the difference between two snapshots taken `elapsed`
+ * nanos apart.
+ */
+void reporter_print(stats* cur, stats* prev, histogram* window, unsigned long elapsed, unsigned long since_start, char open_loop);
+
+#endif
@@ -0,0 +1,397 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <curl/curl.h>
+
+#include "loader.h"
+#include "reqset.h"
+#include "payload.h"
+#include "template.h"
+
+/**
+ * Return 1 if `filename` is a compiled request set.
+ */
+int reqset_detect(const char* filename)
+{
+    char magic[sizeof(((reqset_header*)0)->magic)];
+    FILE* in = fopen(filename, "r");
+    int found = 0;
+
+    if (in == NULL)
+        return 0;
+    if (fread(magic, sizeof(magic), 1, in) == 1)
+        found = (memcmp(magic, REQSET_MAGIC, sizeof(magic)) == 0);
+    fclose(in);
+
+    return found;
+}
+
+/**
+ * Return the index of pf in shared[0..count), or count if absent.
+ */
+static unsigned long find_shared(const payload_file** shared, unsigned long count, const payload_file* pf)
+{
+    unsigned long k;
+
+    for (k=0; k<count && shared[k]!=pf; k++)
+        ;
+    return k;
+}
+
+/**
+ * Write reqs to `filename` as a compiled request set.
+ * Return 1 on error or 0 on success.
+ */
+int reqset_write(const char* filename, requests reqs)
+{
+    reqset_header hdr;
+    reqset_request entry;
+    reqset_header_entry hentry;
+    reqset_feeder fentry;
+    unsigned long i, j, k, offset, feeder_offset, first_header = 0;
+    unsigned long num_shared = 0, num_feeders = 0;
+    const payload_file** shared;
+    unsigned long* shared_offsets;
+    template_file* files;
+    payload_file** feeders = NULL;
+    FILE* out = NULL;
+    int ret = 1;
+
+    shared = malloc(reqs.count * sizeof(payload_file*));
+    shared_offsets = malloc(reqs.count * sizeof(unsigned long));
+    files = template_files(&num_feeders);
+    if (shared == NULL || shared_offsets == NULL || files == NULL ||
+            (feeders = calloc(num_feeders + 1, sizeof(payload_file*))) == NULL) {
+        fprintf(stderr, "Could not allocate request set\n");
+        goto reqset_write_error;
+    }
+
+    // the CSV files go in the set too, so that it runs without them;
+    // those that came from another set are copied from it
+    for (k=0; k<num_feeders; k++) {
+        if (files[k].data != NULL)
+            continue;
+        if ((feeders[k] = payload_open(files[k].path)) == NULL) {
+            fprintf(stderr, "Could not read CSV file '%s'\n", files[k].path);
+            goto reqset_write_error;
+        }
+        files[k].data = feeders[k]->data;
+        files[k].length = feeders[k]->length;
+    }
+
+    if ((out = fopen(filename, "w")) == NULL) {
+        perror(filename);
+        goto reqset_write_error;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, REQSET_MAGIC, sizeof(hdr.magic));
+    hdr.version = REQSET_VERSION;
+    hdr.req_count = reqs.count;
+    for (i=0; i<reqs.count; i++)
+        hdr.header_count += reqs.reqs[i].num_headers;
+    hdr.feeder_count = num_feeders;
+    fwrite(&hdr, sizeof(hdr), 1, out);
+
+    // lay out the arena in the same order it's written below:
+    // each request's URL, then its name, its payload and its headers,
+    // and finally each payload file once, however many requests
+    // name it, and each CSV file after those
+    offset = sizeof(hdr) + hdr.req_count * sizeof(reqset_request) + hdr.header_count * sizeof(reqset_header_entry) + hdr.feeder_count * sizeof(reqset_feeder);
+    for (i=0; i<reqs.count; i++) {
+        request* req = &reqs.reqs[i];
+        offset += strlen(req->url) + 1;
+        if (req->name != NULL)
+            offset += strlen(req->name) + 1;
+        if (req->payload_map == NULL)
+            offset += req->payload_length + 1;
+        for (j=0; j<req->num_headers; j++)
+            offset += (strlen(req->headers[j].name) + strlen(req->headers[j].value)) * 2 + 5;
+    }
+    for (i=0; i<reqs.count; i++) {
+        const payload_file* pf = reqs.reqs[i].payload_map;
+        if (pf == NULL || find_shared(shared, num_shared, pf) < num_shared)
+            continue;
+        shared[num_shared] = pf;
+        shared_offsets[num_shared++] = offset;
+        offset += pf->length + 1;
+    }
+    feeder_offset = offset;
+
+    offset = sizeof(hdr) + hdr.req_count * sizeof(reqset_request) + hdr.header_count * sizeof(reqset_header_entry) + hdr.feeder_count * sizeof(reqset_feeder);
+    for (i=0; i<reqs.count; i++) {
+        request* req = &reqs.reqs[i];
+
+        entry.method = req->method;
+        entry.num_headers = req->num_headers;
+        entry.url = offset;
+        offset += strlen(req->url) + 1;
+        entry.name = 0;
+        if (req->name != NULL) {
+            entry.name = offset;
+            offset += strlen(req->name) + 1;
+        }
+        entry.payload_length = req->payload_length;
+        if (req->payload_map != NULL) {
+            entry.payload = shared_offsets[find_shared(shared, num_shared, req->payload_map)];
+        } else {
+            entry.payload = offset;
+            offset += req->payload_length + 1;
+        }
+        entry.weight = req->weight;
+        entry.timeout = req->timeout;
+        for (j=0; j<EXPECT_MAX; j++)
+            entry.expect[j] = req->expect[j];
+        entry.first_header = first_header;
+        first_header += req->num_headers;
+        for (j=0; j<req->num_headers; j++)
+            offset += (strlen(req->headers[j].name) + strlen(req->headers[j].value)) * 2 + 5;
+
+        fwrite(&entry, sizeof(entry), 1, out);
+    }
+
+    offset = sizeof(hdr) + hdr.req_count * sizeof(reqset_request) + hdr.header_count * sizeof(reqset_header_entry) + hdr.feeder_count * sizeof(reqset_feeder);
+    for (i=0; i<reqs.count; i++) {
+        request* req = &reqs.reqs[i];
+        offset += strlen(req->url) + 1;
+        if (req->name != NULL)
+            offset += strlen(req->name) + 1;
+        if (req->payload_map == NULL)
+            offset += req->payload_length + 1;
+        for (j=0; j<req->num_headers; j++) {
+            hentry.name = offset;
+            offset += strlen(req->headers[j].name) + 1;
+            hentry.value = offset;
+            offset += strlen(req->headers[j].value) + 1;
+            hentry.joined = offset;
+            offset += strlen(req->headers[j].name) + strlen(req->headers[j].value) + 3;
+            fwrite(&hentry, sizeof(hentry), 1, out);
+        }
+    }
+
+    offset = feeder_offset;
+    for (k=0; k<num_feeders; k++) {
+        fentry.path = offset;
+        offset += strlen(files[k].path) + 1;
+        fentry.data = offset;
+        fentry.length = files[k].length;
+        offset += files[k].length + 1;
+        fwrite(&fentry, sizeof(fentry), 1, out);
+    }
+
+    for (i=0; i<reqs.count; i++) {
+        request* req = &reqs.reqs[i];
+        fwrite(req->url, 1, strlen(req->url) + 1, out);
+        if (req->name != NULL)
+            fwrite(req->name, 1, strlen(req->name) + 1, out);
+        if (req->payload_map == NULL) {
+            if (req->payload_length > 0)
+                fwrite(req->payload, 1, req->payload_length, out);
+            fputc('\0', out);
+        }
+        for (j=0; j<req->num_headers; j++) {
+            fwrite(req->headers[j].name, 1, strlen(req->headers[j].name) + 1, out);
+            fwrite(req->headers[j].value, 1, strlen(req->headers[j].value) + 1, out);
+            fprintf(out, "%s: %s", req->headers[j].name, req->headers[j].value);
+            fputc('\0', out);
+        }
+    }
+    for (k=0; k<num_shared; k++) {
+        fwrite(shared[k]->data, 1, shared[k]->length, out);
+        fputc('\0', out);
+    }
+    for (k=0; k<num_feeders; k++) {
+        fwrite(files[k].path, 1, strlen(files[k].path) + 1, out);
+        fwrite(files[k].data, 1, files[k].length, out);
+        fputc('\0', out);
+    }
+    ret = 0;
+
+reqset_write_error:
+    if (out != NULL && fclose(out) != 0) {
+        perror(filename);
+        ret = 1;
+    }
+    for (k=0; feeders!=NULL && k<num_feeders; k++)
+        if (feeders[k] != NULL)
+            payload_close(feeders[k]);
+    free(feeders);
+    free(files);
+    free(shared);
+    free(shared_offsets);
+    return ret;
+}
+
+/**
+ * Return 1 if a NUL-terminated string starts at `offset` and ends
+ * within the `size` bytes mapped at base.
+ */
+static int valid_string(const char* base, unsigned long size, uint64_t offset)
+{
+    return (offset < size && memchr(base + offset, '\0', size - offset) != NULL);
+}
+
+/**
+ * Return 1 if every count, offset and value in the mapped request
+ * set lies within its `size` bytes, so that it can be used as it is.
+ */
+static int valid_reqset(const char* base, unsigned long size)
+{
+    const reqset_header* hdr = (const reqset_header*)base;
+    const reqset_request* entries;
+    const reqset_header_entry* hentries;
+    const reqset_feeder* fentries;
+    unsigned long i, j, tables = size - sizeof(reqset_header);
+
+    // a truncated file can hold fewer entries than it claims
+    if (hdr->req_count > tables / sizeof(reqset_request))
+        return 0;
+    tables -= hdr->req_count * sizeof(reqset_request);
+    if (hdr->header_count > tables / sizeof(reqset_header_entry))
+        return 0;
+    tables -= hdr->header_count * sizeof(reqset_header_entry);
+    if (hdr->feeder_count > tables / sizeof(reqset_feeder))
+        return 0;
+    entries = (const reqset_request*)(base + sizeof(reqset_header));
+    hentries = (const reqset_header_entry*)(entries + hdr->req_count);
+    fentries = (const reqset_feeder*)(hentries + hdr->header_count);
+
+    for (j=0; j<hdr->feeder_count; j++) {
+        if (!valid_string(base, size, fentries[j].path) ||
+                fentries[j].data >= size || fentries[j].length >= size - fentries[j].data ||
+                base[fentries[j].data + fentries[j].length] != '\0')
+            return 0;
+    }
+
+    for (j=0; j<hdr->header_count; j++) {
+        if (!valid_string(base, size, hentries[j].name) ||
+                !valid_string(base, size, hentries[j].value) ||
+                !valid_string(base, size, hentries[j].joined))
+            return 0;
+    }
+    for (i=0; i<hdr->req_count; i++) {
+        const reqset_request* entry = &entries[i];
+
+        if ((entry->method != HTTP_GET && entry->method != HTTP_POST) ||
+                !valid_string(base, size, entry->url) ||
+                (entry->name != 0 && !valid_string(base, size, entry->name)) ||
+                entry->payload >= size || entry->payload_length >= size - entry->payload ||
+                base[entry->payload + entry->payload_length] != '\0' ||
+                entry->first_header > hdr->header_count ||
+                entry->num_headers > hdr->header_count - entry->first_header ||
+                !(entry->weight >= 0))
+            return 0;
+        for (j=0; j<EXPECT_MAX; j++)
+            if (entry->expect[j] != 0 && (entry->expect[j] < 100 || entry->expect[j] > 597))
+                return 0;
+    }
+    return 1;
+}
+
+/**
+ * Map a compiled request set. Exits on error.
+ */
+requests reqset_load(const char* filename)
+{
+    requests reqs;
+    const reqset_header* hdr;
+    const reqset_request* entries;
+    const reqset_header_entry* hentries;
+    const reqset_feeder* fentries;
+    unsigned long i, j;
+    struct stat st;
+    char* base;
+    int fd;
+
+    if ((fd = open(filename, O_RDONLY)) < 0 || fstat(fd, &st) != 0) {
+        perror(filename);
+        exit(1);
+    }
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        perror(filename);
+        exit(1);
+    }
+
+    hdr = (const reqset_header*)base;
+    if (st.st_size < (off_t)sizeof(reqset_header) ||
+            memcmp(hdr->magic, REQSET_MAGIC, sizeof(hdr->magic)) != 0 ||
+            hdr->version != REQSET_VERSION ||
+            hdr->req_count == 0) {
+        fprintf(stderr, "%s: not a compiled request set (version %d)\n", filename, REQSET_VERSION);
+        exit(1);
+    }
+    if (!valid_reqset(base, st.st_size)) {
+        fprintf(stderr, "%s: compiled request set is truncated or corrupt\n", filename);
+        exit(1);
+    }
+    entries = (const reqset_request*)(base + sizeof(reqset_header));
+    hentries = (const reqset_header_entry*)(entries + hdr->req_count);
+    fentries = (const reqset_feeder*)(hentries + hdr->header_count);
+
+    // the CSV files come from the set rather than from disk, so that
+    // its templates are compiled against the rows it was made with
+    for (j=0; j<hdr->feeder_count; j++) {
+        if (template_provide(base + fentries[j].path, base + fentries[j].data, fentries[j].length) != 0) {
+            fprintf(stderr, "%s: compiled request set is truncated or corrupt\n", filename);
+            exit(1);
+        }
+    }
+
+    // three allocations in all, however many requests there are;
+    // everything else points into the mapping
+    reqs.count = hdr->req_count;
+    reqs.mapping = base;
+    reqs.mapping_size = st.st_size;
+    reqs.reqs = malloc(reqs.count * sizeof(request));
+    reqs.header_pool = malloc(hdr->header_count * sizeof(header));
+    reqs.curl_header_pool = malloc(hdr->header_count * sizeof(struct curl_slist));
+    if (reqs.reqs == NULL || (hdr->header_count > 0 && (reqs.header_pool == NULL || reqs.curl_header_pool == NULL))) {
+        fprintf(stderr, "Could not allocate requests\n");
+        exit(2);
+    }
+
+    for (j=0; j<hdr->header_count; j++) {
+        reqs.header_pool[j].name = base + hentries[j].name;
+        reqs.header_pool[j].value = base + hentries[j].value;
+        // libcurl only reads the header list, so it can be
+        // built in place rather than with curl_slist_append()
+        reqs.curl_header_pool[j].data = base + hentries[j].joined;
+        reqs.curl_header_pool[j].next = NULL;
+    }
+
+    for (i=0; i<reqs.count; i++) {
+        request* req = &reqs.reqs[i];
+        const reqset_request* entry = &entries[i];
+
+        req->method = entry->method;
+        req->url = base + entry->url;
+        req->payload = base + entry->payload;
+        req->payload_length = entry->payload_length;
+        req->num_headers = entry->num_headers;
+        req->headers = &reqs.header_pool[entry->first_header];
+        req->curl_headers = NULL;
+        req->chunk = NULL;
+        req->payload_map = NULL;
+        req->tmpl = NULL;
+        req->weight = entry->weight;
+        req->name = (entry->name != 0 ? base + entry->name : NULL);
+        req->endpoint = 0;
+        req->timeout = entry->timeout;
+        for (j=0; j<EXPECT_MAX; j++)
+            req->expect[j] = entry->expect[j];
+        if (req->num_headers > 0) {
+            req->curl_headers = &reqs.curl_header_pool[entry->first_header];
+            for (j=0; j+1<req->num_headers; j++)
+                req->curl_headers[j].next = &req->curl_headers[j + 1];
+        }
+    }
+
+    return reqs;
+}
@@ -0,0 +1,80 @@
+#ifndef WIDELOAD_REQSET_H
+#define WIDELOAD_REQSET_H
+
+#include <stdint.h>
+
+#include "loader.h"
+
+/*
+ * A compiled request set: a parsed URL file, laid out so that it
+ * can be memory-mapped and used without parsing or copying:
+ *
+ *   reqset_header
+ *   req_count reqset_request entries
+ *   header_count reqset_header_entry entries
+ *   feeder_count reqset_feeder entries
+ *   the string arena: URLs, names, payloads and headers
+ *
+ * Offsets are from the start of the file; strings are NUL-terminated.
+ * A payload file named by several requests is stored once, after the
+ * rest of the arena, and they all point at it; so is each CSV file
+ * that ${csv} placeholders read, after those, so that a set needs no
+ * other files to run.
+ * Each header is stored both split and pre-joined as "Name: value",
+ * ready to hand to libcurl. Integers are in native byte order.
+ */
+
+#define REQSET_MAGIC "WLREQSET"
+#define REQSET_VERSION 5
+
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t req_count;
+    uint64_t header_count;
+    uint64_t feeder_count;
+} reqset_header;
+
+typedef struct {
+    uint32_t method;
+    uint32_t num_headers;
+    uint64_t url;
+    uint64_t name;          /* 0 if the request has no name */
+    uint64_t payload;
+    uint64_t payload_length;
+    uint64_t first_header;  /* index of the request's first header */
+    double   weight;
+    uint64_t timeout;
+    uint16_t expect[EXPECT_MAX];
+} reqset_request;
+
+typedef struct {
+    uint64_t name;
+    uint64_t value;
+    uint64_t joined;
+} reqset_header_entry;
+
+typedef struct {
+    uint64_t path;
+    uint64_t data;
+    uint64_t length;
+} reqset_feeder;
+
+/**
+ * Return 1 if `filename` is a compiled request set.
+ */
+int reqset_detect(const char* filename);
+
+/**
+ * Write reqs to `filename` as a compiled request set.
+ * Return 1 on error or 0 on success.
+ */
+int reqset_write(const char* filename, requests reqs);
+
+/**
+ * Map a compiled request set. Exits on error.
+ */
+requests reqset_load(const char* filename);
+
+#endif
@@ -0,0 +1,352 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <argtable2.h>
+
+#include "main.h"
+#include "loader.h"
+#include "results.h"
+#include "histogram.h"
+#include "hash.h"
+
+#define CLI_ERR(msg) { fprintf(stderr, "%s\n", msg); exit(11); }
+
+/* groups only need a rough latency breakdown */
+#define GROUP_SIGFIGS 2
+
+typedef enum {
+    BY_NONE,
+    BY_URL,
+    BY_STATUS,
+    BY_SECOND
+} grouping;
+
+typedef struct {
+    unsigned long count;
+    unsigned long failures;
+    histogram     latency;
+} group;
+
+typedef struct {
+    const results_header*  header;
+    const results_request* reqs;
+    const results_record*  records;
+    unsigned long          record_count;
+    const char*            base;
+} results_file;
+
+/**
+ * Map a binary results file, and check its header. Exits on error.
+ */
+static results_file open_results(const char* filename)
+{
+    results_file rf;
+    struct stat st;
+    int fd;
+
+    if ((fd = open(filename, O_RDONLY)) < 0 || fstat(fd, &st) != 0) {
+        perror(filename);
+        exit(1);
+    }
+    if (st.st_size < (off_t)sizeof(results_header)) {
+        fprintf(stderr, "%s: too short to be a results file\n", filename);
+        exit(1);
+    }
+
+    rf.base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (rf.base == MAP_FAILED) {
+        perror(filename);
+        exit(1);
+    }
+
+    rf.header = (const results_header*)rf.base;
+    if (memcmp(rf.header->magic, RESULTS_MAGIC, sizeof(rf.header->magic)) != 0 ||
+            rf.header->version != RESULTS_VERSION ||
+            rf.header->record_size != sizeof(results_record) ||
+            rf.header->records_offset > (unsigned long)st.st_size ||
+            rf.header->records_offset < sizeof(results_header) ||
+            rf.header->req_count > (rf.header->records_offset - sizeof(results_header)) / sizeof(results_request)) {
+        fprintf(stderr, "%s: not a wideload results file (version %d)\n", filename, RESULTS_VERSION);
+        exit(1);
+    }
+
+    rf.reqs = (const results_request*)(rf.base + sizeof(results_header));
+    rf.records = (const results_record*)(rf.base + rf.header->records_offset);
+    // a crash may have left a partial last record; ignore it
+    rf.record_count = (st.st_size - rf.header->records_offset) / sizeof(results_record);
+
+    return rf;
+}
+
+static void print_csv(const results_file* rf, const results_record* rec)
+{
+    const results_request* req = &rf->reqs[rec->request];
+    unsigned long first_byte = rec->time_start + (rec->ttfb ? rec->ttfb : rec->total) * 1000UL;
+
+    printf("%s,%s,%.6f,%.6f,%.6f,%d,%lu,%.6f,%.3f,%.3f,%.3f,%.3f,%.3f,%u,%u,%d\n",
+           req->method == HTTP_GET ? "GET" : "POST",
+           rf->base + req->url_offset,
+           (rf->header->wall_offset + rec->time_start) / 1000000000.0,
+           (rf->header->wall_offset + first_byte) / 1000000000.0,
+           (rf->header->wall_offset + rec->time_start + rec->total * 1000UL) / 1000000000.0,
+           rec->status,
+           (unsigned long)rec->bytes_received,
+           (rf->header->wall_offset + rec->time_intended) / 1000000000.0,
+           rec->dns / 1000.0,
+           rec->connect / 1000.0,
+           rec->tls / 1000.0,
+           rec->pretransfer / 1000.0,
+           rec->ttfb / 1000.0,
+           rec->header_bytes,
+           rec->request_bytes,
+           rec->reused);
+}
+
+/**
+ * Return the group for `key`, growing the table as needed.
+ */
+static group* get_group(group** groups, unsigned long* ngroups, unsigned long key)
+{
+    unsigned long i, grown;
+
+    if (key >= *ngroups) {
+        grown = (key + 1 > *ngroups * 2 ? key + 1 : *ngroups * 2);
+        *groups = realloc(*groups, grown * sizeof(group));
+        for (i=*ngroups; i<grown; i++) {
+            (*groups)[i].count = 0;
+            (*groups)[i].failures = 0;
+            (*groups)[i].latency.counts = NULL;
+        }
+        *ngroups = grown;
+    }
+
+    if ((*groups)[key].latency.counts == NULL)
+        hist_init(&(*groups)[key].latency, LATENCY_HIGHEST, GROUP_SIGFIGS);
+    return &(*groups)[key];
+}
+
+/**
+ * Number the distinct URLs of the file's requests, so that requests
+ * with the same URL are grouped together: (*url_groups)[i] is request
+ * i's group, and (*group_reqs)[g] the first request in group g.
+ * Return the number of groups.
+ */
+static unsigned long number_urls(const results_file* rf, unsigned long** url_groups, unsigned long** group_reqs)
+{
+    unsigned long n = rf->header->req_count, size = hash_table_size(n);
+    unsigned long i, slot, ngroups = 0;
+    unsigned long* table = calloc(size, sizeof(unsigned long));  /* 1 + group, or 0 if free */
+    const char* url;
+
+    *url_groups = malloc(n * sizeof(unsigned long));
+    *group_reqs = malloc(n * sizeof(unsigned long));
+    if (table == NULL || (n > 0 && (*url_groups == NULL || *group_reqs == NULL))) {
+        fprintf(stderr, "Could not allocate groups\n");
+        exit(2);
+    }
+
+    for (i=0; i<n; i++) {
+        url = rf->base + rf->reqs[i].url_offset;
+        slot = hash_string(HASH_START, url) & (size - 1);
+        while (table[slot] != 0 && strcmp(rf->base + rf->reqs[(*group_reqs)[table[slot] - 1]].url_offset, url) != 0)
+            slot = (slot + 1) & (size - 1);
+        if (table[slot] == 0) {
+            (*group_reqs)[ngroups] = i;
+            table[slot] = ++ngroups;
+        }
+        (*url_groups)[i] = table[slot] - 1;
+    }
+
+    free(table);
+    return ngroups;
+}
+
+static void print_group(const char* label, const group* g, double seconds)
+{
+    printf("%-50s %10lu %10.1f %8lu %9.3f %9.3f %9.3f\n",
+           label,
+           g->count,
+           seconds > 0 ? g->count / seconds : 0,
+           g->failures,
+           hist_percentile(&g->latency, 50) / 1000.0,
+           hist_percentile(&g->latency, 99) / 1000.0,
+           g->latency.max / 1000.0);
+}
+
+/**
+ * Return 1 if the record is a failure: a status its request doesn't
+ * expect, or if it has no expected statuses, one of at least
+ * `failing`, as wideload judged it.
+ */
+static int record_failed(const results_file* rf, const results_record* rec, unsigned long failing)
+{
+    const results_request* req = &rf->reqs[rec->request];
+    int i;
+
+    if (req->expect[0] == 0)
+        return (rec->status >= failing);
+    for (i=0; i<EXPECT_MAX && req->expect[i]!=0; i++)
+        if (rec->status == req->expect[i])
+            return 0;
+    return 1;
+}
+
+int main(int argc, char* argv[])
+{
+    struct arg_lit* help = arg_lit0("h", "help", "Displays this help message");
+    struct arg_lit* csv = arg_lit0(NULL, "csv", "Convert the matching results to CSV on stdout");
+    struct arg_str* by = arg_str0(NULL, "by", "KEY", "Aggregate the matching results by url, status or second");
+    struct arg_str* url = arg_str0(NULL, "url", "TEXT", "Only results whose URL contains TEXT");
+    struct arg_str* status = arg_str0(NULL, "status", "CODE", "Only results with status CODE, or a class like 5xx");
+    struct arg_dbl* from = arg_dbl0(NULL, "from", "S", "Only results started at least S seconds into the run");
+    struct arg_dbl* to = arg_dbl0(NULL, "to", "S", "Only results started before S seconds into the run");
+    struct arg_int* fail_status = arg_int0("t", "fail-status", "N", "HTTP status code greater than which to consider requests failed, unless their URLs file entry lists its expect_status [400]");
+    struct arg_file* filename = arg_file0(NULL, NULL, "RESULTS_FILE", "Binary results written by wideload --binary");
+    struct arg_end* end = arg_end(20);
+
+    void* argtable[] = { help, csv, by, url, status, from, to, fail_status, filename, end };
+
+    results_file rf;
+    grouping grouped = BY_NONE;
+    group* groups = NULL;
+    group overall;
+    unsigned long ngroups = 0;
+    unsigned long* url_groups = NULL;
+    unsigned long* group_reqs = NULL;
+    unsigned long i, key, failing;
+    unsigned long lo = 0, hi = (unsigned long)-1, first = (unsigned long)-1, last = 0;
+    int want_status = -1, want_class = -1;
+    char* matches = NULL;
+    char label[64];
+
+    if (arg_nullcheck(argtable) != 0) {
+        fprintf(stderr, "Memory error parsing command line options\n");
+        exit(10);
+    }
+    if (arg_parse(argc, argv, argtable) != 0) {
+        arg_print_errors(stderr, end, "wideload-results");
+        exit(10);
+    }
+    if (help->count > 0) {
+        fprintf(stdout, "wideload-results");
+        arg_print_syntax(stdout, argtable, "\n\n");
+        fprintf(stdout, "OPTIONS:\n");
+        arg_print_glossary(stdout, argtable, "  %-25s %s\n");
+        exit(0);
+    }
+
+    if (filename->count != 1)
+        CLI_ERR("RESULTS_FILE is required");
+    if (by->count > 0) {
+        if (strcmp(by->sval[0], "url") == 0)
+            grouped = BY_URL;
+        else if (strcmp(by->sval[0], "status") == 0)
+            grouped = BY_STATUS;
+        else if (strcmp(by->sval[0], "second") == 0)
+            grouped = BY_SECOND;
+        else
+            CLI_ERR("--by must be one of: url, status, second");
+    }
+    if (csv->count > 0 && grouped != BY_NONE)
+        CLI_ERR("cannot specify both --csv and --by");
+    if (status->count > 0) {
+        // "5xx" selects a class, anything else an exact status
+        if (strlen(status->sval[0]) == 3 && strcmp(status->sval[0] + 1, "xx") == 0)
+            want_class = status->sval[0][0] - '0';
+        else
+            want_status = strtol(status->sval[0], NULL, 10);
+    }
+    failing = (fail_status->count > 0 ? fail_status->ival[0] : 400);
+
+    rf = open_results(filename->filename[0]);
+    if (from->count > 0)
+        lo = rf.header->run_start + (unsigned long)(from->dval[0] * 1000000000.0);
+    if (to->count > 0)
+        hi = rf.header->run_start + (unsigned long)(to->dval[0] * 1000000000.0);
+
+    // match URLs once per request, rather than once per record
+    if (url->count > 0) {
+        matches = malloc(rf.header->req_count);
+        for (i=0; i<rf.header->req_count; i++)
+            matches[i] = (strstr(rf.base + rf.reqs[i].url_offset, url->sval[0]) != NULL);
+    }
+    // and group them by URL, not by entry: a big URLs file can repeat
+    // a few URLs many times over
+    if (grouped == BY_URL)
+        number_urls(&rf, &url_groups, &group_reqs);
+
+    overall.count = 0;
+    overall.failures = 0;
+    hist_init(&overall.latency, LATENCY_HIGHEST, LATENCY_SIGFIGS);
+
+    if (csv->count > 0)
+        fputs(RESULTS_CSV_HEADER, stdout);
+
+    for (i=0; i<rf.record_count; i++) {
+        const results_record* rec = &rf.records[i];
+        group* g = &overall;
+
+        if (rec->request >= rf.header->req_count)
+            continue;
+        if (matches != NULL && !matches[rec->request])
+            continue;
+        if (want_status >= 0 && rec->status != want_status)
+            continue;
+        if (want_class >= 0 && rec->status / 100 != want_class)
+            continue;
+        if (rec->time_start < lo || rec->time_start >= hi)
+            continue;
+
+        if (csv->count > 0) {
+            print_csv(&rf, rec);
+            continue;
+        }
+
+        if (rec->time_start < first)
+            first = rec->time_start;
+        if (rec->time_start > last)
+            last = rec->time_start;
+
+        if (grouped != BY_NONE) {
+            if (grouped == BY_URL)
+                key = url_groups[rec->request];
+            else if (grouped == BY_STATUS)
+                key = rec->status;
+            else
+                key = (rec->time_start - rf.header->run_start) / 1000000000;
+            g = get_group(&groups, &ngroups, key);
+        }
+
+        g->count++;
+        if (record_failed(&rf, rec, failing))
+            g->failures++;
+        else
+            hist_record(&g->latency, rec->total);
+    }
+
+    if (csv->count > 0)
+        return 0;
+
+    printf("%-50s %10s %10s %8s %9s %9s %9s\n", "", "requests", "req/s", "failures", "p50 ms", "p99 ms", "max ms");
+    if (grouped == BY_NONE) {
+        print_group("all", &overall, (last - first) / 1000000000.0);
+    } else {
+        for (i=0; i<ngroups; i++) {
+            if (groups[i].count == 0)
+                continue;
+            if (grouped == BY_URL)
+                print_group(rf.base + rf.reqs[group_reqs[i]].url_offset, &groups[i], (last - first) / 1000000000.0);
+            else {
+                snprintf(label, sizeof(label), grouped == BY_STATUS ? "%lu" : "%lus", i);
+                print_group(label, &groups[i], grouped == BY_SECOND ? 1.0 : (last - first) / 1000000000.0);
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,74 @@
+#ifndef WIDELOAD_RESULTS_H
+#define WIDELOAD_RESULTS_H
+
+#include <stdint.h>
+
+#include "loader.h"
+
+/*
+ * Binary detailed results. The file is laid out as:
+ *
+ *   results_header
+ *   req_count results_request entries
+ *   the request URLs, each NUL-terminated
+ *   padding to records_offset
+ *   results_record entries, until the end of the file
+ *
+ * so that it can be memory-mapped and the records used in place.
+ * The number of records is implied by the file size, so a file
+ * cut short by a crash is still readable up to its last whole
+ * record. All integers are in the writer's native byte order.
+ */
+
+#define RESULTS_MAGIC "WIDELOAD"
+#define RESULTS_VERSION 2
+
+/* shared by the CSV writer and wideload-results */
+#define RESULTS_CSV_HEADER "method,url,time_start,time_first_byte,time_finish,status,bytes_received,time_intended," \
+                           "dns_ms,connect_ms,tls_ms,pretransfer_ms,ttfb_ms,header_bytes,request_bytes,reused\n"
+
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t record_size;
+
+    /* add to a monotonic time to get nanos since the epoch */
+    uint64_t wall_offset;
+    /* monotonic nanos when the run started */
+    uint64_t run_start;
+
+    uint64_t req_count;
+    uint64_t records_offset;
+} results_header;
+
+typedef struct {
+    uint32_t method;      /* an http_method */
+    uint32_t url_length;
+    uint64_t url_offset;  /* from the start of the file */
+    uint16_t expect[EXPECT_MAX];  /* the statuses it succeeds with, or
+                                     0 to judge it by --fail-status */
+} results_request;
+
+typedef struct {
+    uint64_t time_start;     /* monotonic nanos */
+    uint64_t time_intended;  /* monotonic nanos */
+
+    uint32_t request;        /* index into the request table */
+    uint16_t status;
+    uint8_t  reused;
+    uint8_t  reserved;
+
+    /* when each phase finished, in micros after time_start */
+    uint32_t dns;
+    uint32_t connect;
+    uint32_t tls;
+    uint32_t pretransfer;
+    uint32_t ttfb;
+    uint32_t total;
+
+    uint64_t bytes_received;
+    uint32_t header_bytes;
+    uint32_t request_bytes;
+} results_record;
+
+#endif
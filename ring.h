@@ -0,0 +1,63 @@
+#ifndef WIDELOAD_RING_H
+#define WIDELOAD_RING_H
+
+#include <stdlib.h>
+
+/**
+ * A bounded, lock-free queue of pointers between exactly one
+ * producer thread and one consumer thread.
+ */
+typedef struct {
+    void**        slots;
+    unsigned long mask;  /* size - 1; size is a power of two */
+    unsigned long head;  /* next slot to fill, owned by the producer */
+    unsigned long tail;  /* next slot to drain, owned by the consumer */
+} ring;
+
+/**
+ * Set up a ring with room for `size` (a power of two) entries.
+ * Return 1 on error or 0 on success.
+ */
+static inline int ring_init(ring* rg, unsigned long size)
+{
+    rg->slots = calloc(size, sizeof(void*));
+    rg->mask = size - 1;
+    rg->head = 0;
+    rg->tail = 0;
+    return rg->slots == NULL;
+}
+
+static inline void ring_free(ring* rg)
+{
+    free(rg->slots);
+    rg->slots = NULL;
+}
+
+/**
+ * Add an entry; return 0 if the ring was full.
+ */
+static inline int ring_push(ring* rg, void* item)
+{
+    unsigned long head = rg->head;
+    if (head - __atomic_load_n(&rg->tail, __ATOMIC_ACQUIRE) > rg->mask)
+        return 0;
+    rg->slots[head & rg->mask] = item;
+    __atomic_store_n(&rg->head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/**
+ * Remove and return the oldest entry, or NULL if the ring was empty.
+ */
+static inline void* ring_pop(ring* rg)
+{
+    unsigned long tail = rg->tail;
+    void* item;
+    if (tail == __atomic_load_n(&rg->head, __ATOMIC_ACQUIRE))
+        return NULL;
+    item = rg->slots[tail & rg->mask];
+    __atomic_store_n(&rg->tail, tail + 1, __ATOMIC_RELEASE);
+    return item;
+}
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef WIDELOAD_RNG_H
+#define WIDELOAD_RNG_H
+
+#include <stdint.h>
+
+/**
+ * A small, fast pseudo-random generator (xoshiro256**), one per
+ * thread, so that drawing numbers needs no locking and a run can
+ * be repeated exactly from its seed.
+ */
+typedef struct {
+    uint64_t s[4];
+} rng;
+
+static inline uint64_t rng_rotl(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+/**
+ * Seed the generator; different seeds give unrelated sequences.
+ */
+static inline void rng_seed(rng* r, uint64_t seed)
+{
+    int i;
+
+    // expand the seed with splitmix64, as xoshiro's authors advise
+    for (i=0; i<4; i++) {
+        uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        r->s[i] = z ^ (z >> 31);
+    }
+}
+
+/**
+ * Return 64 random bits.
+ */
+static inline uint64_t rng_next(rng* r)
+{
+    uint64_t* s = r->s;
+    uint64_t result = rng_rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rng_rotl(s[3], 45);
+
+    return result;
+}
+
+/**
+ * Return a number uniformly distributed in (0, 1].
+ */
+static inline double rng_double(rng* r)
+{
+    return ((rng_next(r) >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * Return a number uniformly distributed in [0, n).
+ */
+static inline unsigned long rng_below(rng* r, unsigned long n)
+{
+    return (unsigned long)(((unsigned __int128)rng_next(r) * n) >> 64);
+}
+
+#endif
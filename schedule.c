@@ -0,0 +1,97 @@
+#include <stdlib.h>
+#include <math.h>
+
+#include "timing.h"
+#include "schedule.h"
+
+/* how finely a profiled rate is integrated (ns) */
+#define SCHEDULE_STEP 10000000UL
+
+/**
+ * Start a schedule of `rate` requests per second, from now.
+ */
+void schedule_init(schedule* sched, double rate, char poisson)
+{
+    sched->next = nanos();
+    sched->interval = 1e9 / rate;
+    sched->poisson = poisson;
+    sched->prof = NULL;
+}
+
+/**
+ * Change to `rate` requests per second, starting afresh from now,
+ * so that any backlog at the old rate is forgotten.
+ */
+void schedule_set_rate(schedule* sched, double rate)
+{
+    double interval = 1e9 / rate;
+
+    __atomic_store(&sched->interval, &interval, __ATOMIC_RELAXED);
+    __atomic_store_n(&sched->next, nanos(), __ATOMIC_RELAXED);
+}
+
+/**
+ * Return how long after t the next request is due, when the rate
+ * follows a profile and `need` requests' worth of time must pass
+ * (1, or an exponential variate for a Poisson process). Where the
+ * rate is too low for a request within SCHEDULE_STEP, the rate is
+ * integrated a step at a time, so a ramp up from nothing doesn't
+ * leave a long gap behind it.
+ */
+static unsigned long profile_gap(const profile* prof, unsigned long t, double need)
+{
+    unsigned long gap = 0;
+    unsigned long end = prof->start + prof->length;
+    double rate;
+
+    while (t + gap < end) {
+        rate = profile_value(prof, t + gap);
+        if (rate > 0 && need / rate * 1e9 <= SCHEDULE_STEP)
+            return gap + (unsigned long)(need / rate * 1e9);
+        gap += SCHEDULE_STEP;
+        need -= rate * SCHEDULE_STEP / 1e9;
+        if (need <= 0)
+            return gap;
+    }
+
+    // nothing more is due; the run ends here
+    return (end > t ? end - t : 0) + SCHEDULE_STEP;
+}
+
+/**
+ * Claim the next request, and return its intended start time.
+ */
+unsigned long schedule_claim(schedule* sched, rng* r)
+{
+    unsigned long step, t;
+    double need, interval;
+
+    if (sched->prof != NULL) {
+        need = (sched->poisson ? -log(rng_double(r)) : 1.0);
+        t = __atomic_load_n(&sched->next, __ATOMIC_RELAXED);
+        // the gap depends on when it starts, so claim it by CAS
+        while (!__atomic_compare_exchange_n(&sched->next, &t, t + profile_gap(sched->prof, t, need), 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            ;
+        return t;
+    }
+
+    __atomic_load(&sched->interval, &interval, __ATOMIC_RELAXED);
+    if (sched->poisson) {
+        // exponentially distributed gaps make a Poisson process;
+        // the sum of each thread's claims is still one
+        step = (unsigned long)(-log(rng_double(r)) * interval);
+    } else {
+        step = (unsigned long)interval;
+    }
+
+    return __atomic_fetch_add(&sched->next, step, __ATOMIC_RELAXED);
+}
+
+/**
+ * Return the intended start time of the next request, without
+ * claiming it.
+ */
+unsigned long schedule_peek(schedule* sched)
+{
+    return __atomic_load_n(&sched->next, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,45 @@
+#ifndef WIDELOAD_SCHEDULE_H
+#define WIDELOAD_SCHEDULE_H
+
+#include "rng.h"
+#include "profile.h"
+
+/**
+ * An open-loop arrival schedule, shared by all worker threads.
+ *
+ * Each call to schedule_claim() hands out the intended start time
+ * of the next request, whether or not the previous ones finished.
+ * Times are monotonic nanos (see timing.h).
+ */
+typedef struct {
+    unsigned long next;      /* intended time of the next request (ns) */
+    double        interval;  /* mean nanoseconds between requests */
+    char          poisson;   /* exponential rather than fixed intervals */
+
+    /* if set, the rate follows this profile instead of `interval` */
+    const profile* prof;
+} schedule;
+
+/**
+ * Start a schedule of `rate` requests per second, from now.
+ */
+void schedule_init(schedule* sched, double rate, char poisson);
+
+/**
+ * Change to `rate` requests per second, starting afresh from now,
+ * so that any backlog at the old rate is forgotten.
+ */
+void schedule_set_rate(schedule* sched, double rate);
+
+/**
+ * Claim the next request, and return its intended start time.
+ */
+unsigned long schedule_claim(schedule* sched, rng* r);
+
+/**
+ * Return the intended start time of the next request, without
+ * claiming it.
+ */
+unsigned long schedule_peek(schedule* sched);
+
+#endif
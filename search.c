@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "search.h"
+
+/* stop narrowing once the bracket is this tight, relative to its bottom */
+#define SEARCH_PRECISION 0.05
+
+/**
+ * Sleep until the monotonic time `until`, or until the run is stopped.
+ * Return 1 if it was stopped.
+ */
+static int sleep_until(unsigned long until)
+{
+    struct timespec tick = {0, 50000000};
+    unsigned long now;
+
+    while ((now = nanos()) < until) {
+        if (__atomic_load_n(&stopping, __ATOMIC_RELAXED))
+            return 1;
+        if (until - now < 50000000)
+            tick.tv_nsec = until - now;
+        nanosleep(&tick, NULL);
+    }
+    return __atomic_load_n(&stopping, __ATOMIC_RELAXED);
+}
+
+/**
+ * Merge every worker's stats into `into`.
+ */
+static void snapshot(stats* into, threadstate* states, unsigned long nthreads)
+{
+    unsigned long i;
+
+    stats_clear(into);
+    for (i=0; i<nthreads; i++)
+        stats_merge(into, &states[i].stats);
+}
+
+/**
+ * Steer the running workers' shared schedule from probe to probe,
+ * doubling the rate from opts->rate until a probe misses the SLO,
+ * then bisecting; stop the workers when done.
+ */
+void search_run(search* srch, schedule* sched, threadstate* states, unsigned long nthreads, const options* opts)
+{
+    stats before, after, window;
+    double rate = opts->rate, lo = 0, hi = 0;
+    unsigned long settle, measure, start;
+    probe* pr;
+
+    if (stats_init(&before) || stats_init(&after) || stats_init(&window)) {
+        fprintf(stderr, "Could not allocate statistics\n");
+        exit(2);
+    }
+
+    // the first part of each probe lets the last one's backlog
+    // drain, and isn't counted
+    settle = opts->probe_seconds * 1000000000UL / 5;
+    measure = opts->probe_seconds * 1000000000UL - settle;
+
+    srch->count = 0;
+    srch->best = -1;
+    while (srch->count < SEARCH_MAX_PROBES) {
+        pr = &srch->probes[srch->count];
+        pr->rate = rate;
+
+        schedule_set_rate(sched, rate);
+        start = nanos();
+        if (sleep_until(start + settle))
+            break;
+        snapshot(&before, states, nthreads);
+        if (sleep_until(start + settle + measure))
+            break;
+        snapshot(&after, states, nthreads);
+        stats_diff(&window, &after, &before);
+
+        pr->requests = window.requests;
+        pr->achieved = window.requests / (measure / 1000000000.0);
+        pr->failed = (window.requests ? 100.0 * window.failures / window.requests : 0);
+        pr->p50 = hist_percentile(&window.corrected, 50);
+        pr->p99 = hist_percentile(&window.corrected, 99);
+        // a server that can't keep up also shows as a shortfall, even
+        // before latency or failures give it away
+        pr->passed = (window.requests > 0 &&
+                      pr->p99 <= opts->slo_p99 * 1000 &&
+                      pr->failed <= opts->max_failures &&
+                      pr->achieved >= rate * (1 - SEARCH_PRECISION));
+        fprintf(stderr, "probe %2lu: %9.1f req/s asked, %9.1f done, p99 %.3f ms, %.2f%% failed: %s\n",
+                srch->count + 1, rate, pr->achieved, pr->p99 / 1000.0, pr->failed, pr->passed ? "pass" : "fail");
+
+        if (pr->passed) {
+            lo = rate;
+            if (srch->best < 0 || rate > srch->probes[srch->best].rate)
+                srch->best = srch->count;
+        } else {
+            hi = rate;
+        }
+        srch->count++;
+
+        // double until something fails, then bisect
+        if (hi == 0)
+            rate = lo * 2;
+        else if (hi - lo <= lo * SEARCH_PRECISION || hi - lo < 1)
+            break;
+        else
+            rate = (lo + hi) / 2;
+    }
+
+    stats_free(&before);
+    stats_free(&after);
+    stats_free(&window);
+
+    __atomic_store_n(&stopping, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Print the throughput and latency of every probe, and the result.
+ */
+void search_print(const search* srch, const options* opts)
+{
+    unsigned long i;
+    const probe* pr;
+
+    printf("Capacity search (p99 <= %lu ms, failures <= %g%%)\n", opts->slo_p99, opts->max_failures);
+    printf("Probe      asked      done   requests      p50      p99  failed\n");
+    for (i=0; i<srch->count; i++) {
+        pr = &srch->probes[i];
+        printf(" %3lu  %9.1f %9.1f %10lu %8.3f %8.3f %6.2f%%  %s\n",
+               i + 1, pr->rate, pr->achieved, pr->requests,
+               pr->p50 / 1000.0, pr->p99 / 1000.0, pr->failed,
+               pr->passed ? "pass" : "fail");
+    }
+    if (srch->best >= 0) {
+        pr = &srch->probes[srch->best];
+        printf("Highest sustainable rate: %.1f req/s (p99 %.3f ms, %.2f%% failed)\n",
+               pr->rate, pr->p99 / 1000.0, pr->failed);
+    } else {
+        printf("No probe met the target\n");
+    }
+    printf("\n");
+}
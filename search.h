@@ -0,0 +1,45 @@
+#ifndef WIDELOAD_SEARCH_H
+#define WIDELOAD_SEARCH_H
+
+#include "loader.h"
+#include "schedule.h"
+
+/* give up narrowing the search after this many probes */
+#define SEARCH_MAX_PROBES 20
+
+/**
+ * What one probe of a --search saw, once it had settled.
+ */
+typedef struct {
+    double        rate;      /* requests per second asked for */
+    double        achieved;  /* and completed */
+    unsigned long requests;
+    double        failed;    /* percent */
+    unsigned long p50;       /* micros, from intended start */
+    unsigned long p99;
+    char          passed;
+} probe;
+
+/**
+ * The outcome of a --search: every probe, in the order they ran,
+ * and the highest rate which passed (0 if none did).
+ */
+typedef struct {
+    probe         probes[SEARCH_MAX_PROBES];
+    unsigned long count;
+    long          best;      /* index of the best passing probe, or -1 */
+} search;
+
+/**
+ * Steer the running workers' shared schedule from probe to probe,
+ * doubling the rate from opts->rate until a probe misses the SLO,
+ * then bisecting; stop the workers when done.
+ */
+void search_run(search* srch, schedule* sched, threadstate* states, unsigned long nthreads, const options* opts);
+
+/**
+ * Print the throughput and latency of every probe, and the result.
+ */
+void search_print(const search* srch, const options* opts);
+
+#endif
@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <pthread.h>
+
+#include "share.h"
+
+static CURLSH* share = NULL;
+static pthread_mutex_t locks[CURL_LOCK_DATA_LAST];
+
+/**
+ * Called by libcurl around each use of the shared data; each kind
+ * of data has a lock of its own.
+ */
+static void on_lock(CURL* handle, curl_lock_data data, curl_lock_access access, void* userp)
+{
+    pthread_mutex_lock(&locks[data]);
+}
+
+static void on_unlock(CURL* handle, curl_lock_data data, void* userp)
+{
+    pthread_mutex_unlock(&locks[data]);
+}
+
+/**
+ * Create the share. Return 1 on error or 0 on success.
+ */
+int share_init()
+{
+    int i;
+
+    if ((share = curl_share_init()) == NULL) {
+        fprintf(stderr, "Could not create the libcurl share\n");
+        return 1;
+    }
+    for (i=0; i<CURL_LOCK_DATA_LAST; i++)
+        pthread_mutex_init(&locks[i], NULL);
+
+    curl_share_setopt(share, CURLSHOPT_LOCKFUNC, on_lock);
+    curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, on_unlock);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    return 0;
+}
+
+/**
+ * Have the handle use the share, if there is one.
+ */
+void share_attach(CURL* handle)
+{
+    if (share != NULL)
+        curl_easy_setopt(handle, CURLOPT_SHARE, share);
+}
+
+/**
+ * Free the share, once every handle using it has been cleaned up.
+ */
+void share_free()
+{
+    int i;
+
+    if (share == NULL)
+        return;
+    curl_share_cleanup(share);
+    share = NULL;
+    for (i=0; i<CURL_LOCK_DATA_LAST; i++)
+        pthread_mutex_destroy(&locks[i]);
+}
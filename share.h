@@ -0,0 +1,29 @@
+#ifndef WIDELOAD_SHARE_H
+#define WIDELOAD_SHARE_H
+
+#include <curl/curl.h>
+
+/*
+ * One libcurl share for the whole run, holding the DNS cache and TLS
+ * sessions, so that a handle replaced after a timeout (or a new
+ * connection on any worker) neither resolves the host again nor does
+ * a full TLS handshake. Connections themselves aren't shared: libcurl
+ * doesn't support sharing them between concurrent threads.
+ */
+
+/**
+ * Create the share. Return 1 on error or 0 on success.
+ */
+int share_init();
+
+/**
+ * Have the handle use the share, if there is one.
+ */
+void share_attach(CURL* handle);
+
+/**
+ * Free the share, once every handle using it has been cleaned up.
+ */
+void share_free();
+
+#endif
@@ -0,0 +1,117 @@
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "standby.h"
+
+void standby_init(standby* sb)
+{
+    memset(sb, 0, sizeof(standby));
+    sb->fd = -1;
+}
+
+/**
+ * Called by libcurl to open each socket; hands over the standby if
+ * it's connected to the address wanted.
+ */
+static curl_socket_t on_opensocket(void* clientp, curlsocktype purpose, struct curl_sockaddr* address)
+{
+    standby* sb = (standby*)clientp;
+    curl_socket_t fd;
+
+    if (sb->fd >= 0 && purpose == CURLSOCKTYPE_IPCXN && address->addrlen == sb->addrlen &&
+            memcmp(&address->addr, &sb->addr, sb->addrlen) == 0) {
+        fd = sb->fd;
+        sb->fd = -1;
+        sb->handed = 1;
+        return fd;
+    }
+    return socket(address->family, address->socktype, address->protocol);
+}
+
+/**
+ * Called by libcurl once it has set a socket up; tells it not to
+ * connect a standby, which already is.
+ */
+static int on_sockopt(void* clientp, curl_socket_t fd, curlsocktype purpose)
+{
+    standby* sb = (standby*)clientp;
+
+    if (sb->handed) {
+        sb->handed = 0;
+        return CURL_SOCKOPT_ALREADY_CONNECTED;
+    }
+    return CURL_SOCKOPT_OK;
+}
+
+/**
+ * Have the handle take its next connection from the standby when
+ * it can.
+ */
+void standby_attach(standby* sb, CURL* handle)
+{
+    curl_easy_setopt(handle, CURLOPT_OPENSOCKETFUNCTION, on_opensocket);
+    curl_easy_setopt(handle, CURLOPT_OPENSOCKETDATA, sb);
+    curl_easy_setopt(handle, CURLOPT_SOCKOPTFUNCTION, on_sockopt);
+    curl_easy_setopt(handle, CURLOPT_SOCKOPTDATA, sb);
+}
+
+/**
+ * Connect a standby socket to the server the handle's last transfer
+ * used, waiting at most timeout_ms. Return 1 on error or 0 on success.
+ */
+int standby_open(standby* sb, CURL* handle, unsigned long timeout_ms)
+{
+    struct sockaddr_in* v4 = (struct sockaddr_in*)&sb->addr;
+    struct sockaddr_in6* v6 = (struct sockaddr_in6*)&sb->addr;
+    struct pollfd pfd;
+    char* ip = NULL;
+    long port = 0;
+    int err = 0;
+    socklen_t len = sizeof(err);
+
+    standby_close(sb);
+    if (curl_easy_getinfo(handle, CURLINFO_PRIMARY_IP, &ip) != CURLE_OK || ip == NULL || *ip == '\0' ||
+            curl_easy_getinfo(handle, CURLINFO_PRIMARY_PORT, &port) != CURLE_OK || port == 0)
+        return 1;
+
+    memset(&sb->addr, 0, sizeof(sb->addr));
+    if (inet_pton(AF_INET, ip, &v4->sin_addr) == 1) {
+        v4->sin_family = AF_INET;
+        v4->sin_port = htons(port);
+        sb->addrlen = sizeof(struct sockaddr_in);
+    } else if (inet_pton(AF_INET6, ip, &v6->sin6_addr) == 1) {
+        v6->sin6_family = AF_INET6;
+        v6->sin6_port = htons(port);
+        sb->addrlen = sizeof(struct sockaddr_in6);
+    } else {
+        return 1;
+    }
+
+    // connect without blocking, so that an unresponsive server
+    // costs at most the timeout
+    if ((sb->fd = socket(sb->addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK, IPPROTO_TCP)) < 0)
+        return 1;
+    if (connect(sb->fd, (struct sockaddr*)&sb->addr, sb->addrlen) != 0) {
+        pfd.fd = sb->fd;
+        pfd.events = POLLOUT;
+        if (errno != EINPROGRESS || poll(&pfd, 1, timeout_ms) != 1 ||
+                getsockopt(sb->fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0 || err != 0) {
+            standby_close(sb);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void standby_close(standby* sb)
+{
+    if (sb->fd >= 0)
+        close(sb->fd);
+    sb->fd = -1;
+    sb->handed = 0;
+}
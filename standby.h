@@ -0,0 +1,39 @@
+#ifndef WIDELOAD_STANDBY_H
+#define WIDELOAD_STANDBY_H
+
+#include <sys/socket.h>
+#include <curl/curl.h>
+
+/**
+ * With --standby, a connection opened in advance to replace one torn
+ * down after a timeout, so that the reconnect isn't timed as part of
+ * the next request. libcurl is handed the connected socket when it
+ * next connects to the same address.
+ */
+typedef struct {
+    int                     fd;      /* the standby socket, or -1 */
+    struct sockaddr_storage addr;
+    socklen_t               addrlen;
+    char                    handed;  /* fd was just given to libcurl */
+} standby;
+
+/* how long a standby may take to connect without --fail-after (ms) */
+#define STANDBY_TIMEOUT 1000
+
+void standby_init(standby* sb);
+
+/**
+ * Have the handle take its next connection from the standby when
+ * it can.
+ */
+void standby_attach(standby* sb, CURL* handle);
+
+/**
+ * Connect a standby socket to the server the handle's last transfer
+ * used, waiting at most timeout_ms. Return 1 on error or 0 on success.
+ */
+int standby_open(standby* sb, CURL* handle, unsigned long timeout_ms);
+
+void standby_close(standby* sb);
+
+#endif
@@ -0,0 +1,171 @@
+#include <stdlib.h>
+
+#include "loader.h"
+#include "stats.h"
+
+/* single-writer counter update, safe against concurrent readers */
+#define BUMP(counter, n) __atomic_store_n(&(counter), (counter) + (n), __ATOMIC_RELAXED)
+
+const char* phase_names[PHASE_COUNT] = {
+    "dns",
+    "connect",
+    "tls",
+    "server",
+    "transfer"
+};
+
+/**
+ * Set up an empty stats. Return 1 on error or 0 on success.
+ */
+int stats_init(stats* st)
+{
+    int i;
+
+    st->requests = 0;
+    st->failures = 0;
+    st->timeouts = 0;
+    st->bytes = 0;
+    st->bytes_sent = 0;
+    st->connects = 0;
+    st->late = 0;
+    st->max_late = 0;
+
+    if (hist_init(&st->latency, LATENCY_HIGHEST, LATENCY_SIGFIGS))
+        return 1;
+    if (hist_init(&st->corrected, LATENCY_HIGHEST, LATENCY_SIGFIGS))
+        return 1;
+    for (i=0; i<PHASE_COUNT; i++)
+        if (hist_init(&st->phases[i], LATENCY_HIGHEST, PHASE_SIGFIGS))
+            return 1;
+    return 0;
+}
+
+void stats_free(stats* st)
+{
+    int i;
+
+    hist_free(&st->latency);
+    hist_free(&st->corrected);
+    for (i=0; i<PHASE_COUNT; i++)
+        hist_free(&st->phases[i]);
+}
+
+/**
+ * Reset to an empty stats, keeping the allocated histograms.
+ */
+void stats_clear(stats* st)
+{
+    int i;
+
+    st->requests = 0;
+    st->failures = 0;
+    st->timeouts = 0;
+    st->bytes = 0;
+    st->bytes_sent = 0;
+    st->connects = 0;
+    st->late = 0;
+    st->max_late = 0;
+
+    hist_clear(&st->latency);
+    hist_clear(&st->corrected);
+    for (i=0; i<PHASE_COUNT; i++)
+        hist_clear(&st->phases[i]);
+}
+
+/**
+ * Return how long after it was due the result's request started,
+ * or 0 if it started early (as it can when a sleep is cut short).
+ */
+unsigned long result_lateness(const result* rslt)
+{
+    return (rslt->time_start > rslt->time_intended ? rslt->time_start - rslt->time_intended : 0);
+}
+
+/**
+ * Count a completed result.
+ */
+void stats_record(stats* st, const result* rslt, const options* opts)
+{
+    unsigned long lateness = result_lateness(rslt);
+
+    BUMP(st->requests, 1);
+    BUMP(st->bytes, rslt->num_bytes);
+    BUMP(st->bytes_sent, rslt->request_bytes);
+    if (rslt->status == 598)
+        BUMP(st->timeouts, 1);
+
+    if (!rslt->reused) {
+        BUMP(st->connects, 1);
+        hist_record(&st->phases[PHASE_DNS], rslt->time_dns / 1000);
+        if (rslt->time_connect >= rslt->time_dns)
+            hist_record(&st->phases[PHASE_CONNECT], (rslt->time_connect - rslt->time_dns) / 1000);
+        if (rslt->time_tls >= rslt->time_connect)
+            hist_record(&st->phases[PHASE_TLS], (rslt->time_tls - rslt->time_connect) / 1000);
+    }
+    if (rslt->time_ttfb > 0 && rslt->time_ttfb >= rslt->time_pretransfer) {
+        // server time runs from the request being sent to the
+        // first byte of the response; transfer is the rest
+        hist_record(&st->phases[PHASE_SERVER], (rslt->time_ttfb - rslt->time_pretransfer) / 1000);
+        if (rslt->time_end - rslt->time_start >= rslt->time_ttfb)
+            hist_record(&st->phases[PHASE_TRANSFER], (rslt->time_end - rslt->time_start - rslt->time_ttfb) / 1000);
+    }
+
+    if (lateness > 1000000)
+        BUMP(st->late, 1);
+    if (lateness > st->max_late)
+        __atomic_store_n(&st->max_late, lateness, __ATOMIC_RELAXED);
+
+    if (result_failed(rslt, opts)) {
+        BUMP(st->failures, 1);
+    } else {
+        hist_record(&st->latency, (rslt->time_end - rslt->time_start) / 1000);
+        hist_record(&st->corrected, (rslt->time_end - rslt->time_start + lateness) / 1000);
+    }
+}
+
+/**
+ * Add all of `from`'s totals into `into`.
+ */
+void stats_merge(stats* into, const stats* from)
+{
+    int i;
+
+    into->requests += __atomic_load_n(&from->requests, __ATOMIC_RELAXED);
+    into->failures += __atomic_load_n(&from->failures, __ATOMIC_RELAXED);
+    into->timeouts += __atomic_load_n(&from->timeouts, __ATOMIC_RELAXED);
+    into->bytes += __atomic_load_n(&from->bytes, __ATOMIC_RELAXED);
+    into->bytes_sent += __atomic_load_n(&from->bytes_sent, __ATOMIC_RELAXED);
+    into->connects += __atomic_load_n(&from->connects, __ATOMIC_RELAXED);
+    into->late += __atomic_load_n(&from->late, __ATOMIC_RELAXED);
+    if (from->max_late > into->max_late)
+        into->max_late = from->max_late;
+
+    hist_merge(&into->latency, &from->latency);
+    hist_merge(&into->corrected, &from->corrected);
+    for (i=0; i<PHASE_COUNT; i++)
+        hist_merge(&into->phases[i], &from->phases[i]);
+}
+
+/**
+ * Set `out` to what was counted in `cur` but not `prev`, where
+ * `prev` is an earlier merged copy of the same stats. The most
+ * late a request started can't be split, so `out` keeps cur's.
+ */
+void stats_diff(stats* out, const stats* cur, const stats* prev)
+{
+    int i;
+
+    out->requests = cur->requests - prev->requests;
+    out->failures = cur->failures - prev->failures;
+    out->timeouts = cur->timeouts - prev->timeouts;
+    out->bytes = cur->bytes - prev->bytes;
+    out->bytes_sent = cur->bytes_sent - prev->bytes_sent;
+    out->connects = cur->connects - prev->connects;
+    out->late = cur->late - prev->late;
+    out->max_late = cur->max_late;
+
+    hist_diff(&out->latency, &cur->latency, &prev->latency);
+    hist_diff(&out->corrected, &cur->corrected, &prev->corrected);
+    for (i=0; i<PHASE_COUNT; i++)
+        hist_diff(&out->phases[i], &cur->phases[i], &prev->phases[i]);
+}
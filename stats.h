@@ -0,0 +1,90 @@
+#ifndef WIDELOAD_STATS_H
+#define WIDELOAD_STATS_H
+
+#include "cli.h"
+#include "histogram.h"
+
+/* latencies are recorded in micros, up to an hour, to 3 digits,
+   though results are timed in nanos */
+#define LATENCY_HIGHEST 3600000000UL
+#define LATENCY_SIGFIGS 3
+
+/* phase breakdowns need less precision, and there are more of them */
+#define PHASE_SIGFIGS 2
+
+typedef enum {
+    PHASE_DNS,
+    PHASE_CONNECT,
+    PHASE_TLS,
+    PHASE_SERVER,
+    PHASE_TRANSFER,
+    PHASE_COUNT
+} phase;
+
+extern const char* phase_names[PHASE_COUNT];
+
+struct _result;
+
+/**
+ * Running totals for a worker thread. Only the owning thread
+ * records into a stats; any thread may read it.
+ */
+typedef struct {
+    unsigned long requests;
+    unsigned long failures;
+    unsigned long timeouts;
+    unsigned long bytes;
+    unsigned long bytes_sent;
+
+    /* requests which had to open a new connection */
+    unsigned long connects;
+
+    /* requests which started more than 1ms after they were due */
+    unsigned long late;
+    unsigned long max_late;
+
+    /* successful requests, from their actual and intended start */
+    histogram     latency;
+    histogram     corrected;
+
+    /* every request, by phase; connection phases only count
+       requests which opened a new connection */
+    histogram     phases[PHASE_COUNT];
+} stats;
+
+/**
+ * Set up an empty stats. Return 1 on error or 0 on success.
+ */
+int stats_init(stats* st);
+
+void stats_free(stats* st);
+
+/**
+ * Reset to an empty stats, keeping the allocated histograms.
+ */
+void stats_clear(stats* st);
+
+/**
+ * Return how long after it was due the result's request started,
+ * or 0 if it started early (as it can when a sleep is cut short).
+ */
+unsigned long result_lateness(const struct _result* rslt);
+
+/**
+ * Count a completed result.
+ */
+void stats_record(stats* st, const struct _result* rslt, const options* opts);
+
+/**
+ * Add all of `from`'s totals into `into`.
+ */
+void stats_merge(stats* into, const stats* from);
+
+/**
+ * Set `out` to what was counted in `cur` but not `prev`, where
+ * `prev` is an earlier merged copy of the same stats. The most
+ * late a request started can't be split, so `out` keeps cur's.
+ */
+void stats_diff(stats* out, const stats* cur, const stats* prev);
+
+#endif
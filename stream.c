@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+
+#include "stream.h"
+#include "urlfile.h"
+#include "template.h"
+
+/**
+ * Drop n references to the chunk, freeing it with the last one.
+ */
+static void chunk_unref(stream_chunk* chunk, unsigned long n)
+{
+    unsigned long i;
+
+    if (__atomic_sub_fetch(&chunk->refs, n, __ATOMIC_ACQ_REL) != 0)
+        return;
+
+    for (i=0; i<chunk->count; i++)
+        free_request(&chunk->reqs[i]);
+    free(chunk);
+}
+
+/**
+ * Open url_filename for streaming, checking that it is a line-oriented
+ * URL file with at least one valid request. Return 1 on error or 0 on
+ * success.
+ */
+int stream_open(stream* s, const char* url_filename)
+{
+    request req;
+    int found = 0;
+
+    if (!detect_line_format(url_filename)) {
+        fprintf(stderr, "%s: only line-oriented URL files can be streamed\n", url_filename);
+        return 1;
+    }
+    if ((s->in = fopen(url_filename, "r")) == NULL) {
+        perror(url_filename);
+        return 1;
+    }
+    // we'll read it once through, front to back
+    posix_fadvise(fileno(s->in), 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    s->filename = url_filename;
+    s->pass = 0;
+    s->lineno = 0;
+    s->line = NULL;
+    s->line_size = 0;
+
+    // each chunk compiles its own templates, so keep the CSV files
+    // they read from being read again for every one
+    template_hold_files();
+
+    // make sure there's something to stream, so that stream_next()
+    // can always find a request eventually; read_chunk() skips the
+    // same lines this does
+    while (!found && getline(&s->line, &s->line_size, s->in) >= 0) {
+        s->lineno++;
+        if (skip_line(s->line))
+            continue;
+        req = parse_line(s->line, url_filename, s->lineno);
+        if (req.url == NULL)
+            continue;
+        if (template_prepare(&req) != 0)
+            fprintf(stderr, "%s:%d: Error in the templates of %s\n", url_filename, s->lineno, req.url);
+        else
+            found = 1;
+        free_request(&req);
+    }
+    if (!found) {
+        fprintf(stderr, "No requests in URLs file\n");
+        template_release_files();
+        fclose(s->in);
+        free(s->line);
+        return 1;
+    }
+
+    rewind(s->in);
+    s->lineno = 0;
+    pthread_mutex_init(&s->lock, NULL);
+    return 0;
+}
+
+/**
+ * Read and parse up to STREAM_CHUNK_SIZE requests into a new chunk.
+ * Lines are only read under the lock; parsing them is left to the
+ * calling worker.
+ */
+static stream_chunk* read_chunk(stream* s)
+{
+    stream_chunk* chunk;
+    char* lines[STREAM_CHUNK_SIZE];
+    int linenos[STREAM_CHUNK_SIZE];
+    unsigned long i, pass = 0, n = 0;
+    request req;
+
+    if (!(chunk = malloc(sizeof(stream_chunk)))) {
+        fprintf(stderr, "Could not allocate requests\n");
+        exit(2);
+    }
+
+    pthread_mutex_lock(&s->lock);
+    while (n < STREAM_CHUNK_SIZE) {
+        if (getline(&s->line, &s->line_size, s->in) < 0) {
+            // go round again from the top
+            rewind(s->in);
+            s->lineno = 0;
+            s->pass++;
+            if (n > 0)
+                break;
+            continue;
+        }
+        s->lineno++;
+        if (skip_line(s->line))
+            continue;
+        if (!(lines[n] = strdup(s->line))) {
+            fprintf(stderr, "Could not allocate requests\n");
+            exit(2);
+        }
+        // a chunk stops at the end of the file, so it's all from the
+        // pass its first line is
+        if (n == 0)
+            pass = s->pass;
+        linenos[n++] = s->lineno;
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    chunk->count = 0;
+    for (i=0; i<n; i++) {
+        // a bad line can't stop a run already underway, so skip it
+        req = parse_line(lines[i], s->filename, linenos[i]);
+        free(lines[i]);
+        if (req.url == NULL)
+            continue;
+        if (template_prepare(&req) != 0) {
+            fprintf(stderr, "%s:%d: Error in the templates of %s\n", s->filename, linenos[i], req.url);
+            free_request(&req);
+            continue;
+        }
+        // each line is read once a pass, so its count goes on from
+        // where the last pass left it, as an entry's would unstreamed
+        if (req.tmpl != NULL)
+            req.tmpl->count = pass;
+        req.chunk = chunk;
+        chunk->reqs[chunk->count++] = req;
+    }
+    chunk->next = 0;
+    chunk->refs = chunk->count + 1;
+
+    return chunk;
+}
+
+/**
+ * Return the next request from the worker's *chunk, reading a new
+ * chunk from the stream when that one is used up.
+ */
+request* stream_next(stream* s, stream_chunk** chunk)
+{
+    while (*chunk == NULL || (*chunk)->next == (*chunk)->count) {
+        stream_drop(chunk);
+        *chunk = read_chunk(s);
+    }
+
+    return &(*chunk)->reqs[(*chunk)->next++];
+}
+
+/**
+ * Give up the worker's hold on *chunk, if any.
+ */
+void stream_drop(stream_chunk** chunk)
+{
+    if (*chunk == NULL)
+        return;
+
+    // the requests never handed out are finished with too
+    chunk_unref(*chunk, 1 + (*chunk)->count - (*chunk)->next);
+    *chunk = NULL;
+}
+
+/**
+ * Mark a request as finished with, once its result has been counted
+ * and written; does nothing for requests that weren't streamed.
+ */
+void stream_release(request* req)
+{
+    if (req->chunk != NULL)
+        chunk_unref(req->chunk, 1);
+}
+
+/**
+ * Close the stream; call only once the workers have finished.
+ */
+void stream_close(stream* s)
+{
+    pthread_mutex_destroy(&s->lock);
+    template_release_files();
+    fclose(s->in);
+    free(s->line);
+}
@@ -0,0 +1,69 @@
+#ifndef WIDELOAD_STREAM_H
+#define WIDELOAD_STREAM_H
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include "loader.h"
+
+#define STREAM_CHUNK_SIZE 1024
+
+/**
+ * A run of requests read from a streamed URL file. Each chunk is
+ * handed out whole to one worker; its requests are freed once the
+ * worker has moved on and every result that points at them has
+ * been counted (and written, if detailed results are kept).
+ */
+typedef struct _stream_chunk {
+    unsigned long count;
+    unsigned long next;   /* next request to hand out */
+    unsigned long refs;   /* the holder, plus one per unfinished request */
+    request       reqs[STREAM_CHUNK_SIZE];
+} stream_chunk;
+
+/**
+ * A line-oriented URL file (see parse_line()) shared by all the
+ * workers, and read a chunk at a time as they need more requests,
+ * so that only the chunks in use are ever in memory. At the end of
+ * the file it starts again from the top.
+ */
+typedef struct _stream {
+    const char*     filename;
+    FILE*           in;
+    unsigned long   pass;     /* times through the file, which numbers ${seq} */
+    int             lineno;
+    char*           line;
+    size_t          line_size;
+    pthread_mutex_t lock;
+} stream;
+
+/**
+ * Open url_filename for streaming, checking that it is a line-oriented
+ * URL file with at least one valid request. Return 1 on error or 0 on
+ * success.
+ */
+int stream_open(stream* s, const char* url_filename);
+
+/**
+ * Return the next request from the worker's *chunk, reading a new
+ * chunk from the stream when that one is used up.
+ */
+request* stream_next(stream* s, stream_chunk** chunk);
+
+/**
+ * Give up the worker's hold on *chunk, if any.
+ */
+void stream_drop(stream_chunk** chunk);
+
+/**
+ * Mark a request as finished with, once its result has been counted
+ * and written; does nothing for requests that weren't streamed.
+ */
+void stream_release(request* req);
+
+/**
+ * Close the stream; call only once the workers have finished.
+ */
+void stream_close(stream* s);
+
+#endif
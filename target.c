@@ -0,0 +1,586 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <argtable2.h>
+
+#include "timing.h"
+#include "rng.h"
+
+/*
+ * wideload-target: a small HTTP/1.1 server for benchmarking wideload
+ * itself. It answers every request with the same response, after a
+ * delay drawn from a chosen distribution, so that what wideload
+ * measures can be checked against what was injected.
+ */
+
+#define CLI_ERR(msg) { fprintf(stderr, "%s\n", msg); exit(11); }
+
+#define MAX_EVENTS 256
+
+/* the largest request head accepted; bodies are skipped, not kept */
+#define HEAD_SIZE 16384
+
+typedef enum {
+    DELAY_FIXED,
+    DELAY_UNIFORM,
+    DELAY_EXPONENTIAL
+} delay_kind;
+
+/**
+ * How long to hold each response, in ms: `a` (fixed), between `a`
+ * and `b` (uniform), or with mean `a` (exponential); plus, for a
+ * `slow_fraction` of responses, `slow` more.
+ */
+typedef struct {
+    delay_kind kind;
+    double     a;
+    double     b;
+    double     slow_fraction;
+    double     slow;
+} delay_dist;
+
+typedef struct _client {
+    int           fd;        /* or -1 once closed */
+    unsigned int  gen;       /* bumped on close, to spot stale timers */
+    char          in[HEAD_SIZE];
+    unsigned long in_len;
+    unsigned long body_left; /* request body bytes still to skip */
+    unsigned long out_off;   /* how much of the response has been sent */
+    char          in_body;   /* the head is read; skipping the body */
+    char          responding;
+    char          close_after;
+    struct _client* next_free;
+} client;
+
+/* a response held back until `due` */
+typedef struct {
+    unsigned long due;
+    client*       c;
+    unsigned int  gen;
+} timer;
+
+typedef struct {
+    int           epfd;
+    int           listener;
+    int           timerfd;
+    unsigned long armed;     /* when timerfd is set to fire, or 0 */
+    timer*        heap;
+    unsigned long heap_len;
+    unsigned long heap_max;
+    client*       free_clients;
+    rng           rng;
+    pthread_t     thread;
+} worker;
+
+static delay_dist delay;
+static char* response;
+static unsigned long response_len;
+static unsigned long port;
+
+/* epoll tags for a worker's own descriptors; clients are tagged
+   with their own address */
+static char listener_tag, timer_tag;
+
+/**
+ * Parse a delay like "5", "2-8" or "exp:5" (ms) into `d`.
+ * Return 1 on error or 0 on success.
+ */
+static int parse_delay(const char* spec, delay_dist* d)
+{
+    char* end;
+
+    if (strncmp(spec, "exp:", 4) == 0) {
+        d->kind = DELAY_EXPONENTIAL;
+        d->a = strtod(spec + 4, &end);
+        return (end == spec + 4 || *end != '\0' || d->a < 0);
+    }
+    d->a = strtod(spec, &end);
+    if (end == spec || d->a < 0)
+        return 1;
+    if (*end == '\0') {
+        d->kind = DELAY_FIXED;
+        return 0;
+    }
+    if (*end != '-')
+        return 1;
+    spec = end + 1;
+    d->kind = DELAY_UNIFORM;
+    d->b = strtod(spec, &end);
+    return (end == spec || *end != '\0' || d->b < d->a);
+}
+
+/**
+ * Parse "PCT:MS" into the slow share of `d`.
+ * Return 1 on error or 0 on success.
+ */
+static int parse_slow(const char* spec, delay_dist* d)
+{
+    char* end;
+
+    d->slow_fraction = strtod(spec, &end) / 100.0;
+    if (end == spec || *end != ':' || d->slow_fraction < 0 || d->slow_fraction > 1)
+        return 1;
+    spec = end + 1;
+    d->slow = strtod(spec, &end);
+    return (end == spec || *end != '\0' || d->slow < 0);
+}
+
+/**
+ * Draw a response's delay, in nanos.
+ */
+static unsigned long draw_delay(rng* r)
+{
+    double ms = delay.a;
+
+    if (delay.kind == DELAY_UNIFORM)
+        ms = delay.a + (delay.b - delay.a) * rng_double(r);
+    else if (delay.kind == DELAY_EXPONENTIAL)
+        ms = -delay.a * log(rng_double(r));
+    if (delay.slow_fraction > 0 && rng_double(r) <= delay.slow_fraction)
+        ms += delay.slow;
+
+    return (unsigned long)(ms * 1000000.0);
+}
+
+static void heap_push(worker* w, timer t)
+{
+    unsigned long i, parent;
+
+    if (w->heap_len == w->heap_max) {
+        w->heap_max = 2 * w->heap_max + 64;
+        if ((w->heap = realloc(w->heap, w->heap_max * sizeof(timer))) == NULL) {
+            fprintf(stderr, "Could not allocate timers\n");
+            exit(2);
+        }
+    }
+    for (i=w->heap_len++; i>0; i=parent) {
+        parent = (i - 1) / 2;
+        if (w->heap[parent].due <= t.due)
+            break;
+        w->heap[i] = w->heap[parent];
+    }
+    w->heap[i] = t;
+}
+
+static timer heap_pop(worker* w)
+{
+    timer top = w->heap[0], last = w->heap[--w->heap_len];
+    unsigned long i = 0, child;
+
+    for (;;) {
+        child = 2 * i + 1;
+        if (child >= w->heap_len)
+            break;
+        if (child + 1 < w->heap_len && w->heap[child + 1].due < w->heap[child].due)
+            child++;
+        if (last.due <= w->heap[child].due)
+            break;
+        w->heap[i] = w->heap[child];
+        i = child;
+    }
+    if (w->heap_len > 0)
+        w->heap[i] = last;
+    return top;
+}
+
+/**
+ * Set the timer to fire for the earliest held response, if that
+ * has changed.
+ */
+static void arm_timer(worker* w)
+{
+    struct itimerspec when;
+    unsigned long due = (w->heap_len > 0 ? w->heap[0].due : 0);
+
+    if (due == w->armed)
+        return;
+    memset(&when, 0, sizeof(when));
+    when.it_value.tv_sec = due / 1000000000;
+    when.it_value.tv_nsec = due % 1000000000;
+    timerfd_settime(w->timerfd, TFD_TIMER_ABSTIME, &when, NULL);
+    w->armed = due;
+}
+
+static void close_client(worker* w, client* c)
+{
+    epoll_ctl(w->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    c->fd = -1;
+    c->gen++;
+    c->next_free = w->free_clients;
+    w->free_clients = c;
+}
+
+static void watch(worker* w, client* c, unsigned int events)
+{
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.ptr = c;
+    epoll_ctl(w->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+static void serve_requests(worker* w, client* c);
+
+/**
+ * Send (the rest of) the client's response. Once it's all sent,
+ * go on to any request pipelined behind it.
+ */
+static void send_response(worker* w, client* c)
+{
+    ssize_t n;
+
+    while (c->out_off < response_len) {
+        n = write(c->fd, response + c->out_off, response_len - c->out_off);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EAGAIN) {
+            watch(w, c, EPOLLOUT);
+            return;
+        }
+        if (n < 0) {
+            close_client(w, c);
+            return;
+        }
+        c->out_off += n;
+    }
+
+    if (c->close_after) {
+        close_client(w, c);
+        return;
+    }
+    c->responding = 0;
+    watch(w, c, EPOLLIN);
+    serve_requests(w, c);
+}
+
+/**
+ * Return whether the request head `head` (NUL-terminated) has a
+ * header `name` (lowercase, with its colon) whose value starts with
+ * `value` (lowercase), or any value if `value` is NULL; and if so,
+ * point `found` at the value.
+ */
+static int has_header(const char* head, const char* name, const char* value, const char** found)
+{
+    const char* p;
+    unsigned long len = strlen(name);
+
+    for (p=strchr(head, '\n'); p!=NULL; p=strchr(p, '\n')) {
+        p++;
+        if (strncasecmp(p, name, len) != 0)
+            continue;
+        for (p+=len; *p == ' ' || *p == '\t'; p++)
+            ;
+        if (found != NULL)
+            *found = p;
+        return (value == NULL || strncasecmp(p, value, strlen(value)) == 0);
+    }
+    return 0;
+}
+
+/**
+ * Take the next complete request from the client's input, if any,
+ * and respond to it (now, or when its delay is up). Responses go out
+ * one at a time, in order.
+ */
+static void serve_requests(worker* w, client* c)
+{
+    char* end;
+    const char* length;
+    unsigned long head_len, skip;
+    timer t;
+
+    while (!c->responding) {
+        if (!c->in_body) {
+            c->in[c->in_len] = '\0';
+            if ((end = strstr(c->in, "\r\n\r\n")) == NULL) {
+                // a head too big for the buffer won't fit later either
+                if (c->in_len == HEAD_SIZE - 1)
+                    close_client(w, c);
+                return;
+            }
+            head_len = end + 4 - c->in;
+            end[2] = '\0';
+
+            c->close_after = has_header(c->in, "connection:", "close", NULL);
+            c->body_left = 0;
+            if (has_header(c->in, "content-length:", NULL, &length))
+                c->body_left = strtoul(length, NULL, 10);
+            // libcurl holds large bodies back until told to go ahead
+            if (has_header(c->in, "expect:", "100-continue", NULL) &&
+                    write(c->fd, "HTTP/1.1 100 Continue\r\n\r\n", 25) != 25) {
+                close_client(w, c);
+                return;
+            }
+
+            memmove(c->in, c->in + head_len, c->in_len - head_len);
+            c->in_len -= head_len;
+            c->in_body = 1;
+        }
+
+        // the response waits for the whole body, as a real
+        // server's would
+        skip = (c->body_left < c->in_len ? c->body_left : c->in_len);
+        memmove(c->in, c->in + skip, c->in_len - skip);
+        c->in_len -= skip;
+        c->body_left -= skip;
+        if (c->body_left > 0)
+            return;
+        c->in_body = 0;
+
+        c->responding = 1;
+        c->out_off = 0;
+        t.due = draw_delay(&w->rng);
+        if (t.due == 0) {
+            send_response(w, c);
+            return;
+        }
+        // stop reading until the response is out, so that a client
+        // which hangs up on a slow response is noticed then
+        watch(w, c, 0);
+        t.due += nanos();
+        t.c = c;
+        t.gen = c->gen;
+        heap_push(w, t);
+        arm_timer(w);
+    }
+}
+
+static void read_requests(worker* w, client* c)
+{
+    ssize_t n;
+
+    for (;;) {
+        // request bodies are read into the head buffer and dropped
+        n = read(c->fd, c->in + c->in_len, HEAD_SIZE - 1 - c->in_len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EAGAIN)
+            return;
+        if (n <= 0) {
+            close_client(w, c);
+            return;
+        }
+        c->in_len += n;
+        serve_requests(w, c);
+        // closed, or waiting on a response: read no further for now
+        if (c->fd < 0 || c->responding)
+            return;
+    }
+}
+
+static void accept_clients(worker* w)
+{
+    struct epoll_event ev;
+    client* c;
+    int fd, one = 1;
+
+    while ((fd = accept4(w->listener, NULL, NULL, SOCK_NONBLOCK)) >= 0) {
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if ((c = w->free_clients) != NULL) {
+            w->free_clients = c->next_free;
+        } else if ((c = calloc(1, sizeof(client))) == NULL) {
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->in_len = 0;
+        c->body_left = 0;
+        c->in_body = 0;
+        c->responding = 0;
+
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = c;
+        epoll_ctl(w->epfd, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+/**
+ * Send every held response that's now due.
+ */
+static void expire_timers(worker* w)
+{
+    unsigned long now = nanos(), expirations;
+    timer t;
+
+    if (read(w->timerfd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+        return;
+    w->armed = 0;
+    while (w->heap_len > 0 && w->heap[0].due <= now) {
+        t = heap_pop(w);
+        if (t.c->gen == t.gen)
+            send_response(w, t.c);
+    }
+    arm_timer(w);
+}
+
+static void* worker_thread(void* arg)
+{
+    worker* w = (worker*)arg;
+    struct epoll_event events[MAX_EVENTS];
+    client* c;
+    int i, n;
+
+    for (;;) {
+        n = epoll_wait(w->epfd, events, MAX_EVENTS, -1);
+        if (n < 0 && errno != EINTR) {
+            perror("epoll_wait");
+            exit(2);
+        }
+        for (i=0; i<n; i++) {
+            if (events[i].data.ptr == &listener_tag) {
+                accept_clients(w);
+            } else if (events[i].data.ptr == &timer_tag) {
+                expire_timers(w);
+            } else {
+                c = events[i].data.ptr;
+                if (events[i].events & (EPOLLERR | EPOLLHUP))
+                    close_client(w, c);
+                else if (events[i].events & EPOLLOUT)
+                    send_response(w, c);
+                else if (events[i].events & EPOLLIN)
+                    read_requests(w, c);
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Open the worker's own listening socket (the kernel spreads new
+ * connections across them), its timer and its epoll set.
+ * Return 1 on error or 0 on success.
+ */
+static int worker_init(worker* w, unsigned long index)
+{
+    struct sockaddr_in6 addr;
+    struct epoll_event ev;
+    int one = 1, zero = 0;
+
+    memset(w, 0, sizeof(worker));
+    rng_seed(&w->rng, nanos() + index);
+
+    w->listener = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    w->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    w->epfd = epoll_create1(0);
+    if (w->listener < 0 || w->timerfd < 0 || w->epfd < 0) {
+        perror("socket");
+        return 1;
+    }
+    setsockopt(w->listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(w->listener, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+    setsockopt(w->listener, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin6_family = AF_INET6;
+    addr.sin6_addr = in6addr_any;
+    addr.sin6_port = htons(port);
+    if (bind(w->listener, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(w->listener, 4096) != 0) {
+        perror("bind");
+        return 1;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = &listener_tag;
+    epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->listener, &ev);
+    ev.data.ptr = &timer_tag;
+    epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->timerfd, &ev);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    struct arg_lit* help = arg_lit0("h", "help", "Displays this help message");
+    struct arg_int* port_arg = arg_int0("p", "port", "N", "Port to listen on [8080]");
+    struct arg_int* threads = arg_int0(NULL, "threads", "N", "Number of event loop threads [number of CPUs]");
+    struct arg_int* size = arg_int0(NULL, "size", "N", "Response body size in bytes [64]");
+    struct arg_str* delay_arg = arg_str0(NULL, "delay", "SPEC", "Hold each response for MS, LO-HI (uniform) or exp:MEAN (exponential) milliseconds [0]");
+    struct arg_str* slow = arg_str0(NULL, "slow", "PCT:MS", "Hold PCT percent of responses MS milliseconds longer, e.g. to pass wideload's --fail-after");
+    struct arg_end* end = arg_end(20);
+
+    void* argtable[] = { help, port_arg, threads, size, delay_arg, slow, end };
+
+    worker* workers;
+    unsigned long i, nthreads, body;
+    int head;
+
+    if (arg_nullcheck(argtable) != 0) {
+        fprintf(stderr, "Memory error parsing command line options\n");
+        exit(10);
+    }
+    if (arg_parse(argc, argv, argtable) != 0) {
+        arg_print_errors(stderr, end, "wideload-target");
+        exit(10);
+    }
+    if (help->count > 0) {
+        fprintf(stdout, "wideload-target");
+        arg_print_syntax(stdout, argtable, "\n\n");
+        fprintf(stdout, "OPTIONS:\n");
+        arg_print_glossary(stdout, argtable, "  %-25s %s\n");
+        exit(0);
+    }
+
+    if (port_arg->count > 0 && (port_arg->ival[0] < 1 || port_arg->ival[0] > 65535))
+        CLI_ERR("-p/--port must be between 1 and 65535");
+    if (threads->count > 0 && threads->ival[0] < 1)
+        CLI_ERR("--threads must be a positive number");
+    if (size->count > 0 && size->ival[0] < 0)
+        CLI_ERR("--size must not be negative");
+    memset(&delay, 0, sizeof(delay));
+    if (delay_arg->count > 0 && parse_delay(delay_arg->sval[0], &delay))
+        CLI_ERR("--delay must be MS, LO-HI or exp:MEAN");
+    if (slow->count > 0 && parse_slow(slow->sval[0], &delay))
+        CLI_ERR("--slow must be PCT:MS");
+
+    port = (port_arg->count > 0 ? port_arg->ival[0] : 8080);
+    nthreads = (threads->count > 0 ? threads->ival[0] : sysconf(_SC_NPROCESSORS_ONLN));
+    body = (size->count > 0 ? size->ival[0] : 64);
+
+    // every response is the same, so it's built once
+    if ((response = malloc(body + 128)) == NULL) {
+        fprintf(stderr, "Could not allocate the response\n");
+        exit(2);
+    }
+    head = sprintf(response, "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Length: %lu\r\n\r\n", body);
+    memset(response + head, 'x', body);
+    response_len = head + body;
+
+    // a client hanging up mid-response is its own business
+    signal(SIGPIPE, SIG_IGN);
+
+    if ((workers = calloc(nthreads, sizeof(worker))) == NULL) {
+        fprintf(stderr, "Could not allocate workers\n");
+        exit(2);
+    }
+    for (i=0; i<nthreads; i++) {
+        if (worker_init(&workers[i], i))
+            exit(1);
+    }
+    for (i=0; i<nthreads; i++) {
+        if (pthread_create(&workers[i].thread, NULL, worker_thread, &workers[i]) != 0) {
+            perror("thread error");
+            exit(2);
+        }
+    }
+
+    printf("Listening on port %lu with %lu threads\n", port, nthreads);
+    fflush(stdout);
+    for (i=0; i<nthreads; i++)
+        pthread_join(workers[i].thread, NULL);
+
+    arg_freetable(argtable, sizeof(argtable) / sizeof(argtable[0]));
+    return 0;
+}
@@ -0,0 +1,788 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "template.h"
+
+/**
+ * A CSV file that ${csv} placeholders take columns from, read once
+ * and shared by every template that names it. Its first row names
+ * the columns.
+ */
+typedef struct _feeder {
+    char*         path;
+    char*         data;
+    const char*   source;   /* as provided, for template_files(); or NULL */
+    unsigned long source_length;
+    unsigned long columns;
+    char**        names;
+    unsigned long rows;
+    struct {
+        const char*   text;
+        unsigned long length;
+    }*            fields;   /* rows * columns, row by row */
+    unsigned long refs;
+    struct _feeder* next;
+} feeder;
+
+/* every feeder read; streaming workers compile concurrently */
+static feeder* feeders = NULL;
+static pthread_mutex_t feeders_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* only feeders provided with template_provide() can be opened */
+static char files_forbidden = 0;
+
+/* while held, feeders are kept after their last template is freed */
+static unsigned long holds = 0;
+
+/**
+ * Split the feeder's data into fields, in place: comma-separated,
+ * optionally double-quoted (with "" for a quote), a row per line.
+ * The first row becomes the column names, and short rows are padded
+ * with empty fields. Return 1 on error or 0 on success.
+ */
+static int feeder_parse(feeder* f, unsigned long length)
+{
+    char* p = f->data;
+    char* end = f->data + length;
+    char* out;
+    char* start;
+    unsigned long column, max_rows = 0;
+    void* grown;
+
+    while (p < end) {
+        if (*p == '\n' || *p == '\r') {
+            // blank lines separate nothing
+            p++;
+            continue;
+        }
+
+        if (f->names != NULL && f->rows == max_rows) {
+            max_rows = (max_rows ? 2 * max_rows : 64);
+            if (!(grown = realloc(f->fields, max_rows * f->columns * sizeof(*f->fields))))
+                return 1;
+            f->fields = grown;
+        }
+
+        for (column=0; ; column++) {
+            start = out = p;
+            if (p < end && *p == '"') {
+                for (p++; p < end; p++) {
+                    if (*p == '"') {
+                        if (p + 1 < end && p[1] == '"')
+                            p++;
+                        else
+                            break;
+                    }
+                    *out++ = *p;
+                }
+                p++;
+                while (p < end && *p != ',' && *p != '\n')
+                    p++;
+            } else {
+                while (p < end && *p != ',' && *p != '\n')
+                    p++;
+                out = p;
+                if (out > start && out[-1] == '\r')
+                    out--;
+            }
+
+            if (f->names == NULL) {
+                if (!(grown = realloc(f->fields, (column + 1) * sizeof(*f->fields))))
+                    return 1;
+                f->fields = grown;
+            }
+            if (f->names == NULL || column < f->columns) {
+                f->fields[f->rows * f->columns + column].text = start;
+                f->fields[f->rows * f->columns + column].length = out - start;
+            }
+
+            if (p >= end || *p == '\n')
+                break;
+            p++;
+        }
+        p++;
+
+        if (f->names == NULL) {
+            // the header row: keep the names as strings
+            f->columns = column + 1;
+            if (!(f->names = calloc(f->columns, sizeof(char*))))
+                return 1;
+            for (column=0; column<f->columns; column++)
+                if (!(f->names[column] = strndup(f->fields[column].text, f->fields[column].length)))
+                    return 1;
+            free(f->fields);
+            f->fields = NULL;
+            continue;
+        }
+        for (column++; column<f->columns; column++) {
+            f->fields[f->rows * f->columns + column].text = "";
+            f->fields[f->rows * f->columns + column].length = 0;
+        }
+        f->rows++;
+    }
+
+    return (f->rows == 0);
+}
+
+static void feeder_free(feeder* f)
+{
+    unsigned long i;
+
+    if (f->names != NULL)
+        for (i=0; i<f->columns; i++)
+            free(f->names[i]);
+    free(f->names);
+    free(f->fields);
+    free(f->data);
+    free(f->path);
+    free(f);
+}
+
+/**
+ * Read the CSV file at `path`, or take another reference to it if
+ * it has been read already. Return NULL on error.
+ */
+static feeder* feeder_open(const char* path)
+{
+    feeder* f;
+    FILE* in;
+    long length;
+
+    pthread_mutex_lock(&feeders_lock);
+    for (f=feeders; f!=NULL; f=f->next) {
+        if (strcmp(f->path, path) == 0) {
+            f->refs++;
+            pthread_mutex_unlock(&feeders_lock);
+            return f;
+        }
+    }
+
+    if (files_forbidden) {
+        fprintf(stderr, "CSV file '%s' wasn't sent with the request set\n", path);
+        pthread_mutex_unlock(&feeders_lock);
+        return NULL;
+    }
+    if (!(f = calloc(1, sizeof(feeder))) || !(f->path = strdup(path)))
+        goto feeder_open_error;
+    if ((in = fopen(path, "r")) == NULL) {
+        fprintf(stderr, "Could not read CSV file '%s'\n", path);
+        goto feeder_open_error;
+    }
+    fseek(in, 0, SEEK_END);
+    length = ftell(in);
+    rewind(in);
+    if (length < 0 || !(f->data = malloc(length + 1)) || fread(f->data, 1, length, in) != (size_t)length) {
+        fprintf(stderr, "Could not read CSV file '%s'\n", path);
+        fclose(in);
+        goto feeder_open_error;
+    }
+    fclose(in);
+
+    if (feeder_parse(f, length) != 0) {
+        fprintf(stderr, "CSV file '%s' has no rows after its header\n", path);
+        goto feeder_open_error;
+    }
+
+    f->refs = 1;
+    f->next = feeders;
+    feeders = f;
+    pthread_mutex_unlock(&feeders_lock);
+    return f;
+
+feeder_open_error:
+    pthread_mutex_unlock(&feeders_lock);
+    if (f != NULL)
+        feeder_free(f);
+    return NULL;
+}
+
+/**
+ * Drop a reference to a feeder, freeing it with the last.
+ */
+static void feeder_close(feeder* f)
+{
+    feeder** link;
+
+    pthread_mutex_lock(&feeders_lock);
+    if (--f->refs > 0 || holds > 0) {
+        pthread_mutex_unlock(&feeders_lock);
+        return;
+    }
+    for (link=&feeders; *link!=f; link=&(*link)->next)
+        ;
+    *link = f->next;
+    pthread_mutex_unlock(&feeders_lock);
+
+    feeder_free(f);
+}
+
+/**
+ * Provide the CSV file at `path` from `length` bytes of data, as if
+ * read from it, for as long as the program runs; data must stay
+ * valid as long, too.
+ * Return 1 on error or 0 on success.
+ */
+int template_provide(const char* path, const char* data, unsigned long length)
+{
+    feeder* f;
+
+    if (!(f = calloc(1, sizeof(feeder))) || !(f->path = strdup(path)) || !(f->data = malloc(length + 1)))
+        goto template_provide_error;
+    memcpy(f->data, data, length);
+    f->source = data;
+    f->source_length = length;
+    if (feeder_parse(f, length) != 0) {
+        fprintf(stderr, "CSV file '%s' has no rows after its header\n", path);
+        goto template_provide_error;
+    }
+
+    // the reference is never dropped, so it's never read again
+    f->refs = 1;
+    pthread_mutex_lock(&feeders_lock);
+    f->next = feeders;
+    feeders = f;
+    pthread_mutex_unlock(&feeders_lock);
+    return 0;
+
+template_provide_error:
+    if (f != NULL)
+        feeder_free(f);
+    return 1;
+}
+
+/**
+ * Keep every CSV file read, from now until template_release_files(),
+ * even once no template names it, so that it's never read twice.
+ */
+void template_hold_files(void)
+{
+    pthread_mutex_lock(&feeders_lock);
+    holds++;
+    pthread_mutex_unlock(&feeders_lock);
+}
+
+/**
+ * Undo a template_hold_files(), freeing the CSV files no template
+ * names.
+ */
+void template_release_files(void)
+{
+    feeder** link;
+    feeder* f;
+
+    pthread_mutex_lock(&feeders_lock);
+    if (--holds == 0) {
+        for (link=&feeders; (f = *link)!=NULL; ) {
+            if (f->refs > 0) {
+                link = &f->next;
+                continue;
+            }
+            *link = f->next;
+            feeder_free(f);
+        }
+    }
+    pthread_mutex_unlock(&feeders_lock);
+}
+
+/**
+ * From now on, read no CSV files, failing any template naming one
+ * that wasn't provided with template_provide().
+ */
+void template_forbid_files(void)
+{
+    files_forbidden = 1;
+}
+
+/**
+ * Return every CSV file in use, in a malloc'd array of *count, which
+ * the caller frees; it stays valid while the templates naming them
+ * do. Files read from disk have no data, and should be read again.
+ * Return NULL on error.
+ */
+template_file* template_files(unsigned long* count)
+{
+    template_file* files;
+    feeder* f;
+
+    pthread_mutex_lock(&feeders_lock);
+    for (f=feeders, *count=0; f!=NULL; f=f->next)
+        (*count)++;
+    if ((files = malloc((*count + 1) * sizeof(template_file))) != NULL) {
+        for (f=feeders, *count=0; f!=NULL; f=f->next, (*count)++) {
+            files[*count].path = f->path;
+            files[*count].data = f->source;
+            files[*count].length = f->source_length;
+        }
+    }
+    pthread_mutex_unlock(&feeders_lock);
+    return files;
+}
+
+/**
+ * Parse all of s (up to end) as a number into *n.
+ * Return 1 on error or 0 on success.
+ */
+static int parse_number(const char* s, const char* end, unsigned long* n)
+{
+    if (s == end)
+        return 1;
+    for (*n=0; s<end; s++) {
+        if (*s < '0' || *s > '9')
+            return 1;
+        *n = *n * 10 + (*s - '0');
+    }
+    return 0;
+}
+
+/**
+ * Fill in seg from the placeholder's name (between "${" and "}").
+ * Return -1 if the name isn't one we know, leaving it to be sent as
+ * it is, 1 if it's malformed, or 0 on success.
+ */
+static int parse_placeholder(segment* seg, const char* name, const char* end)
+{
+    const char* arg = memchr(name, ':', end - name);
+    const char* sep;
+    unsigned long length = (arg ? arg : end) - name;
+    char* path;
+    char* column;
+
+    if (length == 3 && strncmp(name, "seq", 3) == 0) {
+        seg->type = SEGMENT_SEQ;
+        seg->lo = 0;
+        return (arg != NULL && parse_number(arg + 1, end, &seg->lo));
+    }
+    if (length == 4 && strncmp(name, "uuid", 4) == 0) {
+        seg->type = SEGMENT_UUID;
+        return (arg != NULL);
+    }
+    if (length == 4 && strncmp(name, "rand", 4) == 0) {
+        seg->type = SEGMENT_RAND;
+        if (arg == NULL || (sep = memchr(arg, '-', end - arg)) == NULL)
+            return 1;
+        return (parse_number(arg + 1, sep, &seg->lo) ||
+                parse_number(sep + 1, end, &seg->hi) ||
+                seg->lo > seg->hi);
+    }
+    if (length == 3 && strncmp(name, "csv", 3) == 0) {
+        seg->type = SEGMENT_CSV;
+        // the file name may itself hold a colon, but the column can't
+        if (arg == NULL || (sep = memrchr(arg, ':', end - arg)) == arg || sep + 1 == end)
+            return 1;
+        if (!(path = strndup(arg + 1, sep - arg - 1)))
+            return 1;
+        seg->feeder = feeder_open(path);
+        free(path);
+        if (seg->feeder == NULL)
+            return 1;
+        for (seg->column=0; seg->column<seg->feeder->columns; seg->column++)
+            if (strlen(seg->feeder->names[seg->column]) == (size_t)(end - sep - 1) &&
+                    strncmp(seg->feeder->names[seg->column], sep + 1, end - sep - 1) == 0)
+                return 0;
+        if ((column = strndup(sep + 1, end - sep - 1)) != NULL)
+            fprintf(stderr, "No column '%s' in CSV file '%s'\n", column, seg->feeder->path);
+        free(column);
+        feeder_close(seg->feeder);
+        seg->feeder = NULL;
+        return 1;
+    }
+
+    return -1;
+}
+
+/**
+ * Append a segment to t, returning it, or NULL on error.
+ */
+static segment* add_segment(template* t, unsigned long* max)
+{
+    void* grown;
+
+    if (t->count == *max) {
+        *max = (*max ? 2 * *max : 8);
+        if (!(grown = realloc(t->segs, *max * sizeof(segment))))
+            return NULL;
+        t->segs = grown;
+    }
+    memset(&t->segs[t->count], 0, sizeof(segment));
+    return &t->segs[t->count++];
+}
+
+/**
+ * Compile length bytes of s, setting *t to the template, or to NULL
+ * if s holds no placeholders. Return 1 on error or 0 on success.
+ */
+int template_compile(const char* s, unsigned long length, template** t)
+{
+    template* tmpl;
+    segment* seg;
+    segment placeholder;
+    const char* p;
+    const char* close;
+    const char* end;
+    const char* text;
+    unsigned long max = 0;
+    int found = 0, known;
+
+    *t = NULL;
+    if (!(tmpl = calloc(1, sizeof(template))) || !(tmpl->source = malloc(length + 1))) {
+        free(tmpl);
+        return 1;
+    }
+    memcpy(tmpl->source, s, length);
+    tmpl->source[length] = '\0';
+    end = tmpl->source + length;
+
+    for (text=p=tmpl->source; p+1<end; p++) {
+        if (p[0] != '$' || p[1] != '{' || (close = memchr(p + 2, '}', end - p - 2)) == NULL)
+            continue;
+
+        memset(&placeholder, 0, sizeof(segment));
+        if ((known = parse_placeholder(&placeholder, p + 2, close)) < 0)
+            continue;
+        if (known > 0) {
+            fprintf(stderr, "Invalid placeholder '%.*s'\n", (int)(close + 1 - p), p);
+            goto template_compile_error;
+        }
+
+        if (p > text) {
+            if (!(seg = add_segment(tmpl, &max)))
+                goto template_compile_error;
+            seg->type = SEGMENT_TEXT;
+            seg->text = text;
+            seg->length = p - text;
+        }
+        if (!(seg = add_segment(tmpl, &max))) {
+            if (placeholder.feeder != NULL)
+                feeder_close(placeholder.feeder);
+            goto template_compile_error;
+        }
+        *seg = placeholder;
+        found = 1;
+        text = p = close + 1;
+        p--;
+    }
+
+    if (!found) {
+        template_free(tmpl);
+        return 0;
+    }
+    if (end > text) {
+        if (!(seg = add_segment(tmpl, &max)))
+            goto template_compile_error;
+        seg->type = SEGMENT_TEXT;
+        seg->text = text;
+        seg->length = end - text;
+    }
+
+    *t = tmpl;
+    return 0;
+
+template_compile_error:
+    template_free(tmpl);
+    return 1;
+}
+
+void template_free(template* t)
+{
+    unsigned long i;
+
+    if (t == NULL)
+        return;
+    for (i=0; i<t->count; i++)
+        if (t->segs[i].type == SEGMENT_CSV)
+            feeder_close(t->segs[i].feeder);
+    free(t->segs);
+    free(t->source);
+    free(t);
+}
+
+/**
+ * Note which variables the template's placeholders use.
+ */
+static void note_uses(request_template* rt, const template* t)
+{
+    unsigned long i;
+
+    if (t == NULL)
+        return;
+    for (i=0; i<t->count; i++) {
+        if (t->segs[i].type == SEGMENT_SEQ || t->segs[i].type == SEGMENT_CSV)
+            rt->counted = 1;
+        if (t->segs[i].type == SEGMENT_UUID)
+            rt->uuid = 1;
+    }
+}
+
+/**
+ * Compile the request's templates, if it has any, into req->tmpl.
+ * Return 1 on error or 0 on success.
+ */
+int template_prepare(request* req)
+{
+    request_template* rt;
+    unsigned long i;
+    int found;
+
+    req->tmpl = NULL;
+    if (!(rt = calloc(1, sizeof(request_template))))
+        return 1;
+    if (req->num_headers > 0 && !(rt->values = calloc(req->num_headers, sizeof(template*))))
+        goto template_prepare_error;
+    req->tmpl = rt;
+
+    if (template_compile(req->url, strlen(req->url), &rt->url) != 0)
+        goto template_prepare_error;
+    found = (rt->url != NULL);
+    for (i=0; i<req->num_headers; i++) {
+        if (template_compile(req->headers[i].value, strlen(req->headers[i].value), &rt->values[i]) != 0)
+            goto template_prepare_error;
+        found |= (rt->values[i] != NULL);
+    }
+    // payload files are sent as they are, straight from their mapping
+    if (req->payload_map == NULL && req->payload != NULL) {
+        if (template_compile(req->payload, req->payload_length, &rt->payload) != 0)
+            goto template_prepare_error;
+        found |= (rt->payload != NULL);
+    }
+
+    if (!found) {
+        template_release(req);
+        return 0;
+    }
+
+    note_uses(rt, rt->url);
+    for (i=0; i<req->num_headers; i++)
+        note_uses(rt, rt->values[i]);
+    note_uses(rt, rt->payload);
+    return 0;
+
+template_prepare_error:
+    if (req->tmpl == NULL)
+        free(rt);
+    template_release(req);
+    return 1;
+}
+
+/**
+ * Free req->tmpl, if the request has one.
+ */
+void template_release(request* req)
+{
+    request_template* rt = req->tmpl;
+    unsigned long i;
+
+    if (rt == NULL)
+        return;
+    template_free(rt->url);
+    if (rt->values != NULL)
+        for (i=0; i<req->num_headers; i++)
+            template_free(rt->values[i]);
+    free(rt->values);
+    template_free(rt->payload);
+    free(rt);
+    req->tmpl = NULL;
+}
+
+/**
+ * Draw the variables for the next expansion of the request.
+ */
+void template_draw(request_template* rt, template_vars* v, rng* r)
+{
+    // only take the shared count if something needs it, as it's
+    // contended by every thread making the request
+    v->n = (rt->counted ? __atomic_fetch_add(&rt->count, 1, __ATOMIC_RELAXED) : 0);
+    if (rt->uuid) {
+        // a version 4 (random) UUID
+        v->uuid[0] = (rng_next(r) & ~0xf000ULL) | 0x4000ULL;
+        v->uuid[1] = (rng_next(r) & ~(3ULL << 62)) | (2ULL << 62);
+    }
+}
+
+/**
+ * Make room for `need` bytes in *buf, exiting if there's no memory.
+ */
+void template_reserve(char** buf, unsigned long* size, unsigned long need)
+{
+    unsigned long grown = (*size ? *size : 256);
+    char* p;
+
+    if (need <= *size)
+        return;
+    while (grown < need)
+        grown *= 2;
+    if (!(p = realloc(*buf, grown))) {
+        fprintf(stderr, "Could not allocate request\n");
+        exit(2);
+    }
+    *buf = p;
+    *size = grown;
+}
+
+/**
+ * Copy length bytes of s to *buf at offset `at`, growing the buffer
+ * (of *size bytes) if needed, and return the offset after them.
+ */
+unsigned long template_put(char** buf, unsigned long* size, unsigned long at, const char* s, unsigned long length)
+{
+    template_reserve(buf, size, at + length);
+    memcpy(*buf + at, s, length);
+    return at + length;
+}
+
+/**
+ * Write n in decimal to *buf at offset `at`.
+ */
+static unsigned long put_number(char** buf, unsigned long* size, unsigned long at, unsigned long n)
+{
+    char digits[20];
+    int i = sizeof(digits);
+
+    do {
+        digits[--i] = '0' + n % 10;
+        n /= 10;
+    } while (n > 0);
+
+    return template_put(buf, size, at, digits + i, sizeof(digits) - i);
+}
+
+/**
+ * Write the UUID to *buf at offset `at`, in its usual 8-4-4-4-12 form.
+ */
+static unsigned long put_uuid(char** buf, unsigned long* size, unsigned long at, const uint64_t* uuid)
+{
+    static const char hex[] = "0123456789abcdef";
+    char* p;
+    int i;
+
+    template_reserve(buf, size, at + 36);
+    p = *buf + at;
+    for (i=0; i<32; i++) {
+        if (i == 8 || i == 12 || i == 16 || i == 20)
+            *p++ = '-';
+        *p++ = hex[(uuid[i / 16] >> (60 - 4 * (i % 16))) & 0xf];
+    }
+
+    return at + 36;
+}
+
+/**
+ * Expand the template to *buf at offset `at`, as template_put(),
+ * and return the offset after it.
+ */
+unsigned long template_write(const template* t, const template_vars* v, rng* r, char** buf, unsigned long* size, unsigned long at)
+{
+    const segment* seg;
+    const feeder* f;
+    unsigned long i, field;
+
+    for (i=0; i<t->count; i++) {
+        seg = &t->segs[i];
+        switch (seg->type) {
+            case SEGMENT_TEXT:
+                at = template_put(buf, size, at, seg->text, seg->length);
+                break;
+            case SEGMENT_SEQ:
+                at = put_number(buf, size, at, seg->lo + v->n);
+                break;
+            case SEGMENT_RAND:
+                at = put_number(buf, size, at, seg->lo + rng_below(r, seg->hi - seg->lo + 1));
+                break;
+            case SEGMENT_UUID:
+                at = put_uuid(buf, size, at, v->uuid);
+                break;
+            case SEGMENT_CSV:
+                f = seg->feeder;
+                field = (v->n % f->rows) * f->columns + seg->column;
+                at = template_put(buf, size, at, f->fields[field].text, f->fields[field].length);
+                break;
+        }
+    }
+
+    return at;
+}
+
+void expansion_init(expansion* exp, rng* r)
+{
+    memset(exp, 0, sizeof(expansion));
+    exp->rng = r;
+}
+
+void expansion_free(expansion* exp)
+{
+    free(exp->buf);
+    free(exp->offsets);
+    free(exp->curl_headers);
+}
+
+/**
+ * Return the request as it should be sent: the request itself if it
+ * has no templates, or else its next expansion, in exp.
+ */
+const request* template_expand(request* req, expansion* exp)
+{
+    request_template* rt = req->tmpl;
+    template_vars v;
+    unsigned long i, at, payload = 0;
+    const header* hdr;
+
+    if (rt == NULL)
+        return req;
+
+    if (exp->max_headers < req->num_headers) {
+        // only grows while the first of the biggest requests is made
+        free(exp->offsets);
+        free(exp->curl_headers);
+        exp->max_headers = req->num_headers;
+        exp->offsets = malloc(exp->max_headers * sizeof(unsigned long));
+        exp->curl_headers = malloc(exp->max_headers * sizeof(struct curl_slist));
+        if (exp->offsets == NULL || exp->curl_headers == NULL) {
+            fprintf(stderr, "Could not allocate request\n");
+            exit(2);
+        }
+    }
+
+    template_draw(rt, &v, exp->rng);
+    exp->req = *req;
+
+    // the buffer may move as it grows, so note where each part
+    // goes and point at them once it's all written
+    if (rt->url != NULL)
+        at = template_write(rt->url, &v, exp->rng, &exp->buf, &exp->size, 0);
+    else
+        at = template_put(&exp->buf, &exp->size, 0, req->url, strlen(req->url));
+    at = template_put(&exp->buf, &exp->size, at, "", 1);
+
+    for (i=0; i<req->num_headers; i++) {
+        hdr = &req->headers[i];
+        exp->offsets[i] = at;
+        at = template_put(&exp->buf, &exp->size, at, hdr->name, strlen(hdr->name));
+        at = template_put(&exp->buf, &exp->size, at, ": ", 2);
+        if (rt->values[i] != NULL)
+            at = template_write(rt->values[i], &v, exp->rng, &exp->buf, &exp->size, at);
+        else
+            at = template_put(&exp->buf, &exp->size, at, hdr->value, strlen(hdr->value));
+        at = template_put(&exp->buf, &exp->size, at, "", 1);
+    }
+
+    if (rt->payload != NULL) {
+        payload = at;
+        at = template_write(rt->payload, &v, exp->rng, &exp->buf, &exp->size, at);
+        exp->req.payload = exp->buf + payload;
+        exp->req.payload_length = at - payload;
+    }
+
+    exp->req.url = exp->buf;
+    exp->req.curl_headers = NULL;
+    for (i=0; i<req->num_headers; i++) {
+        // libcurl only reads the header list, so it can be built
+        // in place, as for a request set
+        exp->curl_headers[i].data = exp->buf + exp->offsets[i];
+        exp->curl_headers[i].next = (i + 1 < req->num_headers ? &exp->curl_headers[i + 1] : NULL);
+    }
+    if (req->num_headers > 0)
+        exp->req.curl_headers = exp->curl_headers;
+
+    return &exp->req;
+}
@@ -0,0 +1,176 @@
+#ifndef WIDELOAD_TEMPLATE_H
+#define WIDELOAD_TEMPLATE_H
+
+#include <stdint.h>
+#include <curl/curl.h>
+
+#include "loader.h"
+#include "rng.h"
+
+typedef enum {
+    SEGMENT_TEXT,
+    SEGMENT_SEQ,    /* ${seq} or ${seq:START} */
+    SEGMENT_RAND,   /* ${rand:LO-HI} */
+    SEGMENT_UUID,   /* ${uuid} */
+    SEGMENT_CSV     /* ${csv:FILE:COLUMN} */
+} segment_type;
+
+struct _feeder;
+
+typedef struct {
+    segment_type  type;
+    const char*   text;    /* SEGMENT_TEXT: into the template's source */
+    unsigned long length;
+    unsigned long lo;      /* SEGMENT_SEQ: the start; SEGMENT_RAND: the range */
+    unsigned long hi;
+    struct _feeder* feeder;  /* SEGMENT_CSV */
+    unsigned long column;
+} segment;
+
+/**
+ * A string with placeholders, split at load time into the literal
+ * text between them and the placeholders themselves, so expanding it
+ * is a walk along the segments.
+ */
+typedef struct _template {
+    char*         source;
+    unsigned long count;
+    segment*      segs;
+} template;
+
+/**
+ * The templates of a request whose URL, header values or payload
+ * hold placeholders; those that don't are NULL.
+ */
+typedef struct _request_template {
+    template*     url;
+    template**    values;   /* one per header */
+    template*     payload;
+
+    /* how many times the request has been expanded, which numbers
+       ${seq} and picks the ${csv} row */
+    unsigned long count;
+    char          counted;  /* some segment uses the count */
+    char          uuid;     /* some segment is a ${uuid} */
+} request_template;
+
+/**
+ * A CSV file that templates read, as template_files() lists it.
+ */
+typedef struct {
+    const char*   path;
+    const char*   data;    /* NULL if it was read from disk */
+    unsigned long length;
+} template_file;
+
+/**
+ * What every placeholder in one expansion of a request shares.
+ */
+typedef struct {
+    unsigned long n;
+    uint64_t      uuid[2];
+} template_vars;
+
+/**
+ * Space to expand templated requests into, reused from one to the
+ * next: the expanded request, and a buffer holding its URL, its
+ * "Name: value" header lines (which the curl_slist nodes point
+ * into) and its payload. A transfer reads these until it's done, so
+ * each connection needs its own.
+ */
+typedef struct _expansion {
+    request            req;
+    rng*               rng;
+    char*              buf;
+    unsigned long      size;
+    unsigned long*     offsets;
+    struct curl_slist* curl_headers;
+    unsigned long      max_headers;
+} expansion;
+
+/**
+ * Compile length bytes of s, setting *t to the template, or to NULL
+ * if s holds no placeholders. Return 1 on error or 0 on success.
+ */
+int template_compile(const char* s, unsigned long length, template** t);
+
+void template_free(template* t);
+
+/**
+ * Provide the CSV file at `path` from `length` bytes of data, as if
+ * read from it, for as long as the program runs; data must stay
+ * valid as long, too.
+ * Return 1 on error or 0 on success.
+ */
+int template_provide(const char* path, const char* data, unsigned long length);
+
+/**
+ * Keep every CSV file read, from now until template_release_files(),
+ * even once no template names it, so that it's never read twice.
+ */
+void template_hold_files(void);
+
+/**
+ * Undo a template_hold_files(), freeing the CSV files no template
+ * names.
+ */
+void template_release_files(void);
+
+/**
+ * From now on, read no CSV files, failing any template naming one
+ * that wasn't provided with template_provide().
+ */
+void template_forbid_files(void);
+
+/**
+ * Return every CSV file in use, in a malloc'd array of *count, which
+ * the caller frees; it stays valid while the templates naming them
+ * do. Files read from disk have no data, and should be read again.
+ * Return NULL on error.
+ */
+template_file* template_files(unsigned long* count);
+
+/**
+ * Compile the request's templates, if it has any, into req->tmpl.
+ * Return 1 on error or 0 on success.
+ */
+int template_prepare(request* req);
+
+/**
+ * Free req->tmpl, if the request has one.
+ */
+void template_release(request* req);
+
+/**
+ * Draw the variables for the next expansion of the request.
+ */
+void template_draw(request_template* rt, template_vars* v, rng* r);
+
+/**
+ * Make room for `need` bytes in *buf, exiting if there's no memory.
+ */
+void template_reserve(char** buf, unsigned long* size, unsigned long need);
+
+/**
+ * Copy length bytes of s to *buf at offset `at`, growing the buffer
+ * (of *size bytes) if needed, and return the offset after them.
+ */
+unsigned long template_put(char** buf, unsigned long* size, unsigned long at, const char* s, unsigned long length);
+
+/**
+ * Expand the template to *buf at offset `at`, as template_put(),
+ * and return the offset after it.
+ */
+unsigned long template_write(const template* t, const template_vars* v, rng* r, char** buf, unsigned long* size, unsigned long at);
+
+void expansion_init(expansion* exp, rng* r);
+
+void expansion_free(expansion* exp);
+
+/**
+ * Return the request as it should be sent: the request itself if it
+ * has no templates, or else its next expansion, in exp.
+ */
+const request* template_expand(request* req, expansion* exp);
+
+#endif
@@ -0,0 +1,60 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "timing.h"
+
+#define TIMING_SAMPLES 10000
+
+unsigned long wall_offset = 0;
+
+/**
+ * Check that the clock is fine-grained, cheap and steady enough
+ * to measure with, warning on stderr if not, and measure the
+ * offset to wall clock time. Return 1 if the clock is unusable
+ * or 0 on success.
+ */
+int timing_init()
+{
+    struct timespec res, wall;
+    unsigned long before, after, prev, now, cost;
+    int i;
+
+    if (clock_getres(CLOCK_MONOTONIC, &res) != 0) {
+        perror("CLOCK_MONOTONIC");
+        return 1;
+    }
+    if (res.tv_sec > 0 || res.tv_nsec > 1000000) {
+        fprintf(stderr, "CLOCK_MONOTONIC resolution is too coarse (%ld.%09lds)\n", (long)res.tv_sec, res.tv_nsec);
+        return 1;
+    }
+    if (res.tv_nsec > 1000)
+        fprintf(stderr, "warning: CLOCK_MONOTONIC resolution is only %ldns\n", res.tv_nsec);
+
+    // the clock is read several times per request, so make sure
+    // each read is cheap (i.e. served from the vDSO) and that it
+    // never runs backwards, even briefly
+    prev = before = nanos();
+    for (i=0; i<TIMING_SAMPLES; i++) {
+        now = nanos();
+        if (now < prev) {
+            fprintf(stderr, "CLOCK_MONOTONIC went backwards by %luns\n", prev - now);
+            return 1;
+        }
+        prev = now;
+    }
+    after = nanos();
+
+    cost = (after - before) / TIMING_SAMPLES;
+    if (cost > 1000)
+        fprintf(stderr, "warning: reading the clock takes %luns; timings will be inflated "
+                        "(check /sys/devices/system/clocksource/clocksource0/current_clocksource)\n", cost);
+
+    // take the wall clock reading between two monotonic ones,
+    // to halve the error in the offset
+    before = nanos();
+    clock_gettime(CLOCK_REALTIME, &wall);
+    after = nanos();
+    wall_offset = (wall.tv_sec * 1000000000UL + wall.tv_nsec) - (before + (after - before) / 2);
+
+    return 0;
+}
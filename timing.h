@@ -0,0 +1,29 @@
+#ifndef WIDELOAD_TIMING_H
+#define WIDELOAD_TIMING_H
+
+#include <time.h>
+
+/*
+ * All timing uses CLOCK_MONOTONIC in nanoseconds, which can't be
+ * stepped by NTP. Wall clock time is only needed to label results,
+ * by adding `wall_offset` (measured once at startup).
+ */
+
+extern unsigned long wall_offset;
+
+static inline unsigned long nanos()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000UL + now.tv_nsec;
+}
+
+/**
+ * Check that the clock is fine-grained, cheap and steady enough
+ * to measure with, warning on stderr if not, and measure the
+ * offset to wall clock time. Return 1 if the clock is unusable
+ * or 0 on success.
+ */
+int timing_init();
+
+#endif
@@ -0,0 +1,126 @@
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "uring.h"
+
+/**
+ * Set up a ring with room for at least `entries` submissions at a
+ * time. Return 1 on error (with errno set) or 0 on success.
+ */
+int uring_init(uring* r, unsigned entries)
+{
+    struct io_uring_params p;
+
+    memset(r, 0, sizeof(uring));
+    memset(&p, 0, sizeof(p));
+    if ((r->fd = syscall(__NR_io_uring_setup, entries, &p)) < 0)
+        return 1;
+
+    // waiting with a timeout needs IORING_ENTER_EXT_ARG (Linux 5.11)
+    if (!(p.features & IORING_FEAT_EXT_ARG)) {
+        close(r->fd);
+        errno = ENOSYS;
+        return 1;
+    }
+
+    r->sq_map_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_map_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    r->sq_map = mmap(NULL, r->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    r->cq_map = mmap(NULL, r->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+    r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sq_map == MAP_FAILED || r->cq_map == MAP_FAILED || r->sqes == MAP_FAILED) {
+        uring_free(r);
+        return 1;
+    }
+
+    r->sq_head = (unsigned*)((char*)r->sq_map + p.sq_off.head);
+    r->sq_tail = (unsigned*)((char*)r->sq_map + p.sq_off.tail);
+    r->sq_array = (unsigned*)((char*)r->sq_map + p.sq_off.array);
+    r->sq_mask = *(unsigned*)((char*)r->sq_map + p.sq_off.ring_mask);
+    r->sq_entries = p.sq_entries;
+    r->cq_head = (unsigned*)((char*)r->cq_map + p.cq_off.head);
+    r->cq_tail = (unsigned*)((char*)r->cq_map + p.cq_off.tail);
+    r->cq_mask = *(unsigned*)((char*)r->cq_map + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe*)((char*)r->cq_map + p.cq_off.cqes);
+
+    return 0;
+}
+
+void uring_free(uring* r)
+{
+    if (r->sq_map != NULL && r->sq_map != MAP_FAILED)
+        munmap(r->sq_map, r->sq_map_size);
+    if (r->cq_map != NULL && r->cq_map != MAP_FAILED)
+        munmap(r->cq_map, r->cq_map_size);
+    if (r->sqes != NULL && r->sqes != MAP_FAILED)
+        munmap(r->sqes, r->sqes_size);
+    close(r->fd);
+}
+
+/**
+ * Hand the kernel what's queued, optionally waiting for completions.
+ */
+static int enter(uring* r, unsigned wait_nr, long timeout_ns)
+{
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    unsigned flags = IORING_ENTER_EXT_ARG;
+    int n;
+
+    memset(&arg, 0, sizeof(arg));
+    if (wait_nr > 0) {
+        flags |= IORING_ENTER_GETEVENTS;
+        if (timeout_ns >= 0) {
+            ts.tv_sec = timeout_ns / 1000000000;
+            ts.tv_nsec = timeout_ns % 1000000000;
+            arg.ts = (unsigned long)&ts;
+        }
+    }
+
+    n = syscall(__NR_io_uring_enter, r->fd, r->to_submit, wait_nr, flags, &arg, sizeof(arg));
+    if (n < 0 && errno != ETIME && errno != EINTR)
+        return -1;
+    // the kernel takes every entry unless it fails outright
+    r->to_submit -= (n > 0 ? (unsigned)n : 0);
+    return 0;
+}
+
+/**
+ * Return a cleared submission entry to fill in, submitting what's
+ * queued first if the queue is full. Return NULL on error.
+ */
+struct io_uring_sqe* uring_sqe(uring* r)
+{
+    unsigned tail = *r->sq_tail, index;
+    struct io_uring_sqe* sqe;
+
+    if (tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) >= r->sq_entries) {
+        if (enter(r, 0, -1) != 0)
+            return NULL;
+        if (tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) >= r->sq_entries)
+            return NULL;
+    }
+
+    index = tail & r->sq_mask;
+    sqe = &r->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    r->sq_array[index] = index;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    r->to_submit++;
+    return sqe;
+}
+
+/**
+ * Submit what's queued, and wait for at least one completion, or
+ * until timeout_ns (if it isn't negative) has passed.
+ * Return -1 on error (with errno set), or 0.
+ */
+int uring_wait(uring* r, long timeout_ns)
+{
+    return enter(r, 1, timeout_ns);
+}
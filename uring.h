@@ -0,0 +1,74 @@
+#ifndef WIDELOAD_URING_H
+#define WIDELOAD_URING_H
+
+#include <linux/io_uring.h>
+
+/**
+ * An io_uring instance, set up and driven with the raw system calls
+ * (there's no liburing dependency). Only one thread uses each ring.
+ */
+typedef struct {
+    int                  fd;
+
+    /* submission queue: the shared ring of indexes, and the entries */
+    unsigned*            sq_head;
+    unsigned*            sq_tail;
+    unsigned*            sq_array;
+    unsigned             sq_mask;
+    unsigned             sq_entries;
+    struct io_uring_sqe* sqes;
+    unsigned             to_submit;
+
+    /* completion queue */
+    unsigned*            cq_head;
+    unsigned*            cq_tail;
+    unsigned             cq_mask;
+    struct io_uring_cqe* cqes;
+
+    void*                sq_map;
+    unsigned long        sq_map_size;
+    void*                cq_map;
+    unsigned long        cq_map_size;
+    unsigned long        sqes_size;
+} uring;
+
+/**
+ * Set up a ring with room for at least `entries` submissions at a
+ * time. Return 1 on error (with errno set) or 0 on success.
+ */
+int uring_init(uring* r, unsigned entries);
+
+void uring_free(uring* r);
+
+/**
+ * Return a cleared submission entry to fill in, submitting what's
+ * queued first if the queue is full. Return NULL on error.
+ */
+struct io_uring_sqe* uring_sqe(uring* r);
+
+/**
+ * Submit what's queued, and wait for at least one completion, or
+ * until timeout_ns (if it isn't negative) has passed.
+ * Return -1 on error (with errno set), or 0.
+ */
+int uring_wait(uring* r, long timeout_ns);
+
+/**
+ * Return the next completion, or NULL if there is none; pass it to
+ * uring_seen() once done with it.
+ */
+static inline struct io_uring_cqe* uring_peek(uring* r)
+{
+    unsigned head = *r->cq_head;
+
+    if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE))
+        return NULL;
+    return &r->cqes[head & r->cq_mask];
+}
+
+static inline void uring_seen(uring* r)
+{
+    __atomic_store_n(r->cq_head, *r->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+#endif
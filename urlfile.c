@@ -1,10 +1,14 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <curl/curl.h>
 #include <yaml.h>
 
 #include "urlfile.h"
+#include "reqset.h"
+#include "payload.h"
+#include "template.h"
 #include "list.h"
 #include "base64decode.h"
 
@@ -102,6 +106,23 @@ parse_headers_error:
     return 1;
 }
 
+/**
+ * Point the `req`'s payload at the payload file at `path`,
+ * which is mapped rather than read, and shared with any other
+ * requests that name the same file.
+ *
+ * Return 1 on error or 0 on success.
+ */
+int map_payload(const char* path, request* req)
+{
+    if ((req->payload_map = payload_open(path)) == NULL)
+        return 1;
+
+    req->payload = req->payload_map->data;
+    req->payload_length = req->payload_map->length;
+    return 0;
+}
+
 /**
  * Parse a (possibly base64 encoded) payload and set it on
  * the `req`.
@@ -162,6 +183,70 @@ int parse_payload(yaml_parser_t* parser, yaml_event_t* event, request* req)
     return 0;
 }
 
+/* what expect_status takes, for its error messages */
+#define EXPECT_USAGE "up to %d statuses from 100 to 597, separated by commas or in a list"
+
+/**
+ * Parse a comma-separated list of statuses into the `req`'s expected
+ * ones. Return 1 on error or 0 on success.
+ */
+int parse_expect(const char* value, request* req)
+{
+    const char* p = value;
+    char* end;
+    unsigned long status;
+    int n = 0;
+
+    memset(req->expect, 0, sizeof(req->expect));
+    while (1) {
+        p += strspn(p, " ");
+        status = strtoul(p, &end, 10);
+        // 598 and 599 are wideload's own, for requests that failed
+        if (end == p || *p == '-' || status < 100 || status > 597 || n == EXPECT_MAX)
+            return 1;
+        req->expect[n++] = status;
+        p = end + strspn(end, " ");
+        if (*p == '\0')
+            return 0;
+        if (*p++ != ',')
+            return 1;
+    }
+}
+
+/**
+ * Parse a YAML list of statuses into the `req`'s expected ones, as
+ * parse_expect() would the same statuses separated by commas, which
+ * are left in `text` (of `size` bytes) for reporting.
+ *
+ * It is assumed that the `parser` has just encountered the list's
+ * YAML_SEQUENCE_START_EVENT. Return 1 on error or 0 on success.
+ */
+int parse_expect_list(yaml_parser_t* parser, request* req, char* text, unsigned long size)
+{
+    yaml_event_t event;
+    unsigned long length = 0;
+
+    text[0] = '\0';
+    while (1) {
+        if (!yaml_parser_parse(parser, &event))
+            return 1;
+        if (event.type == YAML_SEQUENCE_END_EVENT)
+            break;
+        // a nested list or mapping is no status; nor is a list too
+        // long to be EXPECT_MAX of them
+        if (event.type != YAML_SCALAR_EVENT ||
+                (length += snprintf(text + length, size - length, "%s%s", length > 0 ? "," : "",
+                                    event.data.scalar.value)) >= size) {
+            yaml_event_delete(&event);
+            return 1;
+        }
+        yaml_event_delete(&event);
+    }
+    yaml_event_delete(&event);
+
+    return parse_expect(text, req);
+}
+
 /**
  * Parse and return a single request from the YAML URLs file.
  *
@@ -181,6 +266,7 @@ request* parse_request(yaml_parser_t* parser)
     request* req;
     unsigned long expected_ends = 1;
     unsigned long i;
+    char statuses[64];
 
     if (!(req = malloc(sizeof(request))))
         goto parse_request_error;
@@ -191,6 +277,14 @@ request* parse_request(yaml_parser_t* parser)
     req->headers = NULL;
     req->num_headers = 0;
     req->curl_headers = NULL;
+    req->chunk = NULL;
+    req->payload_map = NULL;
+    req->tmpl = NULL;
+    req->weight = 1.0;
+    req->name = NULL;
+    req->endpoint = 0;
+    req->timeout = 0;
+    memset(req->expect, 0, sizeof(req->expect));
 
     yaml_event_t event;
 
@@ -239,7 +333,72 @@ request* parse_request(yaml_parser_t* parser)
                 break;
 
             case YAML_SCALAR_EVENT:
-                if (0 == strncmp("payload", (const char*)event.data.scalar.value, 7)) {
+                if (0 == strcmp("payload_file", (const char*)event.data.scalar.value)) {
+                    // parse the payload file name
+                    yaml_event_delete(&event);
+                    if (!yaml_parser_parse(parser, &event) || event.type != YAML_SCALAR_EVENT)
+                        goto parse_request_error;
+                    if (req->payload != NULL) {
+                        fprintf(stderr, "More than one payload for '%s'\n", req->url);
+                        goto parse_request_error;
+                    }
+                    if (map_payload((const char*)event.data.scalar.value, req)) {
+                        fprintf(stderr, "Could not read payload file '%s'\n", event.data.scalar.value);
+                        goto parse_request_error;
+                    }
+                } else if (0 == strcmp("weight", (const char*)event.data.scalar.value)) {
+                    // parse the request's share of the mix
+                    char* end;
+                    yaml_event_delete(&event);
+                    if (!yaml_parser_parse(parser, &event) || event.type != YAML_SCALAR_EVENT)
+                        goto parse_request_error;
+                    req->weight = strtod((const char*)event.data.scalar.value, &end);
+                    if (*end != '\0' || end == (char*)event.data.scalar.value || !(req->weight >= 0)) {
+                        fprintf(stderr, "Invalid weight '%s' for '%s'\n", event.data.scalar.value, req->url);
+                        goto parse_request_error;
+                    }
+                } else if (0 == strcmp("timeout", (const char*)event.data.scalar.value)) {
+                    // parse the request's own --fail-after
+                    char* end;
+                    yaml_event_delete(&event);
+                    if (!yaml_parser_parse(parser, &event) || event.type != YAML_SCALAR_EVENT)
+                        goto parse_request_error;
+                    req->timeout = strtoul((const char*)event.data.scalar.value, &end, 10);
+                    if (*end != '\0' || req->timeout == 0 || *(char*)event.data.scalar.value == '-') {
+                        fprintf(stderr, "Invalid timeout '%s' for '%s'\n", event.data.scalar.value, req->url);
+                        goto parse_request_error;
+                    }
+                } else if (0 == strcmp("expect_status", (const char*)event.data.scalar.value)) {
+                    // parse the statuses the request succeeds with: one,
+                    // several separated by commas, or a list of them
+                    yaml_event_delete(&event);
+                    if (!yaml_parser_parse(parser, &event))
+                        goto parse_request_error;
+                    if (event.type == YAML_SCALAR_EVENT) {
+                        if (parse_expect((const char*)event.data.scalar.value, req)) {
+                            fprintf(stderr, "Invalid expect_status '%s' for '%s' (" EXPECT_USAGE ")\n",
+                                    event.data.scalar.value, req->url, EXPECT_MAX);
+                            goto parse_request_error;
+                        }
+                    } else if (event.type == YAML_SEQUENCE_START_EVENT) {
+                        if (parse_expect_list(parser, req, statuses, sizeof(statuses))) {
+                            fprintf(stderr, "Invalid expect_status [%s] for '%s' (" EXPECT_USAGE ")\n",
+                                    statuses, req->url, EXPECT_MAX);
+                            goto parse_request_error;
+                        }
+                    } else {
+                        fprintf(stderr, "Invalid expect_status for '%s' (" EXPECT_USAGE ")\n", req->url, EXPECT_MAX);
+                        goto parse_request_error;
+                    }
+                } else if (0 == strcmp("name", (const char*)event.data.scalar.value)) {
+                    // parse the endpoint the request is reported under
+                    yaml_event_delete(&event);
+                    if (!yaml_parser_parse(parser, &event) || event.type != YAML_SCALAR_EVENT)
+                        goto parse_request_error;
+                    free(req->name);
+                    if (!(req->name = strdup((const char*)event.data.scalar.value)))
+                        goto parse_request_error;
+                } else if (0 == strncmp("payload", (const char*)event.data.scalar.value, 7)) {
                     // printf("  calling parse_payload()\n");
                     if (parse_payload(parser, &event, req))
                         goto parse_request_error;
@@ -274,7 +433,10 @@ parse_request_error:
     if (req != NULL ) {
         if (req->url != NULL)
             free(req->url);
-        if (req->payload != NULL)
+        free(req->name);
+        if (req->payload_map != NULL)
+            payload_close(req->payload_map);
+        else if (req->payload != NULL)
             free(req->payload);
         if (req->headers != NULL) {
             for (i=0; i<req->num_headers; i++) {
@@ -310,6 +472,10 @@ requests parse_urls(const char* url_filename)
 
     reqs.count = 0;
     reqs.reqs = NULL;
+    reqs.mapping = NULL;
+    reqs.mapping_size = 0;
+    reqs.header_pool = NULL;
+    reqs.curl_header_pool = NULL;
     req_list = list_new();
 
     urls = fopen(url_filename, "r");
@@ -374,6 +540,14 @@ requests parse_urls(const char* url_filename)
         reqs.reqs[i].headers = req->headers;
         reqs.reqs[i].num_headers = req->num_headers;
         reqs.reqs[i].curl_headers = req->curl_headers;
+        reqs.reqs[i].chunk = NULL;
+        reqs.reqs[i].payload_map = req->payload_map;
+        reqs.reqs[i].tmpl = NULL;
+        reqs.reqs[i].weight = req->weight;
+        reqs.reqs[i].name = req->name;
+        reqs.reqs[i].endpoint = 0;
+        reqs.reqs[i].timeout = req->timeout;
+        memcpy(reqs.reqs[i].expect, req->expect, sizeof(req->expect));
         // printf("set request %lu with url %s\n", i, reqs.reqs[i].url);
         n = n->next;
     }
@@ -382,3 +556,311 @@ requests parse_urls(const char* url_filename)
 
     return reqs;
 }
+
+/**
+ * Parse a URL file line into a request
+ *
+ * A line holds the method and URL, then optionally any number of
+ * "Name: value" headers and an "@path" naming a file whose contents
+ * are the POST payload. Fields are separated by tabs, or, if there
+ * are no tabs in the line, by spaces (in which case there can be no
+ * headers). The `line` is modified in place.
+ *
+ * On error, a message is printed and the returned request's url
+ * is NULL. Blank and comment lines are the caller's to skip.
+ */
+request parse_line(char* line, const char* url_filename, int lineno)
+{
+    request req;
+    char* rest = line;
+    char* field;
+    char* value;
+    char* full_header;
+    const char* sep = (strchr(line, '\t') != NULL ? "\t" : " ");
+    unsigned long i, max_headers = 0;
+    int nfield = 0;
+
+    req.method = HTTP_GET;
+    req.url = NULL;
+    req.payload = NULL;
+    req.payload_length = 0;
+    req.headers = NULL;
+    req.num_headers = 0;
+    req.curl_headers = NULL;
+    req.chunk = NULL;
+    req.payload_map = NULL;
+    req.tmpl = NULL;
+    req.weight = 1.0;
+    req.name = NULL;
+    req.endpoint = 0;
+    req.timeout = 0;
+    memset(req.expect, 0, sizeof(req.expect));
+
+    line[strcspn(line, "\r\n")] = '\0';
+    for (field=line; *field; field++)
+        if (*field == *sep)
+            max_headers++;
+    if (max_headers > 0 && !(req.headers = malloc(sizeof(header) * max_headers)))
+        goto parse_line_error;
+
+    while ((field = strsep(&rest, sep)) != NULL) {
+        if (*field == '\0')
+            continue;
+
+        if (nfield == 0) {
+            // parse the method
+            if (0 == strcasecmp("get", field)) {
+                req.method = HTTP_GET;
+            } else if (0 == strcasecmp("post", field)) {
+                req.method = HTTP_POST;
+            } else {
+                fprintf(stderr, "%s:%d: Unknown HTTP method '%s'\n", url_filename, lineno, field);
+                goto parse_line_error;
+            }
+        } else if (nfield == 1) {
+            // parse the URL
+            if (!(req.url = strdup(field)))
+                goto parse_line_error;
+        } else if (field[0] == '@') {
+            // parse the payload reference
+            if (req.payload_map != NULL) {
+                fprintf(stderr, "%s:%d: More than one payload\n", url_filename, lineno);
+                goto parse_line_error;
+            }
+            if (req.method != HTTP_POST) {
+                fprintf(stderr, "%s:%d: Payload given for a GET request\n", url_filename, lineno);
+                goto parse_line_error;
+            }
+            if (map_payload(field + 1, &req)) {
+                fprintf(stderr, "%s:%d: Could not read payload file '%s'\n", url_filename, lineno, field + 1);
+                goto parse_line_error;
+            }
+        } else {
+            // parse a header
+            if ((value = strchr(field, ':')) == NULL || value == field) {
+                fprintf(stderr, "%s:%d: Invalid header '%s'\n", url_filename, lineno, field);
+                goto parse_line_error;
+            }
+            *value++ = '\0';
+            while (*value == ' ')
+                value++;
+
+            header* hdr = &req.headers[req.num_headers];
+            if (!(hdr->name = strdup(field)))
+                goto parse_line_error;
+            if (!(hdr->value = strdup(value))) {
+                free(hdr->name);
+                goto parse_line_error;
+            }
+            req.num_headers++;
+
+            // also set up header list for libcurl
+            full_header = malloc(sizeof(char) * (strlen(hdr->name) + strlen(hdr->value) + 3));
+            if (!full_header)
+                goto parse_line_error;
+            sprintf(full_header, "%s: %s", hdr->name, hdr->value);
+            req.curl_headers = curl_slist_append(req.curl_headers, full_header);
+            free(full_header);
+            if (req.curl_headers == NULL)
+                goto parse_line_error;
+        }
+        nfield++;
+    }
+
+    if (nfield < 2) {
+        fprintf(stderr, "%s:%d: Expected a method and a URL\n", url_filename, lineno);
+        goto parse_line_error;
+    }
+
+    return req;
+
+parse_line_error:
+    free(req.url);
+    if (req.payload_map != NULL)
+        payload_close(req.payload_map);
+    for (i=0; i<req.num_headers; i++) {
+        free(req.headers[i].name);
+        free(req.headers[i].value);
+    }
+    free(req.headers);
+    curl_slist_free_all(req.curl_headers);
+    req.url = NULL;
+    return req;
+}
+
+/**
+ * Return 1 if a URL file line holds no request (it is blank, or a
+ * comment starting with '#'), or 0 if it should be parsed.
+ */
+int skip_line(const char* line)
+{
+    line += strspn(line, " \t");
+    return (*line == '\0' || *line == '\r' || *line == '\n' || *line == '#');
+}
+
+/**
+ * Return 1 if the URL file is in the line-oriented format (its
+ * first request line starts with a method), or 0 if not.
+ */
+int detect_line_format(const char* url_filename)
+{
+    FILE* urls;
+    char* line = NULL;
+    size_t line_size = 0;
+    const char* start;
+    int found = 0;
+
+    if ((urls = fopen(url_filename, "r")) == NULL)
+        return 0;
+
+    while (getline(&line, &line_size, urls) >= 0) {
+        if (skip_line(line))
+            continue;
+        start = line + strspn(line, " \t");
+        found = ((0 == strncasecmp("get", start, 3) && (start[3] == ' ' || start[3] == '\t')) ||
+                 (0 == strncasecmp("post", start, 4) && (start[4] == ' ' || start[4] == '\t')));
+        break;
+    }
+
+    free(line);
+    fclose(urls);
+    return found;
+}
+
+/**
+ * Parse a whole line-oriented URL file into a requests
+ */
+requests parse_lines(const char* url_filename)
+{
+    unsigned long i;
+
+    requests reqs;
+    request req;
+    request* copy;
+
+    list* req_list;
+    node* n;
+    FILE* urls;
+    char* line = NULL;
+    size_t line_size = 0;
+    int lineno = 0;
+
+    reqs.count = 0;
+    reqs.reqs = NULL;
+    reqs.mapping = NULL;
+    reqs.mapping_size = 0;
+    reqs.header_pool = NULL;
+    reqs.curl_header_pool = NULL;
+    req_list = list_new();
+
+    if ((urls = fopen(url_filename, "r")) == NULL) {
+        perror(url_filename);
+        exit(1);
+    }
+
+    while (getline(&line, &line_size, urls) >= 0) {
+        lineno++;
+        if (skip_line(line))
+            continue;
+
+        req = parse_line(line, url_filename, lineno);
+        if (req.url == NULL || !(copy = malloc(sizeof(request)))) {
+            fprintf(stderr, "Error parsing URLs file\n");
+            exit(1);
+        }
+        *copy = req;
+        n = list_node_new(copy);
+        list_push(req_list, n);
+    }
+    free(line);
+    fclose(urls);
+
+    if (!(reqs.reqs = malloc(sizeof(request) * req_list->length))) {
+        list_free(req_list, 1);
+        exit(2);
+    }
+
+    n = req_list->head;
+    for (i=0; i<req_list->length; i++) {
+        reqs.reqs[i] = *(request *)(n->data);
+        n = n->next;
+    }
+    reqs.count = req_list->length;
+    list_free(req_list, 1);
+
+    return reqs;
+}
+
+/**
+ * Load a URL file or a compiled request set into a requests
+ */
+requests load_requests(const char* url_filename)
+{
+    requests reqs;
+    unsigned long i;
+
+    if (reqset_detect(url_filename))
+        reqs = reqset_load(url_filename);
+    else if (detect_line_format(url_filename))
+        reqs = parse_lines(url_filename);
+    else
+        reqs = parse_urls(url_filename);
+
+    if (reqs.count == 0) {
+        fprintf(stderr, "No requests in URLs file\n");
+        exit(1);
+    }
+
+    for (i=0; i<reqs.count; i++) {
+        if (template_prepare(&reqs.reqs[i]) != 0) {
+            fprintf(stderr, "Error in the templates of %s\n", reqs.reqs[i].url);
+            exit(1);
+        }
+    }
+
+    return reqs;
+}
+
+/**
+ * Free the strings and headers of a parsed request
+ */
+void free_request(request* req)
+{
+    unsigned long j;
+
+    template_release(req);
+    free(req->url);
+    free(req->name);
+    if (req->payload_map != NULL)
+        payload_close(req->payload_map);
+    else
+        free(req->payload);
+    for (j=0; j<req->num_headers; j++) {
+        free(req->headers[j].name);
+        free(req->headers[j].value);
+    }
+    free(req->headers);
+    curl_slist_free_all(req->curl_headers);
+}
+
+/**
+ * Free everything load_requests() allocated
+ */
+void free_requests(requests reqs)
+{
+    unsigned long i;
+
+    if (reqs.mapping != NULL) {
+        // everything but the three arrays (and any templates)
+        // is in the mapping
+        for (i=0; i<reqs.count; i++)
+            template_release(&reqs.reqs[i]);
+        free(reqs.header_pool);
+        free(reqs.curl_header_pool);
+        munmap(reqs.mapping, reqs.mapping_size);
+    } else {
+        for (i=0; i<reqs.count; i++)
+            free_request(&reqs.reqs[i]);
+    }
+    free(reqs.reqs);
+}
@@ -6,12 +6,53 @@
 
 /**
  * Parse a URL file line into a request
+ *
+ * A line holds the method and URL, then optionally any number of
+ * "Name: value" headers and an "@path" naming a file whose contents
+ * are the POST payload. Fields are separated by tabs, or, if there
+ * are no tabs in the line, by spaces (in which case there can be no
+ * headers). The `line` is modified in place.
+ *
+ * On error, a message is printed and the returned request's url
+ * is NULL. Blank and comment lines are the caller's to skip.
  */
 request parse_line(char* line, const char* url_filename, int lineno);
 
+/**
+ * Return 1 if a URL file line holds no request (it is blank, or a
+ * comment starting with '#'), or 0 if it should be parsed.
+ */
+int skip_line(const char* line);
+
+/**
+ * Return 1 if the URL file is in the line-oriented format (its
+ * first request line starts with a method), or 0 if not.
+ */
+int detect_line_format(const char* url_filename);
+
+/**
+ * Parse a whole line-oriented URL file into a requests
+ */
+requests parse_lines(const char* url_filename);
+
 /**
  * Parse a URL file into a requests
  */
 requests parse_urls(const char* url_filename);
 
+/**
+ * Load a URL file or a compiled request set into a requests
+ */
+requests load_requests(const char* url_filename);
+
+/**
+ * Free the strings and headers of a parsed request
+ */
+void free_request(request* req);
+
+/**
+ * Free everything load_requests() allocated
+ */
+void free_requests(requests reqs);
+
 #endif
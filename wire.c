@@ -0,0 +1,291 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "wire.h"
+
+/* the header is sent as two ints and a long */
+typedef struct {
+    unsigned int   type;
+    unsigned int   reserved;
+    unsigned long  length;
+} msg_header;
+
+/* histograms in the order they're encoded */
+#define STATS_HISTOGRAMS (2 + PHASE_COUNT)
+
+static histogram* stats_histogram(stats* st, int i)
+{
+    return (i == 0 ? &st->latency : i == 1 ? &st->corrected : &st->phases[i - 2]);
+}
+
+static int write_all(int fd, const void* buf, unsigned long len)
+{
+    const char* p = buf;
+    ssize_t n;
+
+    while (len > 0) {
+        // a closed connection is an error here, not a SIGPIPE
+        if ((n = send(fd, p, len, MSG_NOSIGNAL)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return 1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int read_all(int fd, void* buf, unsigned long len)
+{
+    char* p = buf;
+    ssize_t n;
+
+    while (len > 0) {
+        if ((n = recv(fd, p, len, 0)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return 1;
+        }
+        if (n == 0)
+            return 1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/**
+ * Send a message. Return 1 on error or 0 on success.
+ */
+int wire_send(int fd, unsigned int type, const void* body, unsigned long length)
+{
+    msg_header header;
+
+    memset(&header, 0, sizeof(header));
+    header.type = type;
+    header.length = length;
+    if (write_all(fd, &header, sizeof(header)) != 0)
+        return 1;
+    return (length > 0 ? write_all(fd, body, length) : 0);
+}
+
+/**
+ * Receive a message into a malloc'd `body`, which the caller
+ * frees. Return 1 on error, end of file, or a body longer than
+ * WIRE_MAX_LENGTH, or 0 on success.
+ */
+int wire_recv(int fd, unsigned int* type, void** body, unsigned long* length)
+{
+    msg_header header;
+
+    *body = NULL;
+    if (read_all(fd, &header, sizeof(header)) != 0)
+        return 1;
+    // the peer says how much it sends, but not how much is kept
+    if (header.length > WIRE_MAX_LENGTH) {
+        fprintf(stderr, "Message of %lu bytes is too long\n", header.length);
+        return 1;
+    }
+
+    // one extra byte, so that text bodies can be NUL-terminated
+    if ((*body = malloc(header.length + 1)) == NULL)
+        return 1;
+    if (read_all(fd, *body, header.length) != 0) {
+        free(*body);
+        *body = NULL;
+        return 1;
+    }
+    ((char*)*body)[header.length] = '\0';
+
+    *type = header.type;
+    *length = header.length;
+    return 0;
+}
+
+/**
+ * Listen on a TCP address and port. Return the socket, or -1 on
+ * error.
+ */
+int wire_listen(const char* address, unsigned long port)
+{
+    struct addrinfo hints, *found;
+    char service[8];
+    int fd, err, on = 1, off = 0;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+    snprintf(service, sizeof(service), "%lu", port);
+    if ((err = getaddrinfo(address, service, &hints, &found)) != 0) {
+        fprintf(stderr, "Could not resolve %s: %s\n", address, gai_strerror(err));
+        return -1;
+    }
+
+    if ((fd = socket(found->ai_family, found->ai_socktype, found->ai_protocol)) < 0) {
+        perror("socket");
+        freeaddrinfo(found);
+        return -1;
+    }
+    // an IPv6 wildcard takes IPv4 connections too, and a restart
+    // needn't wait for the last run's connections to time out
+    if (found->ai_family == AF_INET6)
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    if (bind(fd, found->ai_addr, found->ai_addrlen) != 0 || listen(fd, 16) != 0) {
+        fprintf(stderr, "Could not listen on %s port %lu: %s\n", address, port, strerror(errno));
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(found);
+    return fd;
+}
+
+/**
+ * Connect to "HOST:PORT". Return the socket, or -1 on error.
+ */
+int wire_connect(const char* address)
+{
+    struct addrinfo hints, *found, *ai;
+    char host[256];
+    const char* colon = strrchr(address, ':');
+    int fd = -1, err, on = 1;
+
+    if (colon == NULL || colon == address || colon - address >= sizeof(host)) {
+        fprintf(stderr, "Agent address %s should be HOST:PORT\n", address);
+        return -1;
+    }
+    memcpy(host, address, colon - address);
+    host[colon - address] = '\0';
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if ((err = getaddrinfo(host, colon + 1, &hints, &found)) != 0) {
+        fprintf(stderr, "Could not resolve %s: %s\n", address, gai_strerror(err));
+        return -1;
+    }
+    for (ai=found; ai!=NULL; ai=ai->ai_next) {
+        if ((fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) < 0)
+            continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+            break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(found);
+
+    if (fd < 0) {
+        fprintf(stderr, "Could not connect to agent %s\n", address);
+        return -1;
+    }
+    // messages are small and each is waited on
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    return fd;
+}
+
+/**
+ * Encode a stats (which nothing is recording into) as a malloc'd
+ * message body, which the caller frees. Only the non-empty counts
+ * of each histogram are sent. Return NULL on error.
+ */
+void* wire_encode_stats(const stats* st, unsigned long* length)
+{
+    unsigned long words = 8, nonzero, *body, *p;
+    int i, j;
+
+    // the counters, then per histogram its total, min, max, the
+    // number of non-empty counts and an (index, count) for each
+    for (i=0; i<STATS_HISTOGRAMS; i++) {
+        const histogram* h = stats_histogram((stats*)st, i);
+        words += 4;
+        for (j=0; j<h->counts_len; j++)
+            words += (h->counts[j] != 0 ? 2 : 0);
+    }
+    if ((body = malloc(words * sizeof(unsigned long))) == NULL)
+        return NULL;
+
+    p = body;
+    *p++ = st->requests;
+    *p++ = st->failures;
+    *p++ = st->timeouts;
+    *p++ = st->bytes;
+    *p++ = st->bytes_sent;
+    *p++ = st->connects;
+    *p++ = st->late;
+    *p++ = st->max_late;
+    for (i=0; i<STATS_HISTOGRAMS; i++) {
+        const histogram* h = stats_histogram((stats*)st, i);
+        unsigned long* count_at;
+
+        *p++ = h->total;
+        *p++ = h->min;
+        *p++ = h->max;
+        count_at = p++;
+        for (j=0, nonzero=0; j<h->counts_len; j++) {
+            if (h->counts[j] == 0)
+                continue;
+            *p++ = j;
+            *p++ = h->counts[j];
+            nonzero++;
+        }
+        *count_at = nonzero;
+    }
+
+    *length = words * sizeof(unsigned long);
+    return body;
+}
+
+/**
+ * Replace `st`'s totals with an encoded stats. Return 1 if the
+ * body is malformed or 0 on success.
+ */
+int wire_decode_stats(stats* st, const void* body, unsigned long length)
+{
+    const unsigned long* p = body;
+    const unsigned long* end = p + length / sizeof(unsigned long);
+    unsigned long nonzero, index, k;
+    int i;
+
+    if (length % sizeof(unsigned long) != 0 || end - p < 8)
+        return 1;
+
+    stats_clear(st);
+    st->requests = *p++;
+    st->failures = *p++;
+    st->timeouts = *p++;
+    st->bytes = *p++;
+    st->bytes_sent = *p++;
+    st->connects = *p++;
+    st->late = *p++;
+    st->max_late = *p++;
+    for (i=0; i<STATS_HISTOGRAMS; i++) {
+        histogram* h = stats_histogram(st, i);
+
+        if (end - p < 4)
+            return 1;
+        h->total = *p++;
+        h->min = *p++;
+        h->max = *p++;
+        nonzero = *p++;
+        if ((end - p) / 2 < nonzero)
+            return 1;
+        for (k=0; k<nonzero; k++) {
+            index = *p++;
+            if (index >= (unsigned long)h->counts_len)
+                return 1;
+            h->counts[index] = *p++;
+        }
+    }
+
+    return (p == end ? 0 : 1);
+}
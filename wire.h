@@ -0,0 +1,62 @@
+#ifndef WIDELOAD_WIRE_H
+#define WIDELOAD_WIRE_H
+
+#include "stats.h"
+
+/*
+ * Messages between a coordinator and its agents are a header of
+ * two 32-bit words (type and reserved) and a 64-bit length, then
+ * `length` bytes of body. Everything is in host byte order, so the
+ * coordinator and agents must run on the same architecture.
+ */
+
+typedef enum {
+    MSG_ARGS = 1,  /* coordinator: the agent's command line, NUL-separated */
+    MSG_FILE,      /* coordinator: the request set to load */
+    MSG_READY,     /* agent: loaded, waiting to start */
+    MSG_START,     /* coordinator: 64-bit wall clock nanos to start at */
+    MSG_STATS,     /* agent: running totals so far */
+    MSG_FINAL,     /* agent: totals for the whole run */
+    MSG_STOP       /* coordinator: stop early */
+} msg_type;
+
+/**
+ * Send a message. Return 1 on error or 0 on success.
+ */
+int wire_send(int fd, unsigned int type, const void* body, unsigned long length);
+
+/**
+ * Receive a message into a malloc'd `body`, which the caller
+ * frees. Return 1 on error, end of file, or a body longer than
+ * WIRE_MAX_LENGTH, or 0 on success.
+ */
+int wire_recv(int fd, unsigned int* type, void** body, unsigned long* length);
+
+/* the largest message body received, which bounds a request set */
+#define WIRE_MAX_LENGTH (1UL << 30)
+
+/**
+ * Listen on a TCP address and port. Return the socket, or -1 on
+ * error.
+ */
+int wire_listen(const char* address, unsigned long port);
+
+/**
+ * Connect to "HOST:PORT". Return the socket, or -1 on error.
+ */
+int wire_connect(const char* address);
+
+/**
+ * Encode a stats (which nothing is recording into) as a malloc'd
+ * message body, which the caller frees. Only the non-empty counts
+ * of each histogram are sent. Return NULL on error.
+ */
+void* wire_encode_stats(const stats* st, unsigned long* length);
+
+/**
+ * Replace `st`'s totals with an encoded stats. Return 1 if the
+ * body is malformed or 0 on success.
+ */
+int wire_decode_stats(stats* st, const void* body, unsigned long length);
+
+#endif
@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "loader.h"
+#include "writer.h"
+#include "stream.h"
+
+#define WRITE_BUFFER_SIZE (4 * 1024 * 1024)
+
+/* phase times are stored as 32-bit micros */
+static inline uint32_t micros32(unsigned long nanos)
+{
+    return (nanos / 1000 > UINT32_MAX ? UINT32_MAX : nanos / 1000);
+}
+
+/**
+ * Write out one batch of results as binary records.
+ */
+static void write_records(writer* wr, result_batch* batch)
+{
+    unsigned long i;
+
+    for (i=0; i<batch->count; i++) {
+        result* rslt = &batch->rslts[i];
+        results_record* rec = &wr->records[i];
+
+        rec->time_start = rslt->time_start;
+        rec->time_intended = rslt->time_intended;
+        rec->request = rslt->req - wr->reqs;
+        rec->status = rslt->status;
+        rec->reused = rslt->reused;
+        rec->reserved = 0;
+        rec->dns = micros32(rslt->time_dns);
+        rec->connect = micros32(rslt->time_connect);
+        rec->tls = micros32(rslt->time_tls);
+        rec->pretransfer = micros32(rslt->time_pretransfer);
+        rec->ttfb = micros32(rslt->time_ttfb);
+        rec->total = micros32(rslt->time_end - rslt->time_start);
+        rec->bytes_received = rslt->num_bytes;
+        rec->header_bytes = rslt->header_bytes;
+        rec->request_bytes = rslt->request_bytes;
+    }
+
+    fwrite(wr->records, sizeof(results_record), batch->count, wr->out);
+}
+
+/**
+ * Write the header and request table of a binary results file.
+ */
+static void write_preamble(writer* wr, requests reqs)
+{
+    results_header header;
+    results_request entry;
+    unsigned long i, offset;
+    char padding[sizeof(results_record)];
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RESULTS_MAGIC, sizeof(header.magic));
+    header.version = RESULTS_VERSION;
+    header.record_size = sizeof(results_record);
+    header.wall_offset = wall_offset;
+    header.run_start = nanos();
+    header.req_count = reqs.count;
+
+    offset = sizeof(header) + reqs.count * sizeof(results_request);
+    for (i=0; i<reqs.count; i++)
+        offset += strlen(reqs.reqs[i].url) + 1;
+    // align the records, so they can be used in place when mapped
+    header.records_offset = (offset + sizeof(results_record) - 1) / sizeof(results_record) * sizeof(results_record);
+    fwrite(&header, sizeof(header), 1, wr->out);
+
+    offset = sizeof(header) + reqs.count * sizeof(results_request);
+    for (i=0; i<reqs.count; i++) {
+        entry.method = reqs.reqs[i].method;
+        entry.url_length = strlen(reqs.reqs[i].url);
+        entry.url_offset = offset;
+        memcpy(entry.expect, reqs.reqs[i].expect, sizeof(entry.expect));
+        fwrite(&entry, sizeof(entry), 1, wr->out);
+        offset += entry.url_length + 1;
+    }
+    for (i=0; i<reqs.count; i++)
+        fwrite(reqs.reqs[i].url, 1, strlen(reqs.reqs[i].url) + 1, wr->out);
+
+    memset(padding, 0, sizeof(padding));
+    fwrite(padding, 1, header.records_offset - offset, wr->out);
+}
+
+/**
+ * Write out one batch of results as CSV.
+ */
+static void write_batch(FILE* out, result_batch* batch)
+{
+    unsigned long i;
+
+    for (i=0; i<batch->count; i++) {
+        result* rslt = &batch->rslts[i];
+        fprintf(out, "%s,%s,%.6f,%.6f,%.6f,%d,%lu,%.6f,%.3f,%.3f,%.3f,%.3f,%.3f,%lu,%lu,%d\n",
+                rslt->req->method == HTTP_GET ? "GET" : "POST",
+                rslt->url != NULL ? batch->urls + rslt->url_offset : rslt->req->url,
+                (wall_offset + rslt->time_start) / 1000000000.0,
+                (wall_offset + rslt->time_first_byte) / 1000000000.0,
+                (wall_offset + rslt->time_end) / 1000000000.0,
+                rslt->status,
+                rslt->num_bytes,
+                (wall_offset + rslt->time_intended) / 1000000000.0,
+                rslt->time_dns / 1000000.0,
+                rslt->time_connect / 1000000.0,
+                rslt->time_tls / 1000000.0,
+                rslt->time_pretransfer / 1000000.0,
+                rslt->time_ttfb / 1000000.0,
+                rslt->header_bytes,
+                rslt->request_bytes,
+                rslt->reused);
+        stream_release(rslt->req);
+    }
+}
+
+/**
+ * Drain every worker's queue once; return the number of
+ * batches written.
+ */
+static unsigned long drain(writer* wr)
+{
+    unsigned long i, written = 0;
+    result_batch* batch;
+
+    for (i=0; i<wr->nthreads; i++) {
+        threadstate* state = &wr->states[i];
+        while ((batch = ring_pop(&state->full)) != NULL) {
+            if (wr->binary)
+                write_records(wr, batch);
+            else
+                write_batch(wr->out, batch);
+            written++;
+
+            batch->count = 0;
+            batch->urls_length = 0;
+            if (!ring_push(&state->spare, batch))
+                result_batch_free(batch);
+        }
+    }
+
+    return written;
+}
+
+static void* writer_thread(void* arg)
+{
+    writer* wr = (writer*)arg;
+    struct timespec idle = {0, 1000000};
+
+    while (!__atomic_load_n(&wr->done, __ATOMIC_ACQUIRE)) {
+        if (drain(wr) == 0) {
+            // nothing queued; push what we have to the OS, so an
+            // interrupted or crashed run still leaves it behind
+            fflush(wr->out);
+            nanosleep(&idle, NULL);
+        }
+    }
+
+    // the workers have finished; pick up their last batches
+    drain(wr);
+
+    return NULL;
+}
+
+/**
+ * Open opts.output and start draining results from every state,
+ * as CSV or (if opts.binary) in the format described in results.h.
+ * Return 1 on error or 0 on success.
+ */
+int writer_start(writer* wr, options opts, requests reqs, threadstate* states, unsigned long nthreads)
+{
+    if ((wr->out = fopen(opts.output, "w")) == NULL) {
+        perror(opts.output);
+        return 1;
+    }
+    setvbuf(wr->out, NULL, _IOFBF, WRITE_BUFFER_SIZE);
+
+    wr->binary = opts.binary;
+    wr->reqs = reqs.reqs;
+    if (wr->binary)
+        write_preamble(wr, reqs);
+    else
+        fputs(RESULTS_CSV_HEADER, wr->out);
+
+    wr->states = states;
+    wr->nthreads = nthreads;
+    wr->done = 0;
+
+    if (pthread_create(&wr->thread, NULL, writer_thread, wr) != 0) {
+        fclose(wr->out);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Write everything still queued and close the file; call only
+ * once the workers have finished.
+ */
+void writer_stop(writer* wr)
+{
+    __atomic_store_n(&wr->done, 1, __ATOMIC_RELEASE);
+    pthread_join(wr->thread, NULL);
+    fclose(wr->out);
+}
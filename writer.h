@@ -0,0 +1,40 @@
+#ifndef WIDELOAD_WRITER_H
+#define WIDELOAD_WRITER_H
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include "loader.h"
+#include "results.h"
+
+/**
+ * Background thread which drains each worker's full result
+ * batches to disk while the test runs, and hands the emptied
+ * batches back for reuse.
+ */
+typedef struct {
+    FILE*          out;
+    char           binary;
+    request*       reqs;
+    results_record records[RESULT_BATCH_SIZE];
+
+    threadstate*   states;
+    unsigned long  nthreads;
+    int            done;
+    pthread_t      thread;
+} writer;
+
+/**
+ * Open opts.output and start draining results from every state,
+ * as CSV or (if opts.binary) in the format described in results.h.
+ * Return 1 on error or 0 on success.
+ */
+int writer_start(writer* wr, options opts, requests reqs, threadstate* states, unsigned long nthreads);
+
+/**
+ * Write everything still queued and close the file; call only
+ * once the workers have finished.
+ */
+void writer_stop(writer* wr);
+
+#endif